@@ -11,19 +11,36 @@
 
 #include "MPU6050.h"
 
-uint32_t g_actual_time = 0;
-uint32_t g_prior_time = 0;
-
 float g_angle = 0.0f;
-float g_prior_angle = 0.0f;
 
-/*
- * @brief: Callback function for the PIT to increase a timer
- */
-void update_counter(void)
-{
-	g_actual_time++;
-}
+static uint32_t g_xfer_cycles = 0;
+static uint32_t g_xfer_start = 0;
+static MPU6050_fifo_stats_t g_fifo_stats = {0};
+
+// Samples acquired in interrupt context, consumed by MPU6050_update():
+SPSC_RING_DEFINE(g_ring, MPU6050_sample_t, MPU_RING_SIZE);
+
+// Non-blocking FIFO read state:
+static i2c_master_handle_t g_i2c_handle;
+static i2c_master_transfer_t g_xfer;
+static volatile MPU6050_xfer_state_t g_xfer_state = MPU_XFER_IDLE;
+static volatile bool g_suspended = false;
+static volatile bool g_xfer_pending = false;
+static uint32_t g_drdy_count = 0;
+static uint32_t g_frames_left = 0;
+static uint64_t g_count_time = 0;     // Time base (us) when the count was read.
+static uint8_t g_xfer_buff[MPU_FIFO_BURST * MPU_SAMPLE_BYTES];
+static uint8_t g_reset_cmd = MPU_USER_FIFO_EN | MPU_USER_FIFO_RESET;
+static void (*g_data_callback)(void) = 0;
+
+static void MPU6050_write_reg(uint8_t reg, uint8_t value);
+static void MPU6050_fifo_reset(void);
+static void MPU6050_process_sample(const MPU6050_sample_t * sample);
+static void MPU6050_int_callback(uint32_t flags);
+static void MPU6050_xfer_start(MPU6050_xfer_state_t state);
+static void MPU6050_xfer_callback(I2C_Type * base, i2c_master_handle_t * handle,
+		status_t status, void * userData);
+static void MPU6050_ring_push(const MPU6050_sample_t * sample);
 
 /*
  * @brief: Raise the number to the desired power
@@ -89,6 +106,7 @@ void MPU6050_init(void)
 	i2c_master_transfer_t masterXfer;
 	uint8_t master_txBuff[2] = {0};
 	uint32_t deviceAddress = 0x00U;
+	gpio_pin_config_t int_config = {kGPIO_DigitalInput, 0};
 
 
 	CLOCK_EnableClock(I2C_CLK_GATING);
@@ -97,6 +115,7 @@ void MPU6050_init(void)
 	PORT_SetPinMux(I2C_PORT, SDA_PIN, I2C_PIN_MUX);
 
 	I2C_MasterGetDefaultConfig(&masterConfig);
+	masterConfig.baudRate_Bps = MPU_I2C_BAUDRATE;
 	sourceClock = I2C_MASTER_CLK_FREQ;
 
 	I2C_MasterInit(MODULE_I2C, &masterConfig, sourceClock);
@@ -114,106 +133,494 @@ void MPU6050_init(void)
 
 	I2C_MasterTransferBlocking(I2C0, &masterXfer);
 
-	// PIT config:
-	pit_config_t pit_config;
-	PIT_GetDefaultConfig(&pit_config);
-	//PIT_Init(PIT, &pit_config);
-	PIT_SetTimerPeriod(PIT, kPIT_Chnl_0, USEC_TO_COUNT(1000, 21000000));
+	// Sample rate, filter and full scales (+-8 g, +-1000 deg/s):
+	MPU6050_write_reg(MPU_SMPLRT_DIV, MPU_SMPLRT_DIV_VAL);
+	MPU6050_write_reg(MPU_CONFIG, MPU_DLPF_CFG);
+	MPU6050_write_reg(MPU_GYRO_CONFIG, MPU_GYRO_FS_1000DPS);
+	MPU6050_write_reg(MPU_ACCEL_CONFIG, MPU_ACCEL_FS_8G);
+
+	// Stored biases and mounting rotation, read while the bus is still
+	// free of interrupt driven transfers:
+	imu_calib_load();
+	gyro_temp_load();
+	crash_init();
+
+	// Every sample goes into the FIFO, drained from the INT pin interrupt:
+	MPU6050_write_reg(MPU_FIFO_EN, MPU_FIFO_EN_VAL);
+	MPU6050_fifo_reset();
+
+	// INT pin pulsed once per sample, so every sample gives an edge:
+	MPU6050_write_reg(MPU_INT_PIN_CFG, MPU_INT_PULSE_RD_CLR);
+	MPU6050_write_reg(MPU_INT_ENABLE, MPU_INT_DATA_RDY);
+
+	I2C_MasterTransferCreateHandle(MODULE_I2C, &g_i2c_handle, MPU6050_xfer_callback, NULL);
+	// Same priority as the INT pin, so a transfer is never started from one
+	// while the other is running:
+	NVIC_enable_interrupt_and_priotity(MPU_I2C_IRQ, MPU_INT_PRIORITY);
+
+	CLOCK_EnableClock(MPU_INT_CLOCK);
+	PORT_SetPinMux(MPU_INT_PORT, MPU_INT_PIN, kPORT_MuxAsGpio);
+	GPIO_PinInit(MPU_INT_GPIO, MPU_INT_PIN, &int_config);
+	PORT_SetPinInterruptConfig(MPU_INT_PORT, MPU_INT_PIN, kPORT_InterruptRisingEdge);
+	GPIO_callback_init(MPU_INT_GPIO_NAME, MPU6050_int_callback);
+	NVIC_enable_interrupt_and_priotity(MPU_INT_IRQ, MPU_INT_PRIORITY);
+
+	// Cycle counter, used to time the I2C transfers:
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
 
-	// PIT interrupt config:
-	PIT_EnableInterrupts(PIT, kPIT_Chnl_0, kPIT_TimerInterruptEnable);
-	PIT_callback_init(kPIT_Chnl_0, update_counter);
-	NVIC_enable_interrupt_and_priotity(PIT_CH0_IRQ, PRIORITY_1);
+/*
+ * @brief: Runs the samples acquired in the background through the attitude
+ *         filter. Never touches the I2C bus, so it can be called from the
+ *         main loop at any rate that keeps the ring buffer from filling
+ *         up (MPU_RING_SIZE samples).
+ *
+ * @retval: Number of samples processed.
+ */
+uint32_t MPU6050_update(void)
+{
+	MPU6050_sample_t sample;
+	uint32_t processed = 0;
 
-	PIT_StartTimer(PIT, kPIT_Chnl_0);
+	while (MPU6050_get_sample(&sample))
+	{
+		MPU6050_process_sample(&sample);
+		processed++;
+	}
+
+	return processed;
 }
 
 /*
- * @brief: Reads the accelerometer raw values
+ * @brief: Takes the oldest sample from the ring buffer filled by the
+ *         interrupt driven acquisition.
+ *
+ * @param: sample Where the sample is copied.
+ *
+ * @retval: true if a sample was available.
  */
-Acc_t MPU6050_read_acc(void)
+bool MPU6050_get_sample(MPU6050_sample_t * sample)
 {
-	i2c_master_transfer_t masterXfer;
-	uint8_t master_rxBuff[6] = {0};
-	Acc_t values;
-	uint32_t deviceAddress = 0x3BU;
+	return spsc_ring_pop(&g_ring, sample);
+}
 
-	masterXfer.slaveAddress   = MPU_ADDRESS;
-	masterXfer.direction      = kI2C_Read;
-	masterXfer.subaddress     = deviceAddress;
-	masterXfer.subaddressSize = 1;
-	masterXfer.data           = master_rxBuff;
-	masterXfer.dataSize       = 6;
-	masterXfer.flags          = kI2C_TransferDefaultFlag;
+/*
+ * @brief: Keeps the interrupt driven acquisition off the I2C bus, waiting
+ *         for a transfer in progress to finish, so that other devices on
+ *         the bus (RTC module EEPROM) can be used with blocking transfers.
+ */
+void MPU6050_suspend(void)
+{
+	g_suspended = true;
 
-	I2C_MasterTransferBlocking(I2C0, &masterXfer);
+	while (MPU_XFER_IDLE != g_xfer_state)
+	{
+	}
+}
 
-	values.AcX = (master_rxBuff[0] << 8) | (master_rxBuff[1]);
-	values.AcY = (master_rxBuff[2] << 8) | (master_rxBuff[3]);
-	values.AcZ = (master_rxBuff[4] << 8) | (master_rxBuff[5]);
+/*
+ * @brief: Gives the I2C bus back to the interrupt driven acquisition, and
+ *         reads the FIFO if a data-ready interrupt came while suspended.
+ */
+void MPU6050_resume(void)
+{
+	uint32_t primask = __get_PRIMASK();
 
-	return values;
+	NVIC_disable_interrupts;
+	g_suspended = false;
+	if (g_xfer_pending)
+	{
+		g_xfer_pending = false;
+		MPU6050_xfer_start(MPU_XFER_COUNT);
+	}
+	__set_PRIMASK(primask);
 }
 
 /*
- * @brief: Reads the gyroscope raw values
+ * @brief: Sets a function to be called from interrupt context each time
+ *         new samples are pushed into the ring buffer.
+ *
+ * @param: handler Function that will serve the role of a callback.
  */
-Gyro_t MPU6050_read_gyro(void)
+void MPU6050_callback_init(void (*handler)(void))
+{
+	g_data_callback = handler;
+}
+
+/*
+ * @brief: Decodes FIFO or burst bytes into samples, MPU_SAMPLE_BYTES per
+ *         sample. Trailing bytes of an incomplete frame are ignored.
+ *
+ * @param: data    Bytes read from the sensor.
+ * @param: length  Number of bytes.
+ * @param: samples Array where decoded samples are written.
+ * @param: max     Size of the samples array.
+ *
+ * @retval: Number of samples decoded.
+ */
+uint32_t MPU6050_parse_frames(const uint8_t * data, uint32_t length,
+		MPU6050_sample_t * samples, uint32_t max)
+{
+	const uint8_t * frame = data;
+	uint32_t count = length / MPU_SAMPLE_BYTES;
+	uint32_t i = 0;
+
+	if (count > max)
+	{
+		count = max;
+	}
+
+	// Big-endian values, in register order: accel, temperature, gyro.
+	for (i = 0; i < count; i++)
+	{
+		samples[i].acc.AcX  = (int16_t)((frame[0]  << 8) | frame[1]);
+		samples[i].acc.AcY  = (int16_t)((frame[2]  << 8) | frame[3]);
+		samples[i].acc.AcZ  = (int16_t)((frame[4]  << 8) | frame[5]);
+		samples[i].temp     = (int16_t)((frame[6]  << 8) | frame[7]);
+		samples[i].gyro.GyX = (int16_t)((frame[8]  << 8) | frame[9]);
+		samples[i].gyro.GyY = (int16_t)((frame[10] << 8) | frame[11]);
+		samples[i].gyro.GyZ = (int16_t)((frame[12] << 8) | frame[13]);
+		samples[i].timestamp = 0;
+		frame += MPU_SAMPLE_BYTES;
+	}
+
+	return count;
+}
+
+/*
+ * @brief: Returns the FIFO sample and overflow counters.
+ */
+MPU6050_fifo_stats_t MPU6050_get_fifo_stats(void)
+{
+	return g_fifo_stats;
+}
+
+/*
+ * @brief: Duration of the last FIFO burst read, from the start of the
+ *         non-blocking transfer to its completion, divided by the frames in
+ *         it: the I2C cost of a sample, in core clock cycles (DWT cycle
+ *         counter).
+ */
+uint32_t MPU6050_get_xfer_cycles(void)
+{
+	return g_xfer_cycles;
+}
+
+/*
+ * @brief: Gets the road grade in degrees, as computed from the samples
+ *         processed by MPU6050_update(). Zero on level ground once
+ *         calibrated, and not affected by braking or accelerating.
+ */
+float MPU6050_get_angle(void)
+{
+	return g_angle;
+}
+
+#if MPU6050_MATH_BENCHMARK
+/*
+ * @brief: Measures with the DWT cycle counter one call of arctan() and
+ *         raiz() against their fast_math replacements.
+ */
+MPU6050_bench_t MPU6050_math_benchmark(void)
+{
+	MPU6050_bench_t result = {0};
+	volatile float input = 0.75f;
+	volatile float output = 0.0f;
+	uint32_t start = 0;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	start = DWT->CYCCNT;
+	output = arctan(input);
+	result.arctan_cycles = DWT->CYCCNT - start;
+
+	start = DWT->CYCCNT;
+	output = fast_math_atan2(input, 1.0f);
+	result.atan2_cycles = DWT->CYCCNT - start;
+
+	start = DWT->CYCCNT;
+	output = raiz(input);
+	result.raiz_cycles = DWT->CYCCNT - start;
+
+	start = DWT->CYCCNT;
+	output = fast_math_sqrt(input);
+	result.sqrt_cycles = DWT->CYCCNT - start;
+
+	(void)output;
+
+	return result;
+}
+#endif
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: Attitude filter step for a single sample.
+ */
+static void MPU6050_process_sample(const MPU6050_sample_t * sample)
+{
+	float Acc[3] = {0};
+	float Gyr[3] = {0};
+	float bias[3] = {0};
+	float gravity[3] = {0};
+	float accel = 0.0f;
+	float temp = 0.0f;
+	// Event logs keep millisecond timestamps:
+	uint32_t timestamp = (uint32_t)(sample->timestamp / 1000U);
+
+	Acc[0] = sample->acc.AcX / Acc_R;
+	Acc[1] = sample->acc.AcY / Acc_R;
+	Acc[2] = sample->acc.AcZ / Acc_R;
+
+	Gyr[0] = (sample->gyro.GyX / Gyr_R) * DEG_2_RAD;
+	Gyr[1] = (sample->gyro.GyY / Gyr_R) * DEG_2_RAD;
+	Gyr[2] = (sample->gyro.GyZ / Gyr_R) * DEG_2_RAD;
+
+	// Raw values, before the calibration being measured is applied:
+	imu_calib_add_sample(Acc, Gyr);
+	temp = gyro_temp_celsius(sample->temp);
+	gyro_temp_add_sample(temp, Gyr);
+
+	// Gyro bias at the die temperature, or the calibration one if the
+	// table has not learned this temperature yet:
+	if (!gyro_temp_get_bias(temp, bias))
+	{
+		imu_calib_get_gyro_bias(bias);
+	}
+	Gyr[0] -= bias[0];
+	Gyr[1] -= bias[1];
+	Gyr[2] -= bias[2];
+
+	// Accelerometer bias and mounting rotation, into the bicycle frame:
+	imu_calib_apply(Acc, Gyr);
+
+	// Road vibration, before anything else touches the samples:
+	roughness_add_sample(Acc[2]);
+
+	// Frame sway from pedaling, roll about the forward axis:
+	imu_cadence_add_sample(Gyr[1]);
+
+	// Crash recorder, with the attitude of the previous sample:
+	attitude_get_gravity(gravity);
+	crash_add_sample(timestamp, Acc, Gyr, gravity);
+
+	// Longitudinal acceleration without gravity, for the skid detection
+	// and the fused speed:
+	accel = (Acc[1] - gravity[1]) * SKID_GRAVITY;
+	skid_add_sample(timestamp, accel, MPU_SAMPLE_PERIOD);
+	speed_fusion_predict(accel, MPU_SAMPLE_PERIOD);
+
+	// Only gravity must be left for the attitude filter:
+	grade_compensate(Acc);
+
+	if (!attitude_ready() || imu_calib_changed())
+	{
+		attitude_reset(Acc);
+	}
+
+	// Every sample goes through the FIFO, so they are exactly one sample
+	// period apart:
+	attitude_update(Gyr, Acc, MPU_SAMPLE_PERIOD);
+	grade_update();
+
+	g_angle = grade_get_degrees();
+}
+
+/*
+ * @brief: Writes a single sensor register.
+ */
+static void MPU6050_write_reg(uint8_t reg, uint8_t value)
 {
 	i2c_master_transfer_t masterXfer;
-	uint8_t master_rxBuff[6] = {0};
-	Gyro_t values;
-	uint32_t deviceAddress = 0x43U;
 
 	masterXfer.slaveAddress   = MPU_ADDRESS;
-	masterXfer.direction      = kI2C_Read;
-	masterXfer.subaddress     = deviceAddress;
+	masterXfer.direction      = kI2C_Write;
+	masterXfer.subaddress     = reg;
 	masterXfer.subaddressSize = 1;
-	masterXfer.data           = master_rxBuff;
-	masterXfer.dataSize       = 6;
+	masterXfer.data           = &value;
+	masterXfer.dataSize       = 1;
 	masterXfer.flags          = kI2C_TransferDefaultFlag;
 
 	I2C_MasterTransferBlocking(I2C0, &masterXfer);
+}
 
-	values.GyX = (master_rxBuff[0] << 8) | (master_rxBuff[1]);
-	values.GyY = (master_rxBuff[2] << 8) | (master_rxBuff[3]);
-	values.GyZ = (master_rxBuff[4] << 8) | (master_rxBuff[5]);
-
-	return values;
+/*
+ * @brief: Empties the FIFO and keeps it enabled.
+ */
+static void MPU6050_fifo_reset(void)
+{
+	MPU6050_write_reg(MPU_USER_CTRL, MPU_USER_FIFO_EN | MPU_USER_FIFO_RESET);
 }
 
 /*
- * @brief: Gets the degrees of inclination of the sensor
- *         on the Y-axis.
+ * @brief: INT pin callback, one call per sample. Every MPU_DRDY_DECIMATION
+ *         samples, starts reading the FIFO unless a read is already going
+ *         on or the bus is lent to another device.
  */
-float MPU6050_get_angle(void)
+static void MPU6050_int_callback(uint32_t flags)
 {
-	float Acc_tot = 0.0f;
-	float Acc[3] = {0};
-	float Gyr[3] = {0};
-	float dt = 0.0f;
+	if (!(flags & (1U << MPU_INT_PIN)))
+	{
+		return;
+	}
 
-	Acc_t aceleracion = {0};
-	Gyro_t giroscopio = {0};
+	g_drdy_count++;
+	if (g_drdy_count < MPU_DRDY_DECIMATION)
+	{
+		return;
+	}
+	g_drdy_count = 0;
 
-	//Get values from the module:
-	aceleracion = MPU6050_read_acc();
-	giroscopio  = MPU6050_read_gyro();
+	if (g_suspended)
+	{
+		g_xfer_pending = true;
+	}
+	else if (MPU_XFER_IDLE == g_xfer_state)
+	{
+		MPU6050_xfer_start(MPU_XFER_COUNT);
+	}
+}
 
-	Acc[0] = (aceleracion.AcX + 350) / Acc_R;
-	Acc[1] = (aceleracion.AcY + 350) / Acc_R;
-	Acc[2] = (aceleracion.AcZ + 1350) / Acc_R;
+/*
+ * @brief: Starts the non-blocking transfer of the given step of a FIFO
+ *         read: byte count, a burst of frames, or a FIFO reset.
+ */
+static void MPU6050_xfer_start(MPU6050_xfer_state_t state)
+{
+	g_xfer.slaveAddress   = MPU_ADDRESS;
+	g_xfer.subaddressSize = 1;
+	g_xfer.data           = g_xfer_buff;
+	g_xfer.flags          = kI2C_TransferDefaultFlag;
 
-	Acc_tot = arctan((Acc[1]) / (raiz(pot(Acc[0], 2) + pot(Acc[2], 2))));
-	Acc_tot *= RAD_2_DEG;
+	switch (state)
+	{
+		case MPU_XFER_COUNT:
+			g_xfer.direction  = kI2C_Read;
+			g_xfer.subaddress = MPU_FIFO_COUNT_H;
+			g_xfer.dataSize   = 2;
+			break;
+		case MPU_XFER_FRAMES:
+			g_xfer.direction  = kI2C_Read;
+			g_xfer.subaddress = MPU_FIFO_R_W;
+			g_xfer.dataSize   = ((g_frames_left > MPU_FIFO_BURST) ?
+					MPU_FIFO_BURST : g_frames_left) * MPU_SAMPLE_BYTES;
+			break;
+		case MPU_XFER_RESET:
+			g_xfer.direction  = kI2C_Write;
+			g_xfer.subaddress = MPU_USER_CTRL;
+			g_xfer.data       = &g_reset_cmd;
+			g_xfer.dataSize   = 1;
+			break;
+		default:
+			g_xfer_state = MPU_XFER_IDLE;
+			return;
+	}
 
-	Gyr[0] = (giroscopio.GyX) / Gyr_R;
+	g_xfer_state = state;
+	g_xfer_start = DWT->CYCCNT;
+	if (kStatus_Success != I2C_MasterTransferNonBlocking(MODULE_I2C, &g_i2c_handle, &g_xfer))
+	{
+		// Bus busy, the next data-ready interrupt tries again:
+		g_fifo_stats.bus_errors++;
+		g_xfer_state = MPU_XFER_IDLE;
+	}
+}
 
-	dt = (g_actual_time - g_prior_time) / MILLIS_TO_SEC;
-	g_prior_time = g_actual_time;
+/*
+ * @brief: I2C transfer completion callback. Moves the FIFO read to its
+ *         next step and pushes the decoded samples into the ring buffer.
+ */
+static void MPU6050_xfer_callback(I2C_Type * base, i2c_master_handle_t * handle,
+		status_t status, void * userData)
+{
+	MPU6050_sample_t samples[MPU_FIFO_BURST];
+	uint32_t count = 0;
+	uint32_t parsed = 0;
+	uint32_t i = 0;
 
-	g_angle = HPF * (Acc_tot + Gyr[0] * dt) + (LPF * Acc_tot);
+	(void)base;
+	(void)handle;
+	(void)userData;
 
-	return g_angle;
+	if (kStatus_Success != status)
+	{
+		g_fifo_stats.bus_errors++;
+		g_xfer_state = MPU_XFER_IDLE;
+		return;
+	}
+
+	switch (g_xfer_state)
+	{
+		case MPU_XFER_COUNT:
+			count = ((uint32_t)g_xfer_buff[0] << 8) | g_xfer_buff[1];
+			if (count >= MPU_FIFO_SIZE)
+			{
+				// Frames are no longer aligned after an overflow:
+				g_fifo_stats.overflows++;
+				MPU6050_xfer_start(MPU_XFER_RESET);
+			}
+			else if (count >= MPU_SAMPLE_BYTES)
+			{
+				// Only whole frames, a partial one is read next time. The
+				// last one counted was sampled just now:
+				g_frames_left = count / MPU_SAMPLE_BYTES;
+				g_count_time  = timebase_us();
+				MPU6050_xfer_start(MPU_XFER_FRAMES);
+			}
+			else
+			{
+				g_xfer_state = MPU_XFER_IDLE;
+			}
+			break;
+		case MPU_XFER_FRAMES:
+			parsed = MPU6050_parse_frames(g_xfer_buff, g_xfer.dataSize, samples, MPU_FIFO_BURST);
+			if (parsed)
+			{
+				g_xfer_cycles = (DWT->CYCCNT - g_xfer_start) / parsed;
+			}
+			g_frames_left -= parsed;
+			for (i = 0; i < parsed; i++)
+			{
+				// Counted back from the last frame counted, whatever the
+				// burst, so later bursts don't take their transfer time:
+				samples[i].timestamp = g_count_time - ((uint64_t)(g_frames_left + parsed - 1U - i) *
+						MPU_SAMPLE_US);
+				MPU6050_ring_push(&samples[i]);
+			}
+			g_fifo_stats.samples += parsed;
+			if (parsed && g_data_callback)
+			{
+				g_data_callback();
+			}
+
+			if (g_frames_left && !g_suspended)
+			{
+				MPU6050_xfer_start(MPU_XFER_FRAMES);
+			}
+			else
+			{
+				g_xfer_state = MPU_XFER_IDLE;
+			}
+			break;
+		default:
+			g_xfer_state = MPU_XFER_IDLE;
+			break;
+	}
 }
 
+/*
+ * @brief: Adds a sample to the ring buffer. When full, the new sample is
+ *         dropped so the consumer never sees a half written slot.
+ */
+static void MPU6050_ring_push(const MPU6050_sample_t * sample)
+{
+	if (!spsc_ring_push(&g_ring, sample))
+	{
+		g_fifo_stats.dropped++;
+	}
+}
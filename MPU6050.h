@@ -17,6 +17,20 @@
 #include "fsl_pit.h"
 #include "NVIC.h"
 #include "PIT.h"
+#include "fsl_gpio.h"
+#include "fast_math.h"
+#include "attitude.h"
+#include "imu_calib.h"
+#include "gyro_temp.h"
+#include "grade.h"
+#include "roughness.h"
+#include "imu_cadence.h"
+#include "crash.h"
+#include "skid.h"
+#include "speed_fusion.h"
+#include "timebase.h"
+#include "spsc_ring.h"
+#include "gpio.h"
 
 /*
  * ******************************************************************
@@ -25,6 +39,61 @@
  */
 
 #define MPU_ADDRESS           0x68
+#define MPU_I2C_BAUDRATE      400000U
+
+// Registers:
+#define MPU_SMPLRT_DIV        0x19U
+#define MPU_CONFIG            0x1AU
+#define MPU_GYRO_CONFIG       0x1BU
+#define MPU_ACCEL_CONFIG      0x1CU
+#define MPU_FIFO_EN           0x23U
+#define MPU_INT_PIN_CFG       0x37U
+#define MPU_INT_ENABLE        0x38U
+#define MPU_INT_STATUS        0x3AU
+#define MPU_ACCEL_XOUT_H      0x3BU
+#define MPU_USER_CTRL         0x6AU
+#define MPU_PWR_MGMT_1        0x6BU
+#define MPU_FIFO_COUNT_H      0x72U
+#define MPU_FIFO_R_W          0x74U
+
+// Accel, temperature and gyro block size, same layout in the FIFO:
+#define MPU_SAMPLE_BYTES      14U
+
+// 1 kHz gyro rate with the DLPF on, divided by (1 + 4): 200 Hz samples.
+#define MPU_SMPLRT_DIV_VAL    4U
+#define MPU_SAMPLE_RATE_HZ    200U
+#define MPU_SAMPLE_RATE       ((float)MPU_SAMPLE_RATE_HZ)
+#define MPU_SAMPLE_PERIOD     (1.0f / MPU_SAMPLE_RATE)
+#define MPU_SAMPLE_US         (1000000U / MPU_SAMPLE_RATE_HZ)
+// DLPF at 44 Hz accel / 42 Hz gyro, below half the sample rate:
+#define MPU_DLPF_CFG          3U
+// Accel, temperature and all gyro axes into the FIFO:
+#define MPU_FIFO_EN_VAL       0xF8U
+#define MPU_USER_FIFO_EN      0x40U
+#define MPU_USER_FIFO_RESET   0x04U
+#define MPU_INT_FIFO_OFLOW    0x10U
+#define MPU_INT_DATA_RDY      0x01U
+// INT pin active high, push-pull, 50 us pulse per sample and status
+// cleared by any read. Latched, the pin would stay high between the
+// decimated FIFO reads and give a single rising edge:
+#define MPU_INT_PULSE_RD_CLR  0x10U
+#define MPU_FIFO_SIZE         1024U
+// Frames read per I2C burst when draining the FIFO:
+#define MPU_FIFO_BURST        8U
+// Data-ready interrupts per FIFO read, 20 ms at 200 Hz:
+#define MPU_DRDY_DECIMATION   4U
+// Samples kept for the fusion code, a power of 2:
+#define MPU_RING_SIZE         64U
+
+// Sensor INT pin:
+#define MPU_INT_CLOCK         kCLOCK_PortA
+#define MPU_INT_PORT          PORTA
+#define MPU_INT_GPIO          GPIOA
+#define MPU_INT_GPIO_NAME     GPIO_A
+#define MPU_INT_PIN           1U
+#define MPU_INT_IRQ           PORTA_IRQ
+#define MPU_I2C_IRQ           I2C0_IRQ
+#define MPU_INT_PRIORITY      PRIORITY_3
 
 #define I2C_CLK_GATING        kCLOCK_PortE
 #define I2C_PORT              PORTE
@@ -35,14 +104,20 @@
 #define SCL_PIN               24U
 #define SDA_PIN               25U
 
-#define MILLIS_TO_SEC         1000.0
-#define Acc_R                 16384.0f
-#define Gyr_R                 131.0f
+// Full scales of +-8 g and +-1000 deg/s, so impacts and tumbles are not
+// clipped for the crash recorder:
+#define MPU_ACCEL_FS_8G       0x10U
+#define MPU_GYRO_FS_1000DPS   0x10U
+#define Acc_R                 4096.0f
+#define Gyr_R                 32.8f
 #define RAD_2_DEG             57.295779f
+#define DEG_2_RAD             0.017453293f
 #define PI2_ADJUST_VAL        3.14159265f / 2
-#define HPF                   0.98
-#define LPF                   0.02
 
+// Builds the DWT cycle benchmark of the math functions when set to 1:
+#ifndef MPU6050_MATH_BENCHMARK
+#define MPU6050_MATH_BENCHMARK 0
+#endif
 
 
 typedef struct{
@@ -57,6 +132,38 @@ typedef struct{
 	int16_t GyZ;
 }Gyro_t;
 
+/* Accel, temperature and gyro values read in a single burst: */
+typedef struct{
+	Acc_t acc;
+	int16_t temp;
+	Gyro_t gyro;
+	uint64_t timestamp;       // Time base (us) the frame was sampled at.
+}MPU6050_sample_t;
+
+/* FIFO statistics: */
+typedef struct{
+	uint32_t samples;         // Frames read from the FIFO.
+	uint32_t overflows;       // Times the FIFO overflowed and was reset.
+	uint32_t dropped;         // Samples lost because the ring buffer was full.
+	uint32_t bus_errors;      // Failed non-blocking I2C transfers.
+}MPU6050_fifo_stats_t;
+
+/* Step of the non-blocking FIFO read: */
+typedef enum{
+	MPU_XFER_IDLE,
+	MPU_XFER_COUNT,
+	MPU_XFER_FRAMES,
+	MPU_XFER_RESET
+}MPU6050_xfer_state_t;
+
+/* Cycles taken by one call of each math function: */
+typedef struct{
+	uint32_t arctan_cycles;
+	uint32_t raiz_cycles;
+	uint32_t atan2_cycles;
+	uint32_t sqrt_cycles;
+}MPU6050_bench_t;
+
 /*
  * ******************************************************************
  * Function prototypes:
@@ -66,32 +173,90 @@ typedef struct{
 
 /*
  * @brief: Initialization function for waking up MPU6050 module, as well
- *         as the configuration for I2C communication and a PIT channel
+ *         as the configuration for I2C communication, a PIT channel and
+ *         the data-ready interrupt on the sensor INT pin.
  */
 void MPU6050_init(void);
 
 /*
- * @brief: Reads the accelerometer raw values
+ * @brief: Runs the samples acquired in the background through the attitude
+ *         filter. Never touches the I2C bus, so it can be called from the
+ *         main loop at any rate that keeps the ring buffer from filling
+ *         up (MPU_RING_SIZE samples).
+ *
+ * @retval: Number of samples processed.
  */
-Acc_t MPU6050_read_acc(void);
+uint32_t MPU6050_update(void);
 
 /*
- * @brief: Reads the gyroscope raw values
+ * @brief: Takes the oldest sample from the ring buffer filled by the
+ *         interrupt driven acquisition.
+ *
+ * @param: sample Where the sample is copied.
+ *
+ * @retval: true if a sample was available.
  */
-Gyro_t MPU6050_read_gyro(void);
+bool MPU6050_get_sample(MPU6050_sample_t * sample);
 
 /*
- * @brief: Gets the degrees of inclination of the sensor
- *         on the Y-axis.
+ * @brief: Keeps the interrupt driven acquisition off the I2C bus, waiting
+ *         for a transfer in progress to finish, so that other devices on
+ *         the bus (RTC module EEPROM) can be used with blocking transfers.
  */
-float MPU6050_get_angle(void);
+void MPU6050_suspend(void);
 
 /*
- * @brief: Callback function for the PIT to increase a timer
+ * @brief: Gives the I2C bus back to the interrupt driven acquisition, and
+ *         reads the FIFO if a data-ready interrupt came while suspended.
  */
-void update_counter(void);
+void MPU6050_resume(void);
 
-/*Math functions*/
+/*
+ * @brief: Sets a function to be called from interrupt context each time
+ *         new samples are pushed into the ring buffer.
+ *
+ * @param: handler Function that will serve the role of a callback.
+ */
+void MPU6050_callback_init(void (*handler)(void));
+
+/*
+ * @brief: Decodes FIFO or burst bytes into samples, MPU_SAMPLE_BYTES per
+ *         sample. Trailing bytes of an incomplete frame are ignored.
+ *
+ * @param: data    Bytes read from the sensor.
+ * @param: length  Number of bytes.
+ * @param: samples Array where decoded samples are written.
+ * @param: max     Size of the samples array.
+ *
+ * @retval: Number of samples decoded.
+ */
+uint32_t MPU6050_parse_frames(const uint8_t * data, uint32_t length,
+		MPU6050_sample_t * samples, uint32_t max);
+
+/*
+ * @brief: Returns the FIFO sample and overflow counters.
+ */
+MPU6050_fifo_stats_t MPU6050_get_fifo_stats(void);
+
+/*
+ * @brief: Duration of the last FIFO burst read, from the start of the
+ *         non-blocking transfer to its completion, divided by the frames in
+ *         it: the I2C cost of a sample, in core clock cycles (DWT cycle
+ *         counter).
+ */
+uint32_t MPU6050_get_xfer_cycles(void);
+
+/*
+ * @brief: Gets the road grade in degrees, as computed from the samples
+ *         processed by MPU6050_update(). Zero on level ground once
+ *         calibrated, and not affected by braking or accelerating.
+ */
+float MPU6050_get_angle(void);
+
+/*
+ * Reference math functions, replaced by fast_math in the angle calculation
+ * and kept for MPU6050_math_benchmark():
+ */
 
 /*
  * @brief: Gets the square root of the number
@@ -108,5 +273,13 @@ float arctan(float x);
  */
 float pot(float x,uint32_t expo);
 
+#if MPU6050_MATH_BENCHMARK
+/*
+ * @brief: Measures with the DWT cycle counter one call of arctan() and
+ *         raiz() against their fast_math replacements.
+ */
+MPU6050_bench_t MPU6050_math_benchmark(void);
+#endif
+
 
 #endif /* MPU6050_H_ */
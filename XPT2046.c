@@ -18,7 +18,7 @@
  */
 
 static void Touch_gpio_irq(uint32_t port_flags);
-static void Touch_debounce(void);
+static void Touch_debounce(void * context);
 static uint16_t send_halfduplex_command(uint8_t command);
 
 /*
@@ -27,7 +27,11 @@ static uint16_t send_halfduplex_command(uint8_t command);
  * ******************************************************************
  */
 
-bool g_touch_irq = false;
+// Touch times (ms), from the IRQ to the main loop:
+SPSC_RING_DEFINE(g_touch_events, uint32_t, TOUCH_EVENTS);
+
+static soft_timer_t g_debounce_timer;
+static void (*g_touch_callback)(void) = 0;
 
 /*
  * ******************************************************************
@@ -36,7 +40,8 @@ bool g_touch_irq = false;
  */
 
 /*
- * @brief: Configures and initializes the peripherals used (SPI, PIT, GPIO)
+ * @brief: Configures and initializes the peripherals used (SPI, GPIO) and
+ *         the debounce timer
  */
 void Touch_config_peripherals(void)
 {
@@ -45,7 +50,6 @@ void Touch_config_peripherals(void)
 			kGPIO_DigitalInput,
 			0
 	};
-	pit_config_t pit_config;
 	uint32_t srcClock_Hz;
 
 	CLOCK_SetSimSafeDivs();
@@ -54,13 +58,8 @@ void Touch_config_peripherals(void)
 	CLOCK_EnableClock(TOUCH_CE_CLOCK);
 	CLOCK_EnableClock(kCLOCK_PortB);
 
-	// PIT config:
-	PIT_GetDefaultConfig(&pit_config);
-	PIT_Init(PIT, &pit_config);
-	PIT_SetTimerPeriod(PIT, TOUCH_PIT_CHNL, TOUCH_DELAY);
-	PIT_EnableInterrupts(PIT, TOUCH_PIT_CHNL, kPIT_TimerInterruptEnable);
-	PIT_callback_init(TOUCH_PIT_CHNL, Touch_debounce);
-	NVIC_enable_interrupt_and_priotity(TOUCH_PIT_IRQ, TOUCH_PIT_PRIO);
+	// Debounce timer:
+	soft_timer_setup(&g_debounce_timer, Touch_debounce, NULL);
 
 	// SPI pins:
 	PORT_SetPinMux(TOUCH_CE_PORT,  TOUCH_CE_PIN, SPI_MUX_ALT);
@@ -106,18 +105,29 @@ void Touch_config_peripherals(void)
  */
 bool Touch_pressed(void)
 {
-	return g_touch_irq;
+	return !spsc_ring_is_empty(&g_touch_events);
 }
 
 
 /*
- * @brief: Sets the value of the flag that indicates whether the screen has
- *         been touched to false, avoiding multiple responses to the same
- *         touch. Should be used after Touch_pressed().
+ * @brief: Drops the touches waiting to be handled, avoiding multiple
+ *         responses to the same touch. Should be used after Touch_pressed().
  */
 void Touch_clear_irq_flag(void)
 {
-	g_touch_irq = false;
+	spsc_ring_flush(&g_touch_events);
+}
+
+
+/*
+ * @brief: Sets a function to be called from interrupt context each time
+ *         the screen is touched, after the IRQ flag is set.
+ *
+ * @param: handler Function that will serve the role of a callback.
+ */
+void Touch_callback_init(void (*handler)(void))
+{
+	g_touch_callback = handler;
 }
 
 
@@ -174,25 +184,32 @@ Coordinate_t Touch_get_coordinates(void)
  */
 static void Touch_gpio_irq(uint32_t port_flags)
 {
+	uint32_t touched = 0;
+
 	// Only acts if the touch IRQ pin triggered the interrupt:
 	if (port_flags & (1 << TOUCH_IRQ_PIN))
 	{
-		// Set the global IRQ flag:
-		g_touch_irq = true;
-		// Disabled the port's interrupt for 5 ms as debouncing.
+		// Queue the touch, a full queue already has one to handle:
+		touched = timebase_ms();
+		(void)spsc_ring_push(&g_touch_events, &touched);
+		// Disabled the port's interrupt for TOUCH_DEBOUNCE_MS as debouncing.
 		PORT_SetPinInterruptConfig(PORTB, TOUCH_IRQ_PIN, kPORT_InterruptOrDMADisabled);
-		PIT_StartTimer(PIT, TOUCH_PIT_CHNL);
+		soft_timer_start(&g_debounce_timer, TOUCH_DEBOUNCE_MS, 0);
+		if (g_touch_callback)
+		{
+			g_touch_callback();
+		}
 	}
 }
 
 
 /*
- * @brief: Function used as a PIT callback function. Enables the touch IRQ
- *         port's interrupt again.
+ * @brief: Function used as a software timer callback. Enables the touch
+ *         IRQ port's interrupt again.
  */
-static void Touch_debounce(void)
+static void Touch_debounce(void * context)
 {
-	PIT_StopTimer(PIT, TOUCH_PIT_CHNL);
+	(void)context;
 	PORT_SetPinInterruptConfig(PORTB, TOUCH_IRQ_PIN, kPORT_InterruptFallingEdge);
 }
 
@@ -20,7 +20,8 @@
 #include "fsl_pit.h"
 #include "NVIC.h"
 #include "gpio.h"
-#include "PIT.h"
+#include "soft_timer.h"
+#include "spsc_ring.h"
 #include <stdbool.h>
 
 /*
@@ -51,10 +52,10 @@
 #define TOUCH_CPOL  kDSPI_ClockPolarityActiveHigh
 #define TOUCH_CPHA  kDSPI_ClockPhaseFirstEdge
 
-#define TOUCH_PIT_CHNL kPIT_Chnl_1
-#define TOUCH_DELAY    USEC_TO_COUNT(10000U, 21000000U)
-#define TOUCH_PIT_IRQ  PIT_CH1_IRQ
-#define TOUCH_PIT_PRIO PRIORITY_4
+// The touch IRQ is ignored this long after each edge, in ms:
+#define TOUCH_DEBOUNCE_MS 10U
+// Touches kept until the main loop handles them (power of 2):
+#define TOUCH_EVENTS      4U
 
 /*
  * ******************************************************************
@@ -75,7 +76,8 @@ typedef struct {
  */
 
 /*
- * @brief: Configures and initializes the peripherals used (SPI, PIT, GPIO)
+ * @brief: Configures and initializes the peripherals used (SPI, GPIO) and
+ *         the debounce timer
  */
 void Touch_config_peripherals(void);
 
@@ -89,13 +91,21 @@ bool Touch_pressed(void);
 
 
 /*
- * @brief: Sets the value of the flag that indicates whether the screen has
- *         been touched to false, avoiding multiple responses to the same
- *         touch. Should be used after Touch_pressed().
+ * @brief: Drops the touches waiting to be handled, avoiding multiple
+ *         responses to the same touch. Should be used after Touch_pressed().
  */
 void Touch_clear_irq_flag(void);
 
 
+/*
+ * @brief: Sets a function to be called from interrupt context each time
+ *         the screen is touched, after the IRQ flag is set.
+ *
+ * @param: handler Function that will serve the role of a callback.
+ */
+void Touch_callback_init(void (*handler)(void));
+
+
 /*
  * @brief: When the screen has been touched, returns the screen coordinates
  *         where it was touched.
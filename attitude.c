@@ -0,0 +1,186 @@
+/*
+ * @file     attitude.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the attitude estimator: a Mahony filter that
+ *           integrates gyroscope rates into a quaternion at the IMU
+ *           sample rate and corrects its drift with the gravity vector
+ *           measured by the accelerometer.
+ */
+
+#include "attitude.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Sensor-to-earth rotation quaternion (w, x, y, z):
+static float g_q[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+// Integral term of the gravity correction, in rad/s:
+static float g_integral[3] = {0.0f, 0.0f, 0.0f};
+static bool g_ready = false;
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Starts the estimator from the attitude given by a gravity
+ *         reading, with zero yaw and no learned gyro bias.
+ *
+ * @param: acc Accelerometer reading (any unit, it is normalized).
+ */
+void attitude_reset(const float acc[3])
+{
+	float norm = fast_math_sqrt(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]);
+	float ax = 0.0f;
+	float ay = 0.0f;
+	float az = 1.0f;
+	float s = 0.0f;
+
+	if (norm > 0.0f)
+	{
+		ax = acc[0] / norm;
+		ay = acc[1] / norm;
+		az = acc[2] / norm;
+	}
+
+	// Shortest rotation between the earth Z-axis and the measured gravity.
+	// Two forms, so the division is never by less than sqrt(0.5):
+	if (az >= 0.0f)
+	{
+		s = fast_math_sqrt(0.5f * (1.0f + az));
+		g_q[0] = s;
+		g_q[1] = ay / (2.0f * s);
+		g_q[2] = -ax / (2.0f * s);
+		g_q[3] = 0.0f;
+	}
+	else
+	{
+		s = fast_math_sqrt(0.5f * (1.0f - az));
+		g_q[0] = ay / (2.0f * s);
+		g_q[1] = s;
+		g_q[2] = 0.0f;
+		g_q[3] = ax / (2.0f * s);
+	}
+
+	g_integral[0] = 0.0f;
+	g_integral[1] = 0.0f;
+	g_integral[2] = 0.0f;
+	g_ready = true;
+}
+
+/*
+ * @brief: One filter step. Constant cost: no loops, one square root for
+ *         each normalization and no trigonometry.
+ *
+ * @param: gyro Angular rates, in rad/s.
+ * @param: acc  Accelerometer reading, in g.
+ * @param: dt   Time since the previous sample, in seconds.
+ */
+void attitude_update(const float gyro[3], const float acc[3], float dt)
+{
+	float gx = gyro[0];
+	float gy = gyro[1];
+	float gz = gyro[2];
+	float q0 = g_q[0];
+	float q1 = g_q[1];
+	float q2 = g_q[2];
+	float q3 = g_q[3];
+	float norm = fast_math_sqrt(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]);
+	float ax = 0.0f;
+	float ay = 0.0f;
+	float az = 0.0f;
+	float vx = 0.0f;
+	float vy = 0.0f;
+	float vz = 0.0f;
+	float ex = 0.0f;
+	float ey = 0.0f;
+	float ez = 0.0f;
+
+	if ((norm > (1.0f - ATTITUDE_ACC_GATE)) && (norm < (1.0f + ATTITUDE_ACC_GATE)))
+	{
+		ax = acc[0] / norm;
+		ay = acc[1] / norm;
+		az = acc[2] / norm;
+
+		// Estimated gravity, halved:
+		vx = q1 * q3 - q0 * q2;
+		vy = q0 * q1 + q2 * q3;
+		vz = q0 * q0 - 0.5f + q3 * q3;
+
+		// Error is the cross product of measured and estimated gravity:
+		ex = ay * vz - az * vy;
+		ey = az * vx - ax * vz;
+		ez = ax * vy - ay * vx;
+
+		g_integral[0] += 2.0f * ATTITUDE_KI * ex * dt;
+		g_integral[1] += 2.0f * ATTITUDE_KI * ey * dt;
+		g_integral[2] += 2.0f * ATTITUDE_KI * ez * dt;
+
+		gx += 2.0f * ATTITUDE_KP * ex;
+		gy += 2.0f * ATTITUDE_KP * ey;
+		gz += 2.0f * ATTITUDE_KP * ez;
+	}
+
+	gx += g_integral[0];
+	gy += g_integral[1];
+	gz += g_integral[2];
+
+	// Quaternion derivative, integrated over dt:
+	gx *= 0.5f * dt;
+	gy *= 0.5f * dt;
+	gz *= 0.5f * dt;
+	g_q[0] = q0 + (-q1 * gx - q2 * gy - q3 * gz);
+	g_q[1] = q1 + ( q0 * gx + q2 * gz - q3 * gy);
+	g_q[2] = q2 + ( q0 * gy - q1 * gz + q3 * gx);
+	g_q[3] = q3 + ( q0 * gz + q1 * gy - q2 * gx);
+
+	norm = fast_math_sqrt(g_q[0] * g_q[0] + g_q[1] * g_q[1] +
+			g_q[2] * g_q[2] + g_q[3] * g_q[3]);
+	g_q[0] /= norm;
+	g_q[1] /= norm;
+	g_q[2] /= norm;
+	g_q[3] /= norm;
+}
+
+/*
+ * @brief: Gravity direction in the sensor frame, as estimated by the
+ *         filter (unit vector).
+ *
+ * @param: gravity Where the vector is written.
+ */
+void attitude_get_gravity(float gravity[3])
+{
+	gravity[0] = 2.0f * (g_q[1] * g_q[3] - g_q[0] * g_q[2]);
+	gravity[1] = 2.0f * (g_q[0] * g_q[1] + g_q[2] * g_q[3]);
+	gravity[2] = g_q[0] * g_q[0] - g_q[1] * g_q[1] - g_q[2] * g_q[2] + g_q[3] * g_q[3];
+}
+
+/*
+ * @brief: Angle between the sensor Y-axis and the horizontal plane, in
+ *         degrees. Same convention as atan2(AcY, sqrt(AcX^2 + AcZ^2)).
+ */
+float attitude_get_angle(void)
+{
+	float v[3];
+
+	attitude_get_gravity(v);
+
+	return fast_math_atan2(v[1], fast_math_sqrt(v[0] * v[0] + v[2] * v[2])) *
+			ATTITUDE_RAD_2_DEG;
+}
+
+/*
+ * @brief: Returns true once attitude_reset() has been called.
+ */
+bool attitude_ready(void)
+{
+	return g_ready;
+}
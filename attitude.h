@@ -0,0 +1,81 @@
+/*
+ * @file     attitude.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the attitude estimator: a Mahony filter that
+ *           integrates gyroscope rates into a quaternion at the IMU
+ *           sample rate and corrects its drift with the gravity vector
+ *           measured by the accelerometer.
+ */
+
+#ifndef ATTITUDE_H_
+#define ATTITUDE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fast_math.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Proportional and integral gains of the gravity correction. Kp sets the
+// time constant the accelerometer needs to pull the gyro back (~1 / Kp s),
+// Ki how fast the gyro bias left after calibration is learned:
+#define ATTITUDE_KP          1.0f
+#define ATTITUDE_KI          0.1f
+
+// Accelerometer readings further than this from 1 g (bumps, braking) are
+// not trusted as gravity, and only the gyro is integrated:
+#define ATTITUDE_ACC_GATE    0.25f
+
+#define ATTITUDE_RAD_2_DEG   57.295779f
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Starts the estimator from the attitude given by a gravity
+ *         reading, with zero yaw and no learned gyro bias.
+ *
+ * @param: acc Accelerometer reading (any unit, it is normalized).
+ */
+void attitude_reset(const float acc[3]);
+
+/*
+ * @brief: One filter step. Constant cost: no loops, one square root for
+ *         each normalization and no trigonometry.
+ *
+ * @param: gyro Angular rates, in rad/s.
+ * @param: acc  Accelerometer reading, in g.
+ * @param: dt   Time since the previous sample, in seconds.
+ */
+void attitude_update(const float gyro[3], const float acc[3], float dt);
+
+/*
+ * @brief: Gravity direction in the sensor frame, as estimated by the
+ *         filter (unit vector).
+ *
+ * @param: gravity Where the vector is written.
+ */
+void attitude_get_gravity(float gravity[3]);
+
+/*
+ * @brief: Angle between the sensor Y-axis and the horizontal plane, in
+ *         degrees. Same convention as atan2(AcY, sqrt(AcX^2 + AcZ^2)).
+ */
+float attitude_get_angle(void);
+
+/*
+ * @brief: Returns true once attitude_reset() has been called.
+ */
+bool attitude_ready(void);
+
+#endif /* ATTITUDE_H_ */
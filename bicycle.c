@@ -17,8 +17,27 @@
  * ******************************************************************
  */
 
-/* PIT callback that indicates new measures must be taken: */
-static void data_refresh_callback(void);
+/* Software timer callback that posts the periodic tasks: */
+static void data_refresh_callback(void * context);
+
+/* Interrupt callbacks that post the IMU and touch tasks: */
+static void bicycle_post_fusion(void);
+static void bicycle_post_touch(void);
+
+/* Scheduler tasks, besides bicycle_update_FSM(): */
+static void bicycle_fusion_task(void);
+static void bicycle_sensors_task(void);
+static void bicycle_render_task(void);
+static void bicycle_log_task(void);
+
+/* Starts, aborts and saves the IMU calibration: */
+static void bicycle_calibration(void);
+
+/* Shows the calibration state on the records screen: */
+static void display_calibration(screen_message_t * msg);
+
+/* Shows a skid alert next to the title while one is held: */
+static void display_skid(void);
 
 /*
  * ******************************************************************
@@ -29,25 +48,50 @@ static void data_refresh_callback(void);
 static state_t g_current_state = DataState;
 
 static uint8_t g_speed_data[]    = "00.0 KM/H";
-static uint8_t g_angle_data[]    = "00.0^";
+static uint8_t g_angle_data[]    = " 00.0^  00.0 PCT";
+static uint8_t g_accel_data[]    = " 0.0 M/S2";
+static uint8_t g_cadence_data[]  = "000 RPM";
 static uint8_t g_distance_data[] = "0000 M";
+static uint8_t g_gear_data[]     = "0.00";
 
-static bool g_data_refresh = 0;
+static uint32_t g_refresh_ticks = 0;
+static uint32_t g_still_ticks   = 0;
+static bool g_auto_calib_tried = false;
+static skid_type_t g_skid_shown = SKID_NONE;
+static soft_timer_t g_refresh_timer;
 
 static screen_message_t g_title_str    = {"CURRENT TRIP", 12};
 static screen_message_t g_speed_str    = {"SPEED:",        6};
-static screen_message_t g_angle_str    = {"INCLINATION:", 12};
+static screen_message_t g_accel_str    = {"ACCEL:",        6};
+static screen_message_t g_angle_str    = {"GRADE:",        6};
+static screen_message_t g_cadence_str  = {"CADENCE:",      8};
 static screen_message_t g_distance_str = {"DISTANCE:",     9};
+static screen_message_t g_gear_str     = {"GEAR:",         5};
 
 static screen_message_t g_record_title_str = {"HISTORIC RECORDS", 16};
 static screen_message_t g_dist_record_str  = {"TOTAL DISTANCE:",  15};
 static screen_message_t g_speed_record_str = {"AVERAGE SPEED:",   14};
 
+// Same length, so each one covers the previous:
+static screen_message_t g_calib_run_str  = {"CALIBRATING", 11};
+static screen_message_t g_calib_ok_str   = {"CALIBRATED ", 11};
+static screen_message_t g_calib_fail_str = {"CAL FAILED ", 11};
+
+// Skid alerts, same length too:
+static screen_message_t g_skid_lock_str  = {"LOCK", 4};
+static screen_message_t g_skid_spin_str  = {"SLIP", 4};
+static screen_message_t g_skid_clear_str = {"    ", 4};
+
 float g_inclination   = 0.0f;
+float g_grade_percent = 0.0f;
 float g_current_speed = 0.0f;
-float g_prev_speed    = 0.0f;
+float g_acceleration  = 0.0f;
 uint32_t g_distance   = 0;
+// Part of a meter travelled, not added to g_distance yet:
+static float g_distance_frac = 0.0f;
 float g_freq          = 0.0f;
+float g_cadence       = 0.0f;
+float g_gear_ratio    = 0.0f;
 
 uint32_t g_avg_speed   = 0;
 uint32_t g_avg_samples = 0;
@@ -64,6 +108,12 @@ button_t g_sesion_btn = {
 		96, 32
 };
 
+button_t g_calib_btn = {
+		{"CALIB", 5},
+		30, 200,
+		96, 32
+};
+
 /*
  * ******************************************************************
  * Function code:
@@ -77,23 +127,35 @@ button_t g_sesion_btn = {
  */
 void bicyclye_init_modules(void)
 {
+	timebase_init();
+	soft_timer_init();
+	scheduler_init();
 	GUI_init();
 	init_freq();
+	roughness_init();
+	imu_cadence_init();
+	skid_init();
+	speed_fusion_init();
 	MPU6050_init();
 	ftm_speed_init();
+	ftm_speed_self_test();
 
 	bicycle_main_screen();
 
 	GUI_create_button(&g_record_btn);
 
-	// PIT config:
-	PIT_SetTimerPeriod(PIT, UPDATE_PIT_CHNL, USEC_TO_COUNT(500000U, 21000000));
-	// PIT interrupt config:
-	PIT_EnableInterrupts(PIT, UPDATE_PIT_CHNL, kPIT_TimerInterruptEnable);
-	PIT_callback_init(UPDATE_PIT_CHNL, data_refresh_callback);
-	NVIC_enable_interrupt_and_priotity(UPDATE_PIT_IRQ, PRIORITY_1);
-
-	PIT_StartTimer(PIT, UPDATE_PIT_CHNL);
+	// Tasks, posted by the refresh timer, the IMU and the touch screen:
+	scheduler_add_task(BICYCLE_TASK_FUSION,  bicycle_fusion_task);
+	scheduler_add_task(BICYCLE_TASK_TOUCH,   bicycle_update_FSM);
+	scheduler_add_task(BICYCLE_TASK_SENSORS, bicycle_sensors_task);
+	scheduler_add_task(BICYCLE_TASK_RENDER,  bicycle_render_task);
+	scheduler_add_task(BICYCLE_TASK_LOG,     bicycle_log_task);
+	MPU6050_callback_init(bicycle_post_fusion);
+	Touch_callback_init(bicycle_post_touch);
+
+	// Refresh timer:
+	soft_timer_setup(&g_refresh_timer, data_refresh_callback, NULL);
+	soft_timer_start(&g_refresh_timer, IMU_PERIOD_MS, IMU_PERIOD_MS);
 }
 
 
@@ -107,10 +169,16 @@ void bicycle_main_screen(void)
 	GUI_write_string(&g_title_str);
 	GUI_set_cursor(10,40);
 	GUI_write_string(&g_speed_str);
+	GUI_set_cursor(10,73);
+	GUI_write_string(&g_accel_str);
 	GUI_set_cursor(10,106);
 	GUI_write_string(&g_angle_str);
+	GUI_set_cursor(10,139);
+	GUI_write_string(&g_cadence_str);
 	GUI_set_cursor(10,172);
 	GUI_write_string(&g_distance_str);
+	GUI_set_cursor(10,205);
+	GUI_write_string(&g_gear_str);
 }
 
 
@@ -130,12 +198,13 @@ void bicycle_record_screen(void)
 
 
 /*
- * @brief: checks if the touch screen has been pressed in order to
- *         change between states, and which information to display.
+ * @brief: Touch task. Checks if the touch screen has been pressed in order
+ *         to change between states, and which information to display.
  */
 void bicycle_update_FSM(void)
 {
 	RGB_pixel_t bg_color = {0x1F, 0x3F, 0x1F};
+	Coordinate_t touch_spot = {0};
 	uint32_t saved_dist  = 0;
 	uint32_t saved_speed = 0;
 	mem_data_t mem_data_dist  = {
@@ -157,7 +226,10 @@ void bicycle_update_FSM(void)
 				g_current_state = RecordState;
 				Display_fill_screen(bg_color);
 				GUI_create_button(&g_sesion_btn);
+				GUI_create_button(&g_calib_btn);
 
+				// The EEPROM shares the I2C bus with the IMU:
+				MPU6050_suspend();
 				RTC_mod_read_mem(&mem_data_dist);
 				RTC_mod_read_mem(&mem_data_speed);
 
@@ -166,6 +238,7 @@ void bicycle_update_FSM(void)
 
 				RTC_mod_write_mem(&mem_data_dist);
 				RTC_mod_write_mem(&mem_data_speed);
+				MPU6050_resume();
 
 				g_distance = 0;
 
@@ -173,32 +246,28 @@ void bicycle_update_FSM(void)
 				display_record(saved_dist, saved_speed);
 
 			}
-			else if (g_data_refresh)
-			{
-				g_freq = freq_get_freq();
-				g_prev_speed = g_current_speed;
-				g_current_speed = bicycle_calculate_speed(g_freq);
-
-				g_avg_samples++;
-
-				g_inclination = MPU6050_get_angle() - 55;
-
-				g_distance += (g_prev_speed / 3.6f);
-
-				ftm_speed_update(g_current_speed);
-
-				display_data();
-				g_data_refresh = false;
-			}
 		break;
 
 		case RecordState:
-			if(GUI_button_pressed(&g_sesion_btn))
+			// Two buttons, so the touch is read only once:
+			if (Touch_pressed())
 			{
-				g_current_state = DataState;
-				Display_fill_screen(bg_color);
-				bicycle_main_screen();
-				GUI_create_button(&g_record_btn);
+				Touch_clear_irq_flag();
+				touch_spot = Touch_get_coordinates();
+
+				if (GUI_button_hit(&g_sesion_btn, touch_spot))
+				{
+					g_current_state = DataState;
+					Display_fill_screen(bg_color);
+					bicycle_main_screen();
+					g_skid_shown = SKID_NONE;
+					GUI_create_button(&g_record_btn);
+				}
+				else if (GUI_button_hit(&g_calib_btn, touch_spot))
+				{
+					imu_calib_start();
+					display_calibration(&g_calib_run_str);
+				}
 			}
 		break;
 	}
@@ -213,11 +282,18 @@ void bicycle_update_FSM(void)
 void display_data(void)
 {
 	screen_message_t speed_data = {0};
+	screen_message_t accel_data = {0};
 	screen_message_t angle_data = {0};
+	screen_message_t cadence_data = {0};
 	screen_message_t distance_data = {0};
+	screen_message_t gear_data = {0};
 
 	uint32_t spd_val = (uint32_t)(g_current_speed * 10);
-	uint32_t inc_val = (uint32_t)(g_inclination * 10);
+	uint32_t acc_val = 0;
+	uint32_t inc_val = 0;
+	uint32_t pct_val = 0;
+	uint32_t cad_val = (uint32_t)(g_cadence);
+	uint32_t gear_val = (uint32_t)(g_gear_ratio * 100);
 
 	//Speed value decoding:
 	g_speed_data[0] = (spd_val / 100) + 0x30;
@@ -230,17 +306,74 @@ void display_data(void)
 	GUI_set_cursor(162,40);
 	GUI_write_string(&speed_data);
 
-	// Inclination value decoding:
-	g_angle_data[0] = (inc_val / 100) + 0x30;
-	g_angle_data[1] = ((inc_val / 10) % 10)  + 0x30;
-	g_angle_data[3] = (inc_val % 10) + 0x30;
+	// Acceleration value decoding (sign, then magnitude):
+	if (g_acceleration < 0.0f)
+	{
+		g_accel_data[0] = '-';
+		acc_val = (uint32_t)(-g_acceleration * 10);
+	}
+	else
+	{
+		g_accel_data[0] = ' ';
+		acc_val = (uint32_t)(g_acceleration * 10);
+	}
+	g_accel_data[1] = ((acc_val / 10) % 10) + 0x30;
+	g_accel_data[3] = (acc_val % 10) + 0x30;
+
+	// Displaying acceleration:
+	accel_data.message = g_accel_data;
+	accel_data.msg_size = 9;
+	GUI_set_cursor(162,73);
+	GUI_write_string(&accel_data);
+
+	// Inclination value decoding, degrees then percent (sign, then
+	// magnitude):
+	if (g_inclination < 0.0f)
+	{
+		g_angle_data[0] = '-';
+		inc_val = (uint32_t)(-g_inclination * 10);
+	}
+	else
+	{
+		g_angle_data[0] = ' ';
+		inc_val = (uint32_t)(g_inclination * 10);
+	}
+	g_angle_data[1] = ((inc_val / 100) % 10) + 0x30;
+	g_angle_data[2] = ((inc_val / 10) % 10)  + 0x30;
+	g_angle_data[4] = (inc_val % 10) + 0x30;
+
+	if (g_grade_percent < 0.0f)
+	{
+		g_angle_data[7] = '-';
+		pct_val = (uint32_t)(-g_grade_percent * 10);
+	}
+	else
+	{
+		g_angle_data[7] = ' ';
+		pct_val = (uint32_t)(g_grade_percent * 10);
+	}
+	g_angle_data[8]  = ((pct_val / 100) % 10) + 0x30;
+	g_angle_data[9]  = ((pct_val / 10) % 10)  + 0x30;
+	g_angle_data[11] = (pct_val % 10) + 0x30;
 
-	// Displaying inclination:
+	// Displaying inclination. Both units take 16 characters, 192 px: they
+	// start left of the other values to end within the screen:
 	angle_data.message = g_angle_data;
-	angle_data.msg_size = 5;
-	GUI_set_cursor(162,106);
+	angle_data.msg_size = 16;
+	GUI_set_cursor(106,106);
 	GUI_write_string(&angle_data);
 
+	// Cadence value decoding:
+	g_cadence_data[0] = ((cad_val / 100) % 10) + 0x30;
+	g_cadence_data[1] = ((cad_val / 10)  % 10) + 0x30;
+	g_cadence_data[2] = (cad_val % 10) + 0x30;
+
+	// Displaying cadence:
+	cadence_data.message = g_cadence_data;
+	cadence_data.msg_size = 7;
+	GUI_set_cursor(162,139);
+	GUI_write_string(&cadence_data);
+
 	// Distance value decoding:
 	g_distance_data[0] = ((g_distance / 1000) % 10) + 0x30;
 	g_distance_data[1] = ((g_distance / 100)  % 10) + 0x30;
@@ -253,6 +386,17 @@ void display_data(void)
 	distance_data.msg_size = 6;
 	GUI_set_cursor(162,172);
 	GUI_write_string(&distance_data);
+
+	// Gear ratio decoding:
+	g_gear_data[0] = ((gear_val / 100) % 10) + 0x30;
+	g_gear_data[2] = ((gear_val / 10)  % 10) + 0x30;
+	g_gear_data[3] = (gear_val % 10) + 0x30;
+
+	// Displaying gear ratio, left of the record button:
+	gear_data.message = g_gear_data;
+	gear_data.msg_size = 4;
+	GUI_set_cursor(100,205);
+	GUI_write_string(&gear_data);
 }
 
 
@@ -307,10 +451,239 @@ float bicycle_calculate_speed(float freq)
 
 
 /*
- * @brief: This PIT callback turns on a flag that indicates new speed and
- *         inclination measures must be taken.
+ * @brief: This software timer callback posts the IMU tick tasks and, every
+ *         REFRESH_TICKS calls, the one that takes new speed and inclination
+ *         measures and shows them.
+ */
+static void data_refresh_callback(void * context)
+{
+	(void)context;
+
+	scheduler_post(BICYCLE_TASK_SENSORS);
+	scheduler_post(BICYCLE_TASK_LOG);
+
+	g_refresh_ticks++;
+	if (g_refresh_ticks >= REFRESH_TICKS)
+	{
+		g_refresh_ticks = 0;
+		scheduler_post(BICYCLE_TASK_RENDER);
+	}
+}
+
+
+/*
+ * @brief: IMU callback, new samples are in the ring buffer.
+ */
+static void bicycle_post_fusion(void)
+{
+	scheduler_post(BICYCLE_TASK_FUSION);
+}
+
+
+/*
+ * @brief: Touch callback, the screen has been pressed.
+ */
+static void bicycle_post_touch(void)
+{
+	scheduler_post(BICYCLE_TASK_TOUCH);
+}
+
+
+/*
+ * @brief: Fusion task. IMU samples are filtered as each FIFO read brings
+ *         them, so the skid check and the speed correction compare the IMU
+ *         and the wheel at about the same moment.
+ */
+static void bicycle_fusion_task(void)
+{
+	if (MPU6050_update())
+	{
+		skid_check();
+		speed_fusion_correct();
+	}
+}
+
+
+/*
+ * @brief: Sensors task, every IMU tick: trip distance, road roughness,
+ *         calibration, the gauges and the skid alert.
+ */
+static void bicycle_sensors_task(void)
+{
+	freq_edge_t edge;
+
+	// Trip distance, a wheel circumference per turn:
+	while (freq_get_edge(&edge))
+	{
+		g_distance_frac += WHEEL;
+	}
+	g_distance += (uint32_t)g_distance_frac;
+	g_distance_frac -= (float)((uint32_t)g_distance_frac);
+
+	roughness_process();
+	bicycle_calibration();
+
+	// The speed needle follows the fused speed at the IMU tick:
+	ftm_speed_update_gauges(speed_fusion_get() * 3.6f, g_cadence, g_inclination);
+
+	if (DataState == g_current_state)
+	{
+		display_skid();
+	}
+}
+
+
+/*
+ * @brief: Render task, every REFRESH_TICKS IMU ticks: takes new measures
+ *         and shows them on the real-time screen.
+ */
+static void bicycle_render_task(void)
+{
+	if (DataState != g_current_state)
+	{
+		return;
+	}
+
+	g_freq = freq_get_predicted_freq();
+	g_current_speed = speed_fusion_get() * 3.6f;
+	g_acceleration  = freq_get_accel();
+	g_cadence       = freq_get_cadence();
+
+	// No crank sensor fitted (it has never seen an edge): the cadence
+	// comes from the frame sway while the wheel turns.
+	if ((0 == freq_get_diagnostics(FREQ_CRANK).accepted_edges) && (g_freq > 0.0f))
+	{
+		g_cadence = imu_cadence_get(NULL);
+	}
+
+	// Gear ratio: wheel turns per crank turn.
+	g_gear_ratio = 0.0f;
+	if (g_cadence > 0.0f)
+	{
+		g_gear_ratio = (g_freq * 60.0f) / g_cadence;
+	}
+
+	g_avg_samples++;
+
+	g_inclination   = MPU6050_get_angle();
+	g_grade_percent = grade_get_percent();
+
+	display_data();
+}
+
+
+/*
+ * @brief: Logging task, every IMU tick. One page per tick, the EEPROM
+ *         finishes its write cycle meanwhile.
  */
-static void data_refresh_callback(void)
+static void bicycle_log_task(void)
 {
-	g_data_refresh = true;
+	crash_process();
+}
+
+
+/*
+ * @brief: Handles the IMU calibration, every IMU tick: starts it when
+ *         none is stored and the wheel has been stopped for a while (once
+ *         per stop, and only kept if the bike stands upright), aborts it
+ *         if the wheel moves, and saves its result. Also tells
+ *         the gyro temperature table when it may learn, and saves it
+ *         when the bike starts moving.
+ */
+static void bicycle_calibration(void)
+{
+	imu_calib_state_t state = imu_calib_get_state();
+	bool stopped = (freq_get_freq() <= 0.0f);
+
+	gyro_temp_set_stopped(stopped);
+
+	if (!stopped)
+	{
+		// Whatever the gyro learned while stopped, saved once per stop:
+		if ((0 != g_still_ticks) && gyro_temp_dirty())
+		{
+			MPU6050_suspend();
+			gyro_temp_save();
+			MPU6050_resume();
+		}
+
+		g_still_ticks = 0;
+		g_auto_calib_tried = false;
+		if (IMU_CALIB_RUNNING == state)
+		{
+			imu_calib_abort();
+			display_calibration(&g_calib_fail_str);
+		}
+		return;
+	}
+
+	if (g_still_ticks < CALIB_STILL_TICKS)
+	{
+		g_still_ticks++;
+	}
+	else if (!imu_calib_is_valid() && !g_auto_calib_tried && (IMU_CALIB_IDLE == state))
+	{
+		// Once per stop, a failure here is most likely a slope or a lean:
+		g_auto_calib_tried = true;
+		imu_calib_start_auto();
+		display_calibration(&g_calib_run_str);
+	}
+
+	if (IMU_CALIB_DONE == state)
+	{
+		// The EEPROM shares the I2C bus with the IMU:
+		MPU6050_suspend();
+		imu_calib_save();
+		MPU6050_resume();
+		imu_calib_clear_state();
+		display_calibration(&g_calib_ok_str);
+	}
+	else if (IMU_CALIB_FAILED == state)
+	{
+		// Wait for the bike to settle before trying again:
+		g_still_ticks = 0;
+		imu_calib_clear_state();
+		display_calibration(&g_calib_fail_str);
+	}
+}
+
+
+/*
+ * @brief: Shows the calibration state on the records screen, below the
+ *         records. Nothing is shown on the other screens.
+ */
+static void display_calibration(screen_message_t * msg)
+{
+	if (RecordState == g_current_state)
+	{
+		GUI_set_cursor(10,160);
+		GUI_write_string(msg);
+	}
+}
+
+/*
+ * @brief: Shows a skid alert next to the title while one is held, only
+ *         writing to the screen when it changes.
+ */
+static void display_skid(void)
+{
+	skid_type_t alert = skid_get_alert();
+
+	if (alert != g_skid_shown)
+	{
+		GUI_set_cursor(250,1);
+		if (SKID_LOCK == alert)
+		{
+			GUI_write_string(&g_skid_lock_str);
+		}
+		else if (SKID_SPIN == alert)
+		{
+			GUI_write_string(&g_skid_spin_str);
+		}
+		else
+		{
+			GUI_write_string(&g_skid_clear_str);
+		}
+		g_skid_shown = alert;
+	}
 }
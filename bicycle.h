@@ -15,6 +15,7 @@
 #include "rtc_mod.h"
 #include "ftm_speed.h"
 #include "freq.h"
+#include "scheduler.h"
 
 /*
  * ******************************************************************
@@ -22,10 +23,16 @@
  * ******************************************************************
  */
 
-#define WHEEL 2.075f
+#define WHEEL FREQ_WHEEL_CIRC
 
-#define UPDATE_PIT_CHNL kPIT_Chnl_2
-#define UPDATE_PIT_IRQ  PIT_CH2_IRQ
+// IMU samples are filtered every IMU_PERIOD_MS, the screen is refreshed every
+// REFRESH_TICKS of those:
+#define IMU_PERIOD_MS   100U
+#define REFRESH_TICKS   5U
+
+// The IMU calibrates itself when none is stored and the wheel has been
+// stopped for this many IMU ticks (5 s):
+#define CALIB_STILL_TICKS 50U
 
 /*
  * ******************************************************************
@@ -39,6 +46,15 @@ typedef enum {
 	RecordState,
 } state_t;
 
+/* Scheduler tasks, from the highest priority: */
+typedef enum {
+	BICYCLE_TASK_FUSION,      // IMU samples, skid check and fused speed.
+	BICYCLE_TASK_TOUCH,       // Buttons and screen changes.
+	BICYCLE_TASK_SENSORS,     // IMU tick: roughness, calibration, gauges.
+	BICYCLE_TASK_RENDER,      // New measures on the real-time screen.
+	BICYCLE_TASK_LOG,         // Crash event pages to the EEPROM.
+} bicycle_task_t;
+
 /*
  * ******************************************************************
  * Function prototypes:
@@ -68,8 +84,8 @@ void bicycle_record_screen(void);
 
 
 /*
- * @brief: checks if the touch screen has been pressed in order to
- *         change between states, and which information to display.
+ * @brief: Touch task. Checks if the touch screen has been pressed in order
+ *         to change between states, and which information to display.
  */
 void bicycle_update_FSM(void);
 
@@ -0,0 +1,544 @@
+/*
+ * @file     crash.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the crash recorder: the last seconds of IMU
+ *           samples are kept in a RAM ring. An impact or a fall freezes the
+ *           samples before it, the samples after it are captured, and the
+ *           event is delta-compressed and written to the RTC module EEPROM
+ *           one page at a time from the main loop.
+ */
+
+#include "crash.h"
+#include "MPU6050.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static crash_frame_t g_ring[CRASH_RING_SIZE];
+static uint32_t g_head = 0;
+static uint32_t g_filled = 0;
+
+static crash_state_t g_state = CRASH_ARMED;
+static crash_stats_t g_stats = {0};
+
+// Trigger checks:
+static uint32_t g_tilt_count = 0;
+static uint32_t g_calm_count = 0;
+
+// Event being captured:
+static uint32_t g_start = 0;
+static uint32_t g_pre = 0;
+static uint32_t g_post_left = 0;
+static float g_peak_acc = 0.0f;
+static crash_header_t g_header;
+
+// Events recorded so far, read from the EEPROM at start up:
+static uint32_t g_event_count = 0;
+
+// EEPROM image of the event, header page then payload, and the write
+// progress through it:
+static uint8_t g_image[CRASH_EEPROM_SIZE];
+static crash_frame_t g_frames[CRASH_FRAMES];
+static bool g_encoded = false;
+static uint32_t g_write_offset = 0;
+static uint32_t g_write_end = 0;
+static uint32_t g_write_retries = 0;
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static int16_t crash_quantize(float value, float scale);
+static void crash_trigger(uint32_t timestamp, crash_cause_t cause);
+static void crash_prepare(void);
+static uint32_t crash_checksum(const crash_header_t * header, const uint8_t * payload);
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Empties the ring and reads the event count from the EEPROM, so
+ *         a new event continues it. Called before the IMU acquisition
+ *         takes the I2C bus.
+ */
+void crash_init(void)
+{
+	crash_header_t header;
+
+	g_head = 0;
+	g_filled = 0;
+	g_tilt_count = 0;
+	g_calm_count = 0;
+	g_state = CRASH_ARMED;
+	g_encoded = false;
+
+	g_event_count = 0;
+	if (crash_read_header(&header))
+	{
+		g_event_count = header.count;
+	}
+}
+
+/*
+ * @brief: Adds one IMU sample and checks the triggers.
+ *
+ * @param: timestamp Sample time, in ms.
+ * @param: acc       Acceleration in the bicycle frame, in g, with gravity.
+ * @param: gyro      Angular rates in the bicycle frame, in rad/s.
+ * @param: gravity   Unit gravity direction from the attitude filter.
+ */
+void crash_add_sample(uint32_t timestamp, const float acc[3],
+		const float gyro[3], const float gravity[3])
+{
+	crash_frame_t * frame = &g_ring[g_head];
+	float magnitude = fast_math_sqrt(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]);
+	bool impact = (magnitude > CRASH_ACC_LIMIT);
+	bool tilted = (gravity[2] < CRASH_TILT_COS);
+	uint32_t i = 0;
+
+	// The ring is frozen until the event has been compressed:
+	if ((CRASH_WRITING == g_state) && !g_encoded)
+	{
+		return;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		frame->value[i]     = crash_quantize(acc[i], CRASH_ACC_SCALE);
+		frame->value[i + 3] = crash_quantize(gyro[i], CRASH_GYR_SCALE);
+	}
+	g_head = (g_head + 1U) & CRASH_RING_MASK;
+	if (g_filled < CRASH_RING_SIZE)
+	{
+		g_filled++;
+	}
+
+	g_tilt_count = tilted ? (g_tilt_count + 1U) : 0U;
+
+	switch (g_state)
+	{
+		case CRASH_ARMED:
+			if (impact)
+			{
+				crash_trigger(timestamp, CRASH_CAUSE_IMPACT);
+			}
+			else if (g_tilt_count >= CRASH_TILT_SAMPLES)
+			{
+				crash_trigger(timestamp, CRASH_CAUSE_FALL);
+			}
+			if (CRASH_CAPTURING == g_state)
+			{
+				g_peak_acc = magnitude;
+			}
+		break;
+
+		case CRASH_CAPTURING:
+			if (magnitude > g_peak_acc)
+			{
+				g_peak_acc = magnitude;
+			}
+			g_post_left--;
+			if (0 == g_post_left)
+			{
+				g_encoded = false;
+				g_state = CRASH_WRITING;
+			}
+		break;
+
+		case CRASH_REARMING:
+			g_calm_count = (impact || tilted) ? 0U : (g_calm_count + 1U);
+			if (g_calm_count >= CRASH_REARM_SAMPLES)
+			{
+				g_tilt_count = 0;
+				g_state = CRASH_ARMED;
+			}
+		break;
+
+		default:
+		break;
+	}
+}
+
+/*
+ * @brief: Compresses a captured event, then writes at most one EEPROM page
+ *         per call, the header last. A page the EEPROM refuses because it
+ *         is still busy is tried again on the next call. Meant for the
+ *         main loop.
+ *
+ * @retval: true while an event is being written.
+ */
+bool crash_process(void)
+{
+	uint32_t status = kStatus_Success;
+	mem_data_t page;
+
+	if (CRASH_WRITING != g_state)
+	{
+		return false;
+	}
+
+	if (!g_encoded)
+	{
+		crash_prepare();
+		g_encoded = true;
+		return true;
+	}
+
+	// Payload pages first; the header page goes last, so an interrupted
+	// write leaves a header whose checksum does not match:
+	if (g_write_offset < g_write_end)
+	{
+		page.address    = CRASH_EEPROM_ADDR + g_write_offset;
+		page.data_array = &g_image[g_write_offset];
+		page.size       = MEM_PAGE_SIZE;
+		if (page.size > (g_write_end - g_write_offset))
+		{
+			page.size = g_write_end - g_write_offset;
+		}
+	}
+	else
+	{
+		page.address    = CRASH_EEPROM_ADDR;
+		page.data_array = &g_image[0];
+		page.size       = sizeof(crash_header_t);
+	}
+
+	MPU6050_suspend();
+	status = RTC_mod_write_mem(&page);
+	MPU6050_resume();
+
+	if (kStatus_Success != status)
+	{
+		g_write_retries++;
+		if (g_write_retries >= CRASH_WRITE_RETRIES)
+		{
+			g_stats.dropped++;
+			g_calm_count = 0;
+			g_state = CRASH_REARMING;
+		}
+		return true;
+	}
+	g_write_retries = 0;
+
+	if (g_write_offset < g_write_end)
+	{
+		g_write_offset += page.size;
+		return true;
+	}
+
+	g_event_count = g_header.count;
+	g_stats.saved++;
+	g_calm_count = 0;
+	g_state = CRASH_REARMING;
+
+	return false;
+}
+
+/*
+ * @brief: Returns the recorder state.
+ */
+crash_state_t crash_get_state(void)
+{
+	return g_state;
+}
+
+/*
+ * @brief: Returns the trigger, save and loss counters.
+ */
+crash_stats_t crash_get_stats(void)
+{
+	return g_stats;
+}
+
+/*
+ * @brief: Delta-encodes frames.
+ *
+ * @param: frames Frames to encode.
+ * @param: count  Number of frames.
+ * @param: out    Buffer for the code.
+ * @param: max    Size of the buffer.
+ * @param: used   Where the bytes written are stored.
+ *
+ * @retval: Number of frames that fit.
+ */
+uint32_t crash_encode(const crash_frame_t * frames, uint32_t count,
+		uint8_t * out, uint32_t max, uint32_t * used)
+{
+	int16_t prev[CRASH_CHANNELS] = {0};
+	uint8_t code[CRASH_CHANNELS * 3U];
+	uint32_t length = 0;
+	uint32_t size = 0;
+	uint32_t n = 0;
+	uint32_t i = 0;
+	int32_t delta = 0;
+
+	for (n = 0; n < count; n++)
+	{
+		// A frame is stored whole or not at all:
+		length = 0;
+		for (i = 0; i < CRASH_CHANNELS; i++)
+		{
+			delta = (int32_t)frames[n].value[i] - prev[i];
+			if ((delta > CRASH_ESCAPE) && (delta <= 127))
+			{
+				code[length++] = (uint8_t)(int8_t)delta;
+			}
+			else
+			{
+				code[length++] = (uint8_t)CRASH_ESCAPE;
+				code[length++] = (uint8_t)((uint16_t)frames[n].value[i] & 0xFFU);
+				code[length++] = (uint8_t)((uint16_t)frames[n].value[i] >> 8);
+			}
+		}
+
+		if ((size + length) > max)
+		{
+			break;
+		}
+		for (i = 0; i < length; i++)
+		{
+			out[size++] = code[i];
+		}
+		for (i = 0; i < CRASH_CHANNELS; i++)
+		{
+			prev[i] = frames[n].value[i];
+		}
+	}
+
+	*used = size;
+
+	return n;
+}
+
+/*
+ * @brief: Decodes frames written by crash_encode().
+ *
+ * @param: code   Delta code.
+ * @param: size   Bytes of code.
+ * @param: frames Where the frames are written.
+ * @param: max    Size of the frames array.
+ *
+ * @retval: Number of frames decoded.
+ */
+uint32_t crash_decode(const uint8_t * code, uint32_t size,
+		crash_frame_t * frames, uint32_t max)
+{
+	int16_t prev[CRASH_CHANNELS] = {0};
+	uint32_t pos = 0;
+	uint32_t n = 0;
+	uint32_t i = 0;
+
+	for (n = 0; n < max; n++)
+	{
+		for (i = 0; i < CRASH_CHANNELS; i++)
+		{
+			if (pos >= size)
+			{
+				return n;
+			}
+			if (CRASH_ESCAPE == (int8_t)code[pos])
+			{
+				if ((pos + 3U) > size)
+				{
+					return n;
+				}
+				prev[i] = (int16_t)((uint16_t)code[pos + 1U] | ((uint16_t)code[pos + 2U] << 8));
+				pos += 3U;
+			}
+			else
+			{
+				prev[i] = (int16_t)(prev[i] + (int8_t)code[pos]);
+				pos++;
+			}
+			frames[n].value[i] = prev[i];
+		}
+	}
+
+	return n;
+}
+
+/*
+ * @brief: Reads the stored event header. Blocking, the IMU must be kept
+ *         off the I2C bus meanwhile.
+ *
+ * @param: header Where the header is copied.
+ *
+ * @retval: true if an event is stored and its header is valid. The payload
+ *          is checked against the checksum by crash_read_event().
+ */
+bool crash_read_header(crash_header_t * header)
+{
+	mem_data_t mem_data = {
+			(uint8_t *)header,
+			sizeof(crash_header_t), CRASH_EEPROM_ADDR
+	};
+
+	return (kStatus_Success == RTC_mod_read_mem(&mem_data)) &&
+			(CRASH_MAGIC == header->magic) &&
+			(header->payload_size <= CRASH_PAYLOAD_SIZE) &&
+			(header->frames <= CRASH_FRAMES);
+}
+
+/*
+ * @brief: Reads and decodes the stored event. Blocking, the IMU must be
+ *         kept off the I2C bus meanwhile.
+ *
+ * @param: header Where the header is copied.
+ * @param: frames Where the frames are written, CRASH_FRAMES of them.
+ *
+ * @retval: Number of frames, 0 if no valid event is stored.
+ */
+uint32_t crash_read_event(crash_header_t * header, crash_frame_t * frames)
+{
+	uint8_t * payload = &g_image[MEM_PAGE_SIZE];
+	mem_data_t mem_data = {0};
+
+	// The image buffer holds an event being written:
+	if ((CRASH_WRITING == g_state) || !crash_read_header(header))
+	{
+		return 0;
+	}
+
+	mem_data.data_array = payload;
+	mem_data.size       = header->payload_size;
+	mem_data.address    = CRASH_PAYLOAD_ADDR;
+	if ((kStatus_Success != RTC_mod_read_mem(&mem_data)) ||
+		(crash_checksum(header, payload) != header->checksum))
+	{
+		return 0;
+	}
+
+	return crash_decode(payload, header->payload_size, frames, header->frames);
+}
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: Converts to fixed point, saturated to 16 bits.
+ */
+static int16_t crash_quantize(float value, float scale)
+{
+	float scaled = value * scale;
+
+	if (scaled > 32767.0f)
+	{
+		return INT16_MAX;
+	}
+	if (scaled < -32768.0f)
+	{
+		return INT16_MIN;
+	}
+
+	return (int16_t)((scaled < 0.0f) ? (scaled - 0.5f) : (scaled + 0.5f));
+}
+
+/*
+ * @brief: Freezes the samples before the trigger, the one that triggered
+ *         included, and starts the capture of the ones after it.
+ */
+static void crash_trigger(uint32_t timestamp, crash_cause_t cause)
+{
+	g_pre = (g_filled < CRASH_PRE_SAMPLES) ? g_filled : CRASH_PRE_SAMPLES;
+	// Whole frames only:
+	g_pre -= g_pre % CRASH_DECIMATION;
+	g_start = (g_head - g_pre) & CRASH_RING_MASK;
+	g_post_left = CRASH_POST_SAMPLES;
+
+	g_header.timestamp = timestamp;
+	g_header.cause = cause;
+
+	g_stats.triggers++;
+	g_state = CRASH_CAPTURING;
+}
+
+/*
+ * @brief: Averages the captured samples into frames, encodes them after
+ *         the header page of the image, and fills in the header.
+ */
+static void crash_prepare(void)
+{
+	uint8_t * payload = &g_image[MEM_PAGE_SIZE];
+	uint32_t samples = g_pre + CRASH_POST_SAMPLES;
+	uint32_t frames = samples / CRASH_DECIMATION;
+	uint32_t index = g_start;
+	uint32_t stored = 0;
+	uint32_t used = 0;
+	int32_t sum = 0;
+	uint32_t n = 0;
+	uint32_t i = 0;
+	uint32_t k = 0;
+	float peak = g_peak_acc * CRASH_ACC_SCALE;
+
+	for (n = 0; n < frames; n++)
+	{
+		for (i = 0; i < CRASH_CHANNELS; i++)
+		{
+			sum = 0;
+			for (k = 0; k < CRASH_DECIMATION; k++)
+			{
+				sum += g_ring[(index + k) & CRASH_RING_MASK].value[i];
+			}
+			g_frames[n].value[i] = (int16_t)(sum / (int32_t)CRASH_DECIMATION);
+		}
+		index = (index + CRASH_DECIMATION) & CRASH_RING_MASK;
+	}
+
+	stored = crash_encode(g_frames, frames, payload, CRASH_PAYLOAD_SIZE, &used);
+	if (stored < frames)
+	{
+		g_stats.truncated++;
+	}
+
+	g_header.magic        = CRASH_MAGIC;
+	g_header.count        = g_event_count + 1U;
+	g_header.peak_acc     = (peak > 65535.0f) ? 0xFFFFU : (uint16_t)peak;
+	g_header.frames       = (uint16_t)stored;
+	g_header.pre_frames   = (uint16_t)(g_pre / CRASH_DECIMATION);
+	g_header.payload_size = (uint16_t)used;
+	g_header.checksum     = crash_checksum(&g_header, payload);
+
+	for (i = 0; i < sizeof(crash_header_t); i++)
+	{
+		g_image[i] = ((const uint8_t *)&g_header)[i];
+	}
+
+	g_write_offset = MEM_PAGE_SIZE;
+	g_write_end = MEM_PAGE_SIZE + used;
+	g_write_retries = 0;
+}
+
+/*
+ * @brief: Rotating sum of the header words before the checksum field and
+ *         of the payload bytes.
+ */
+static uint32_t crash_checksum(const crash_header_t * header, const uint8_t * payload)
+{
+	const uint32_t * word = (const uint32_t *)header;
+	uint32_t words = (sizeof(crash_header_t) / sizeof(uint32_t)) - 1U;
+	uint32_t sum = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < words; i++)
+	{
+		sum = ((sum << 1) | (sum >> 31)) + word[i];
+	}
+	for (i = 0; i < header->payload_size; i++)
+	{
+		sum = ((sum << 1) | (sum >> 31)) + payload[i];
+	}
+
+	return ~sum;
+}
@@ -0,0 +1,206 @@
+/*
+ * @file     crash.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the crash recorder: the last seconds of IMU
+ *           samples are kept in a RAM ring. An impact or a fall freezes the
+ *           samples before it, the samples after it are captured, and the
+ *           event is delta-compressed and written to the RTC module EEPROM
+ *           one page at a time from the main loop.
+ */
+
+#ifndef CRASH_H_
+#define CRASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fast_math.h"
+#include "rtc_mod.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Ring of IMU samples at 200 Hz, 5.12 s. The samples before the trigger
+// and the ones after it fit together, so the capture never overwrites
+// its own start:
+#define CRASH_RING_SIZE       1024U
+#define CRASH_RING_MASK       (CRASH_RING_SIZE - 1U)
+#define CRASH_PRE_SAMPLES     512U        // 2.56 s before the trigger.
+#define CRASH_POST_SAMPLES    256U        // 1.28 s after it.
+
+// Samples averaged into each stored frame, 100 Hz in the EEPROM:
+#define CRASH_DECIMATION      2U
+#define CRASH_FRAMES          ((CRASH_PRE_SAMPLES + CRASH_POST_SAMPLES) / CRASH_DECIMATION)
+
+// Impact: acceleration magnitude above this, in g.
+#define CRASH_ACC_LIMIT       4.0f
+// Fall: gravity more than 60 deg away from the bicycle Z-axis for 1 s.
+#define CRASH_TILT_COS        0.5f
+#define CRASH_TILT_SAMPLES    200U
+// Re-armed once upright and below the impact level for 1 s:
+#define CRASH_REARM_SAMPLES   200U
+
+// Fixed point of the stored values: mg and mrad/s.
+#define CRASH_ACC_SCALE       1000.0f
+#define CRASH_GYR_SCALE       1000.0f
+#define CRASH_CHANNELS        6U
+
+// Delta code: one signed byte, or this escape and the 16-bit value.
+#define CRASH_ESCAPE          ((int8_t)-128)
+
+// Last event only, from the page after the gyro table to the end of the
+// 4 KB EEPROM. The header goes in the first page, written last.
+#define CRASH_EEPROM_ADDR     0x0400U
+#define CRASH_EEPROM_SIZE     0x0C00U
+#define CRASH_PAYLOAD_ADDR    (CRASH_EEPROM_ADDR + MEM_PAGE_SIZE)
+#define CRASH_PAYLOAD_SIZE    (CRASH_EEPROM_SIZE - MEM_PAGE_SIZE)
+#define CRASH_MAGIC           0x43525348U  // "CRSH"
+
+// Page writes refused (EEPROM busy or bus error) before the event is
+// dropped:
+#define CRASH_WRITE_RETRIES   100U
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+typedef enum{
+	CRASH_ARMED,              // Filling the ring, watching for a trigger.
+	CRASH_CAPTURING,          // Collecting the samples after the trigger.
+	CRASH_WRITING,            // Compressed, going to the EEPROM by pages.
+	CRASH_REARMING            // Waiting for the bicycle to be upright.
+}crash_state_t;
+
+typedef enum{
+	CRASH_CAUSE_NONE,
+	CRASH_CAUSE_IMPACT,
+	CRASH_CAUSE_FALL
+}crash_cause_t;
+
+/* One stored frame, acceleration in mg and rates in mrad/s: */
+typedef struct{
+	int16_t value[CRASH_CHANNELS];  // AcX, AcY, AcZ, GyX, GyY, GyZ.
+}crash_frame_t;
+
+/* Event header, as stored in the EEPROM: */
+typedef struct{
+	uint32_t magic;
+	uint32_t count;           // Events recorded since the EEPROM was blank.
+	uint32_t timestamp;       // Sample timestamp (ms) of the trigger.
+	uint32_t cause;           // crash_cause_t.
+	uint16_t peak_acc;        // Largest acceleration magnitude, mg.
+	uint16_t frames;          // Frames stored.
+	uint16_t pre_frames;      // Frames before the trigger.
+	uint16_t payload_size;    // Bytes of delta code.
+	uint32_t checksum;        // Header words above and the payload bytes.
+}crash_header_t;
+
+/* Counters: */
+typedef struct{
+	uint32_t triggers;
+	uint32_t saved;
+	uint32_t dropped;         // Events lost to EEPROM write errors.
+	uint32_t truncated;       // Events whose code did not fit.
+}crash_stats_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Empties the ring and reads the event count from the EEPROM, so
+ *         a new event continues it. Called before the IMU acquisition
+ *         takes the I2C bus.
+ */
+void crash_init(void);
+
+/*
+ * @brief: Adds one IMU sample and checks the triggers.
+ *
+ * @param: timestamp Sample time, in ms.
+ * @param: acc       Acceleration in the bicycle frame, in g, with gravity.
+ * @param: gyro      Angular rates in the bicycle frame, in rad/s.
+ * @param: gravity   Unit gravity direction from the attitude filter.
+ */
+void crash_add_sample(uint32_t timestamp, const float acc[3],
+		const float gyro[3], const float gravity[3]);
+
+/*
+ * @brief: Compresses a captured event, then writes at most one EEPROM page
+ *         per call, the header last. A page the EEPROM refuses because it
+ *         is still busy is tried again on the next call. Meant for the
+ *         main loop.
+ *
+ * @retval: true while an event is being written.
+ */
+bool crash_process(void);
+
+/*
+ * @brief: Returns the recorder state.
+ */
+crash_state_t crash_get_state(void);
+
+/*
+ * @brief: Returns the trigger, save and loss counters.
+ */
+crash_stats_t crash_get_stats(void);
+
+/*
+ * @brief: Delta-encodes frames.
+ *
+ * @param: frames Frames to encode.
+ * @param: count  Number of frames.
+ * @param: out    Buffer for the code.
+ * @param: max    Size of the buffer.
+ * @param: used   Where the bytes written are stored.
+ *
+ * @retval: Number of frames that fit.
+ */
+uint32_t crash_encode(const crash_frame_t * frames, uint32_t count,
+		uint8_t * out, uint32_t max, uint32_t * used);
+
+/*
+ * @brief: Decodes frames written by crash_encode().
+ *
+ * @param: code   Delta code.
+ * @param: size   Bytes of code.
+ * @param: frames Where the frames are written.
+ * @param: max    Size of the frames array.
+ *
+ * @retval: Number of frames decoded.
+ */
+uint32_t crash_decode(const uint8_t * code, uint32_t size,
+		crash_frame_t * frames, uint32_t max);
+
+/*
+ * @brief: Reads the stored event header. Blocking, the IMU must be kept
+ *         off the I2C bus meanwhile.
+ *
+ * @param: header Where the header is copied.
+ *
+ * @retval: true if an event is stored and its header is valid. The payload
+ *          is checked against the checksum by crash_read_event().
+ */
+bool crash_read_header(crash_header_t * header);
+
+/*
+ * @brief: Reads and decodes the stored event. Blocking, the IMU must be
+ *         kept off the I2C bus meanwhile.
+ *
+ * @param: header Where the header is copied.
+ * @param: frames Where the frames are written, CRASH_FRAMES of them.
+ *
+ * @retval: Number of frames, 0 if no valid event is stored.
+ */
+uint32_t crash_read_event(crash_header_t * header, crash_frame_t * frames);
+
+#endif /* CRASH_H_ */
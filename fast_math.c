@@ -0,0 +1,119 @@
+/*
+ * @file     fast_math.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the constant-time math kernels used by the
+ *           sensor code: arctangent and square root in single precision.
+ */
+
+#include "fast_math.h"
+
+#if !(defined(__ARM_FP) && (__ARM_FP & 0x4))
+#include <math.h>
+#endif
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+/* Minimax coefficients of atan(z) on [0, 1], odd powers 1 to 9: */
+#define ATAN_A1   0.9998660f
+#define ATAN_A3  -0.3302995f
+#define ATAN_A5   0.1801410f
+#define ATAN_A7  -0.0851330f
+#define ATAN_A9   0.0208351f
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static float fast_math_atan_unit(float z);
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Four-quadrant arctangent of y/x, in radians (-pi to pi).
+ *         Degree-9 minimax polynomial on [0, 1] with octant reduction.
+ *         Maximum error 1.2e-5 rad (0.0007 deg) over the whole domain.
+ *         No loops: one division and five multiply-adds, plus the
+ *         quadrant fix-up. Returns 0 for (0, 0).
+ */
+float fast_math_atan2(float y, float x)
+{
+	float abs_x = (x < 0.0f) ? -x : x;
+	float abs_y = (y < 0.0f) ? -y : y;
+	float angle = 0.0f;
+
+	if ((0.0f == abs_x) && (0.0f == abs_y))
+	{
+		return 0.0f;
+	}
+
+	// Reduce to the first octant, so the polynomial argument is in [0, 1]:
+	if (abs_y <= abs_x)
+	{
+		angle = fast_math_atan_unit(abs_y / abs_x);
+	}
+	else
+	{
+		angle = FAST_MATH_PI_2 - fast_math_atan_unit(abs_x / abs_y);
+	}
+
+	// Back to the original quadrant:
+	if (x < 0.0f)
+	{
+		angle = FAST_MATH_PI - angle;
+	}
+	if (y < 0.0f)
+	{
+		angle = -angle;
+	}
+
+	return angle;
+}
+
+/*
+ * @brief: Square root. On the Cortex-M4F it is a single VSQRT.F32
+ *         instruction (14 cycles, correctly rounded). Negative inputs
+ *         return 0.
+ */
+float fast_math_sqrt(float x)
+{
+	float root = 0.0f;
+
+	if (x > 0.0f)
+	{
+#if defined(__ARM_FP) && (__ARM_FP & 0x4)
+		__asm volatile ("vsqrt.f32 %0, %1" : "=t" (root) : "t" (x));
+#else
+		// Builds without a single-precision FPU (host tools):
+		root = sqrtf(x);
+#endif
+	}
+
+	return root;
+}
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: Arctangent of z for z in [0, 1], evaluated in Horner form.
+ */
+static float fast_math_atan_unit(float z)
+{
+	float z2 = z * z;
+
+	return z * (ATAN_A1 + z2 * (ATAN_A3 + z2 * (ATAN_A5 + z2 * (ATAN_A7 + z2 * ATAN_A9))));
+}
@@ -7,33 +7,57 @@
 
 #include "freq.h"
 
-static void no_gpio_pit_callback(void);
+static void no_gpio_pit_callback(void * context);
+static uint32_t freq_now(void);
+static void freq_snapshot(freq_channel_t channel, uint32_t * period, uint32_t * elapsed);
+static void freq_capture_edge(freq_channel_t channel, uint32_t now);
+static void freq_history_reset(void);
+static void freq_history_add(uint32_t period);
+static void freq_log_add(uint32_t time, uint32_t spacing, freq_log_type_t type);
 
-uint8_t g_flag = 0;
-uint32_t g_pit_period = 0;
+static freq_input_t g_inputs[FREQ_CHANNELS] = {
+		{FREQ_WHEEL_PIN, FREQ_TIMEOUT,       0, 0, false, {0}},
+		{FREQ_CRANK_PIN, FREQ_CRANK_TIMEOUT, 0, 0, false, {0}}
+};
 
+// Accepted wheel edges, from port C to the main loop:
+SPSC_RING_DEFINE(g_edges, freq_edge_t, FREQ_EDGE_RING_SIZE);
+
+static freq_history_t g_history = {0};
+static soft_timer_t g_timeout_timer;
+static float g_accel = 0.0f;
+
+// Wheel events, written from port C:
+static freq_log_t g_log[FREQ_LOG_SIZE];
+static uint32_t g_log_head = 0;
+static uint32_t g_log_count = 0;
+
+/*
+ * @brief: Port C callback. Timestamps the edge of every pulse input that
+ *         triggered the interrupt.
+ */
 void capture_values(uint32_t flags)
 {
-	if(g_flag == 0)
-	{
-		PIT_StartTimer(PIT, kPIT_Chnl_3);
-		g_flag = 1;
-	}
-	else
+	uint32_t now = freq_now();
+	uint32_t i = 0;
+
+	for (i = 0; i < FREQ_CHANNELS; i++)
 	{
-		g_pit_period = USEC_TO_COUNT(5000000U,21000000U) - PIT_GetCurrentTimerCount(PIT, kPIT_Chnl_3);
-		PIT_StopTimer(PIT, kPIT_Chnl_3);
-		PIT_StartTimer(PIT, kPIT_Chnl_3);
+		if (flags & (1U << g_inputs[i].pin))
+		{
+			freq_capture_edge((freq_channel_t)i, now);
+		}
 	}
 }
 
 void init_freq(void)
 {
-	// PIT config:
-	PIT_SetTimerPeriod(PIT, kPIT_Chnl_3, USEC_TO_COUNT(5000000U,21000000U));
-	PIT_EnableInterrupts(PIT, kPIT_Chnl_3, kPIT_TimerInterruptEnable);
-	PIT_callback_init(kPIT_Chnl_3, no_gpio_pit_callback);
-	NVIC_enable_interrupt_and_priotity(PIT_CH3_IRQ, PRIORITY_4);
+	uint32_t i = 0;
+	uint32_t pin_mask = 0;
+
+	// Timeouts are checked from a software timer, which has the same
+	// priority as port C:
+	soft_timer_setup(&g_timeout_timer, no_gpio_pit_callback, NULL);
 
 	CLOCK_EnableClock(kCLOCK_PortC);
 	const port_pin_config_t input_config = {
@@ -50,29 +74,490 @@ void init_freq(void)
 			        kGPIO_DigitalInput,
 			        0
 			    };
-	PORT_SetPinConfig(PORTC, 2u, &input_config);
-	GPIO_PinInit(GPIOC, 2u, &gpio_input_config);
-	PORT_SetPinInterruptConfig(PORTC, 2u, kPORT_InterruptFallingEdge);
+
+	for (i = 0; i < FREQ_CHANNELS; i++)
+	{
+		PORT_SetPinConfig(FREQ_PORT, g_inputs[i].pin, &input_config);
+		GPIO_PinInit(FREQ_GPIO, g_inputs[i].pin, &gpio_input_config);
+		pin_mask |= (1U << g_inputs[i].pin);
+	}
+
+#if defined(FSL_FEATURE_PORT_HAS_DIGITAL_FILTER) && FSL_FEATURE_PORT_HAS_DIGITAL_FILTER
+	// Hardware filter for short spikes, the rest is done by software:
+	const port_digital_filter_config_t filter_config = {
+			FREQ_DFILTER_WIDTH,
+			kPORT_BusClock
+		  };
+	PORT_SetDigitalFilterConfig(FREQ_PORT, &filter_config);
+	PORT_EnablePinsDigitalFilter(FREQ_PORT, pin_mask, true);
+#endif
+
+	for (i = 0; i < FREQ_CHANNELS; i++)
+	{
+		PORT_SetPinInterruptConfig(FREQ_PORT, g_inputs[i].pin, kPORT_InterruptFallingEdge);
+	}
 	GPIO_callback_init(GPIO_C, capture_values);
 
-	NVIC_enable_interrupt_and_priotity(PORTC_IRQ, PRIORITY_2);
+	freq_set_max_speed(FREQ_MAX_SPEED_KMH);
+	g_inputs[FREQ_CRANK].diag.min_spacing =
+			(uint32_t)((60.0f / FREQ_MAX_CADENCE) * FREQ_COUNTS_PER_SEC);
 
+	NVIC_enable_interrupt_and_priotity(PORTC_IRQ, SOFT_TIMER_PRIORITY);
+
+	soft_timer_start(&g_timeout_timer, FREQ_CHECK_MS, FREQ_CHECK_MS);
 }
 
+/*
+ * @brief: Returns the wheel frequency in turns per second. Between edges,
+ *         the value is bounded by the time elapsed since the last edge, and
+ *         drops to 0 once FREQ_STOP_PERIODS periods have passed without one.
+ */
 float freq_get_freq(void)
 {
-	float frequency = 0.0f;
-	if (g_pit_period)
+	return freq_get_channel_freq(FREQ_WHEEL);
+}
+
+/*
+ * @brief: Same as freq_get_freq(), for any of the pulse inputs.
+ *
+ * @param: channel Pulse input to be read.
+ */
+float freq_get_channel_freq(freq_channel_t channel)
+{
+	float frequency  = 0.0f;
+	uint32_t period  = 0;
+	uint32_t elapsed = 0;
+
+	freq_snapshot(channel, &period, &elapsed);
+
+	if (period)
+	{
+		if ((elapsed > (FREQ_STOP_PERIODS * period)) ||
+			(elapsed > g_inputs[channel].timeout))
+		{
+			// No edge within several expected periods: the input stopped.
+			frequency = 0.0f;
+		}
+		else if (elapsed > period)
+		{
+			// The current turn already lasts longer than the last one, so
+			// it can't be turning faster than once per elapsed time:
+			frequency = FREQ_COUNTS_PER_SEC / elapsed;
+		}
+		else
+		{
+			frequency = FREQ_COUNTS_PER_SEC / period;
+		}
+	}
+
+	return frequency;
+}
+
+/*
+ * @brief: Returns a wheel frequency estimate in turns per second that keeps
+ *         moving between edges: the last period is extrapolated with the
+ *         acceleration trend up to the present, and bounded by the time
+ *         elapsed since the last edge.
+ */
+float freq_get_predicted_freq(void)
+{
+	float frequency  = 0.0f;
+	float bound      = 0.0f;
+	float p          = 0.0f;
+	float e          = 0.0f;
+	uint32_t period  = 0;
+	uint32_t elapsed = 0;
+
+	// A stopped wheel isn't extrapolated:
+	if (freq_get_freq() > 0.0f)
 	{
-		frequency = 10500000.0f / g_pit_period;
+		freq_snapshot(FREQ_WHEEL, &period, &elapsed);
+		p = period  / FREQ_COUNTS_PER_SEC;
+		e = elapsed / FREQ_COUNTS_PER_SEC;
+
+		// The last period's speed belongs to the middle of that turn:
+		frequency = (1.0f / p) + ((g_accel / FREQ_WHEEL_CIRC) * (e + (0.5f * p)));
+
+		// No edge since, so the wheel hasn't made a full turn yet:
+		if (elapsed)
+		{
+			bound = FREQ_COUNTS_PER_SEC / elapsed;
+			if (frequency > bound)
+			{
+				frequency = bound;
+			}
+		}
+		if (frequency < 0.0f)
+		{
+			frequency = 0.0f;
+		}
 	}
 
 	return frequency;
 }
 
-static void no_gpio_pit_callback(void)
+/*
+ * @brief: Returns the pedaling cadence in revolutions per minute.
+ */
+float freq_get_cadence(void)
+{
+	return freq_get_channel_freq(FREQ_CRANK) * 60.0f;
+}
+
+/*
+ * @brief: Returns the longitudinal acceleration in m/s^2, obtained as the
+ *         least-squares slope of the wheel speed over the last
+ *         FREQ_ACCEL_WINDOW revolutions. Returns 0 when stopped.
+ */
+float freq_get_accel(void)
+{
+	float accel = 0.0f;
+
+	if (freq_get_freq() > 0.0f)
+	{
+		accel = g_accel;
+	}
+
+	return accel;
+}
+
+/*
+ * @brief: Returns the last period of a pulse input and the time elapsed
+ *         since its last edge.
+ *
+ * @param: channel Pulse input to be read.
+ * @param: period  Where the last period is written, in seconds, 0 if the
+ *                 input is stopped.
+ * @param: age     Where the time since the last edge is written, in
+ *                 seconds.
+ */
+void freq_get_timing(freq_channel_t channel, float * period, float * age)
+{
+	uint32_t last    = 0;
+	uint32_t elapsed = 0;
+
+	freq_snapshot(channel, &last, &elapsed);
+
+	*period = last    / FREQ_COUNTS_PER_SEC;
+	*age    = elapsed / FREQ_COUNTS_PER_SEC;
+}
+
+/*
+ * @brief: Sets the minimum spacing between two accepted wheel edges,
+ *         derived from the fastest plausible speed and the wheel
+ *         circumference.
+ *
+ * @param: max_speed_kmh Fastest speed the bicycle is expected to reach.
+ */
+void freq_set_max_speed(float max_speed_kmh)
+{
+	float min_period = 0.0f;
+
+	if (max_speed_kmh > 0.0f)
+	{
+		// Time per turn at the maximum speed (km/h to m/s):
+		min_period = FREQ_WHEEL_CIRC / (max_speed_kmh / 3.6f);
+	}
+
+	g_inputs[FREQ_WHEEL].diag.min_spacing = (uint32_t)(min_period * FREQ_COUNTS_PER_SEC);
+}
+
+/*
+ * @brief: Returns the accepted and rejected edge counters of a pulse input,
+ *         along with the minimum edge spacing currently in use.
+ *
+ * @param: channel Pulse input to be read.
+ */
+freq_diag_t freq_get_diagnostics(freq_channel_t channel)
+{
+	freq_diag_t diag;
+	uint32_t primask = __get_PRIMASK();
+
+	// Copied at once, port C may be counting an edge:
+	NVIC_disable_interrupts;
+	diag = g_inputs[channel].diag;
+	__set_PRIMASK(primask);
+
+	return diag;
+}
+
+/*
+ * @brief: Clears the accepted and rejected edge counters of a pulse input.
+ *
+ * @param: channel Pulse input to be cleared.
+ */
+void freq_clear_diagnostics(freq_channel_t channel)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	NVIC_disable_interrupts;
+	g_inputs[channel].diag.accepted_edges = 0;
+	g_inputs[channel].diag.rejected_edges = 0;
+	g_inputs[channel].diag.lost_edges = 0;
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief: Takes the oldest accepted wheel edge not taken yet. Only one
+ *         consumer may call it.
+ *
+ * @param: edge Where the edge is copied.
+ *
+ * @retval: false if there is none.
+ */
+bool freq_get_edge(freq_edge_t * edge)
+{
+	return spsc_ring_pop(&g_edges, edge);
+}
+
+/*
+ * @brief: Gets a logged wheel event.
+ *
+ * @param: age   0 for the last one, 1 for the one before, etc.
+ * @param: entry Where the event is copied.
+ *
+ * @retval: false if there is no such event.
+ */
+bool freq_get_log(uint32_t age, freq_log_t * entry)
+{
+	bool found = false;
+	uint32_t primask = __get_PRIMASK();
+
+	// Port C may be writing the next one:
+	NVIC_disable_interrupts;
+	if ((age < FREQ_LOG_SIZE) && (age < g_log_count))
+	{
+		*entry = g_log[(g_log_head - 1U - age) & FREQ_LOG_MASK];
+		found = true;
+	}
+	__set_PRIMASK(primask);
+
+	return found;
+}
+
+/*
+ * @brief: Software timer callback, every FREQ_CHECK_MS. Stops the
+ *         inputs that haven't seen an edge within their timeout, so their
+ *         last edge never gets old enough for the time base to wrap.
+ */
+static void no_gpio_pit_callback(void * context)
+{
+	uint32_t now = 0;
+	uint32_t i = 0;
+
+	(void)context;
+
+	now = freq_now();
+
+	for (i = 0; i < FREQ_CHANNELS; i++)
+	{
+		if (g_inputs[i].active && ((now - g_inputs[i].last_edge) > g_inputs[i].timeout))
+		{
+			g_inputs[i].active = false;
+			g_inputs[i].period = 0;
+		}
+	}
+
+	if (!g_inputs[FREQ_WHEEL].active)
+	{
+		g_accel = 0.0f;
+	}
+}
+
+/*
+ * @brief: Low 32 bits of the system time base, in time base ticks
+ *         (TIMEBASE_TICKS_PER_SEC, wraps around).
+ */
+static uint32_t freq_now(void)
+{
+	return (uint32_t)timebase_ticks();
+}
+
+/*
+ * @brief: Reads the last period of a pulse input and the time elapsed since
+ *         its last edge, both belonging to the same capture.
+ *
+ * @param: channel Pulse input to be read.
+ * @param: period  Last period in time base ticks, 0 if stopped.
+ * @param: elapsed Time base ticks since the last edge.
+ */
+static void freq_snapshot(freq_channel_t channel, uint32_t * period, uint32_t * elapsed)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	NVIC_disable_interrupts;
+	*period  = g_inputs[channel].period;
+	*elapsed = freq_now() - g_inputs[channel].last_edge;
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief: Handles an edge of a pulse input: starts a new run of edges,
+ *         rejects it as a glitch, or measures a new period.
+ *
+ * @param: channel Pulse input that triggered.
+ * @param: now     Time base value at the edge.
+ */
+static void freq_capture_edge(freq_channel_t channel, uint32_t now)
 {
-	PIT_StopTimer(PIT, kPIT_Chnl_3);
-	g_pit_period = 0;
-	g_flag = 0;
+	freq_input_t * input = &g_inputs[channel];
+	uint32_t elapsed = now - input->last_edge;
+	freq_edge_t edge = {now, 0};
+	bool accepted = true;
+
+	if ((!input->active) || (elapsed > input->timeout))
+	{
+		// First edge after a stop, there's nothing to measure yet:
+		input->active    = true;
+		input->period    = 0;
+		input->last_edge = now;
+		input->diag.accepted_edges++;
+
+		if (FREQ_WHEEL == channel)
+		{
+			freq_history_reset();
+		}
+	}
+	else if (elapsed < input->diag.min_spacing)
+	{
+		// Edges closer than a turn at the maximum rate are bounce or EMI:
+		input->diag.rejected_edges++;
+		accepted = false;
+
+		if (FREQ_WHEEL == channel)
+		{
+			freq_log_add(now, elapsed, FREQ_LOG_REJECTED);
+		}
+	}
+	else
+	{
+		input->period    = elapsed;
+		input->last_edge = now;
+		edge.period      = elapsed;
+		input->diag.accepted_edges++;
+
+		if (FREQ_WHEEL == channel)
+		{
+			freq_history_add(elapsed);
+			freq_log_add(now, elapsed, FREQ_LOG_REVOLUTION);
+		}
+	}
+
+	if (accepted && (FREQ_WHEEL == channel) && !spsc_ring_push(&g_edges, &edge))
+	{
+		input->diag.lost_edges++;
+	}
+}
+
+/*
+ * @brief: Empties the speed history, used when a new run of edges starts.
+ */
+static void freq_history_reset(void)
+{
+	g_history.clock  = 0;
+	g_history.head   = 0;
+	g_history.n      = 0;
+	g_history.sum_t  = 0.0f;
+	g_history.sum_v  = 0.0f;
+	g_history.sum_tt = 0.0f;
+	g_history.sum_tv = 0.0f;
+	g_accel = 0.0f;
+}
+
+/*
+ * @brief: Adds the revolution that just ended to the speed history and
+ *         updates the acceleration. The sums are updated in constant time:
+ *         they are shifted to the new time origin, the oldest sample is
+ *         dropped and the new one added.
+ *
+ * @param: period Duration of the revolution, in time base ticks.
+ */
+static void freq_history_add(uint32_t period)
+{
+	freq_history_t * h = &g_history;
+	float p     = period / FREQ_COUNTS_PER_SEC;
+	float n     = 0.0f;
+	float t     = 0.0f;
+	float v     = 0.0f;
+	float denom = 0.0f;
+	uint32_t i  = 0;
+
+	// Move the origin from the previous edge to this one (t' = t - p):
+	n = (float)h->n;
+	h->sum_tt += (n * p * p) - (2.0f * p * h->sum_t);
+	h->sum_tv -= p * h->sum_v;
+	h->sum_t  -= n * p;
+	h->clock  += period;
+
+	// Drop the oldest sample once the window is full:
+	if (FREQ_ACCEL_WINDOW == h->n)
+	{
+		t = (int32_t)(h->time[h->head] - h->clock) / FREQ_COUNTS_PER_SEC;
+		v = h->speed[h->head];
+		h->sum_t  -= t;
+		h->sum_v  -= v;
+		h->sum_tt -= t * t;
+		h->sum_tv -= t * v;
+		h->n--;
+	}
+
+	// The average speed of a revolution belongs to its middle point:
+	t = -0.5f * p;
+	v = FREQ_WHEEL_CIRC / p;
+	h->time[h->head]  = h->clock - (period / 2U);
+	h->speed[h->head] = v;
+	h->sum_t  += t;
+	h->sum_v  += v;
+	h->sum_tt += t * t;
+	h->sum_tv += t * v;
+	h->n++;
+	h->head = (h->head + 1U) & FREQ_ACCEL_MASK;
+
+	// Rounding errors build up in the running sums, so they are rebuilt
+	// from the window each time it wraps around:
+	if (0U == h->head)
+	{
+		h->sum_t  = 0.0f;
+		h->sum_v  = 0.0f;
+		h->sum_tt = 0.0f;
+		h->sum_tv = 0.0f;
+		for (i = 0; i < h->n; i++)
+		{
+			t = (int32_t)(h->time[i] - h->clock) / FREQ_COUNTS_PER_SEC;
+			v = h->speed[i];
+			h->sum_t  += t;
+			h->sum_v  += v;
+			h->sum_tt += t * t;
+			h->sum_tv += t * v;
+		}
+	}
+
+	// Least-squares slope of speed over time:
+	n = (float)h->n;
+	denom = (n * h->sum_tt) - (h->sum_t * h->sum_t);
+	if ((h->n >= 3U) && (denom > 0.0f))
+	{
+		g_accel = ((n * h->sum_tv) - (h->sum_t * h->sum_v)) / denom;
+	}
+}
+
+/*
+ * @brief: Adds a wheel event to the log, overwriting the oldest one when
+ *         full.
+ *
+ * @param: time    Time base value at the edge.
+ * @param: spacing Time base ticks since the last accepted edge.
+ * @param: type    Revolution or rejected edge.
+ */
+static void freq_log_add(uint32_t time, uint32_t spacing, freq_log_type_t type)
+{
+	freq_log_t * entry = &g_log[g_log_head];
+
+	entry->time    = time;
+	entry->spacing = spacing;
+	entry->type    = type;
+	entry->accel   = (FREQ_LOG_REVOLUTION == type) ? g_accel : 0.0f;
+
+	g_log_head = (g_log_head + 1U) & FREQ_LOG_MASK;
+	g_log_count++;
 }
@@ -14,11 +14,220 @@
 #include "NVIC.h"
 #include "PIT.h"
 #include "gpio.h"
+#include "timebase.h"
+#include "soft_timer.h"
+#include "spsc_ring.h"
 
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// All pulse inputs are on port C, and share its interrupt:
+#define FREQ_PORT           PORTC
+#define FREQ_GPIO           GPIOC
+#define FREQ_WHEEL_PIN      2u
+#define FREQ_CRANK_PIN      12u
+
+// Longest wheel period, and how often channels are checked for timeouts:
+#define FREQ_TIMEOUT        (5U * TIMEBASE_TICKS_PER_SEC)
+#define FREQ_CHECK_MS       1000U
+// Time base counts per second:
+#define FREQ_COUNTS_PER_SEC ((float)TIMEBASE_TICKS_PER_SEC)
+// Expected periods without an edge after which a channel is stopped:
+#define FREQ_STOP_PERIODS   3U
+
+// Wheel circumference in meters:
+#define FREQ_WHEEL_CIRC     2.075f
+// Fastest plausible speed, used to reject edges that come too close:
+#define FREQ_MAX_SPEED_KMH  90.0f
+// Fastest plausible pedaling cadence, and slowest one before timing out:
+#define FREQ_MAX_CADENCE    200.0f
+#define FREQ_CRANK_TIMEOUT  (3U * TIMEBASE_TICKS_PER_SEC)
+
+// Revolutions in the acceleration least-squares window (power of 2):
+#define FREQ_ACCEL_WINDOW   8U
+#define FREQ_ACCEL_MASK     (FREQ_ACCEL_WINDOW - 1U)
+// Wheel edges kept for the main loop (power of 2), 1.5 s at 90 km/h:
+#define FREQ_EDGE_RING_SIZE 32U
+// PORT digital filter width in bus clock cycles (31 max, ~3 us):
+#define FREQ_DFILTER_WIDTH  31U
+// Wheel events kept for logging, revolutions and rejected edges:
+#define FREQ_LOG_SIZE       32U
+#define FREQ_LOG_MASK       (FREQ_LOG_SIZE - 1U)
+
+/*
+ * ******************************************************************
+ * Structs and enums:
+ * ******************************************************************
+ */
+
+/* Pulse inputs handled by the capture engine: */
+typedef enum {
+	FREQ_WHEEL,
+	FREQ_CRANK,
+	FREQ_CHANNELS
+} freq_channel_t;
+
+/* Edge counters for the pulse input diagnostics: */
+typedef struct {
+	uint32_t accepted_edges;
+	uint32_t rejected_edges;
+	uint32_t lost_edges;       // Accepted, but the edge ring was full.
+	uint32_t min_spacing;      // Minimum edge spacing, in time base ticks.
+} freq_diag_t;
+
+/* An accepted wheel edge, as handed to the main loop: */
+typedef struct {
+	uint32_t time;             // Time base value at the edge.
+	uint32_t period;           // Time base ticks since the previous one, 0
+	                           // for the first edge after a stop.
+} freq_edge_t;
+
+typedef enum {
+	FREQ_LOG_REVOLUTION,       // A wheel turn was measured.
+	FREQ_LOG_REJECTED          // An edge came too close to the previous one.
+} freq_log_type_t;
+
+/* A wheel event, kept for braking analysis and glitch diagnostics: */
+typedef struct {
+	uint32_t time;             // Time base value at the edge.
+	uint32_t spacing;          // Time base ticks since the last accepted edge.
+	uint32_t type;             // freq_log_type_t.
+	float accel;               // m/s^2 after this turn, 0 if rejected.
+} freq_log_t;
+
+/* Capture state of a single pulse input: */
+typedef struct {
+	uint32_t pin;
+	uint32_t timeout;          // Longest period, in time base ticks.
+	uint32_t last_edge;        // Time base value at the last edge.
+	uint32_t period;           // Last measured period, 0 if stopped.
+	bool active;               // An edge has been seen within the timeout.
+	freq_diag_t diag;
+} freq_input_t;
+
+/*
+ * Sliding window of wheel speed samples, one per revolution, along with
+ * the running sums needed for a least-squares fit of speed over time.
+ * Sample times are time base ticks (TIMEBASE_TICKS_PER_SEC, wrapping),
+ * sums use the newest edge as time origin.
+ */
+typedef struct {
+	uint32_t time[FREQ_ACCEL_WINDOW];  // Middle of each revolution.
+	float speed[FREQ_ACCEL_WINDOW];    // Average speed in m/s.
+	uint32_t clock;                    // Time of the newest edge.
+	uint32_t head;                     // Next slot to be written.
+	uint32_t n;
+	float sum_t;
+	float sum_v;
+	float sum_tt;
+	float sum_tv;
+} freq_history_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Port C callback. Timestamps the edge of every pulse input that
+ *         triggered the interrupt.
+ */
 void capture_values(uint32_t flags);
 
 void init_freq(void);
 
+/*
+ * @brief: Returns the wheel frequency in turns per second. Between edges,
+ *         the value is bounded by the time elapsed since the last edge, and
+ *         drops to 0 once FREQ_STOP_PERIODS periods have passed without one.
+ */
 float freq_get_freq(void);
 
+/*
+ * @brief: Same as freq_get_freq(), for any of the pulse inputs.
+ *
+ * @param: channel Pulse input to be read.
+ */
+float freq_get_channel_freq(freq_channel_t channel);
+
+/*
+ * @brief: Returns a wheel frequency estimate in turns per second that keeps
+ *         moving between edges: the last period is extrapolated with the
+ *         acceleration trend up to the present, and bounded by the time
+ *         elapsed since the last edge.
+ */
+float freq_get_predicted_freq(void);
+
+/*
+ * @brief: Returns the pedaling cadence in revolutions per minute.
+ */
+float freq_get_cadence(void);
+
+/*
+ * @brief: Returns the longitudinal acceleration in m/s^2, obtained as the
+ *         least-squares slope of the wheel speed over the last
+ *         FREQ_ACCEL_WINDOW revolutions. Returns 0 when stopped.
+ */
+float freq_get_accel(void);
+
+/*
+ * @brief: Returns the last period of a pulse input and the time elapsed
+ *         since its last edge.
+ *
+ * @param: channel Pulse input to be read.
+ * @param: period  Where the last period is written, in seconds, 0 if the
+ *                 input is stopped.
+ * @param: age     Where the time since the last edge is written, in
+ *                 seconds.
+ */
+void freq_get_timing(freq_channel_t channel, float * period, float * age);
+
+/*
+ * @brief: Sets the minimum spacing between two accepted wheel edges,
+ *         derived from the fastest plausible speed and the wheel
+ *         circumference.
+ *
+ * @param: max_speed_kmh Fastest speed the bicycle is expected to reach.
+ */
+void freq_set_max_speed(float max_speed_kmh);
+
+/*
+ * @brief: Returns the accepted and rejected edge counters of a pulse input,
+ *         along with the minimum edge spacing currently in use.
+ *
+ * @param: channel Pulse input to be read.
+ */
+freq_diag_t freq_get_diagnostics(freq_channel_t channel);
+
+/*
+ * @brief: Clears the accepted and rejected edge counters of a pulse input.
+ *
+ * @param: channel Pulse input to be cleared.
+ */
+void freq_clear_diagnostics(freq_channel_t channel);
+
+/*
+ * @brief: Takes the oldest accepted wheel edge not taken yet. Only one
+ *         consumer may call it.
+ *
+ * @param: edge Where the edge is copied.
+ *
+ * @retval: false if there is none.
+ */
+bool freq_get_edge(freq_edge_t * edge);
+
+/*
+ * @brief: Gets a logged wheel event.
+ *
+ * @param: age   0 for the last one, 1 for the one before, etc.
+ * @param: entry Where the event is copied.
+ *
+ * @retval: false if there is no such event.
+ */
+bool freq_get_log(uint32_t age, freq_log_t * entry);
+
 #endif /* FREQ_H_ */
@@ -10,121 +10,543 @@
 
 #include "ftm_speed.h"
 
-uint16_t g_dutyCycle = 0;
+#define CAL_POINTS(table) (sizeof(table) / sizeof(table[0]))
+
+/* Needle calibration, a higher duty cycle points to a lower speed: */
+static const ftm_speed_cal_t g_speed_cal[] = {
+		{ 0.0f, 260}, { 2.0f, 250}, { 4.0f, 240}, { 6.0f, 230},
+		{ 8.0f, 220}, {10.0f, 210}, {12.0f, 200}, {14.0f, 190},
+		{16.0f, 180}, {18.0f, 170}, {20.0f, 160}, {22.0f, 150},
+		{24.0f, 140}, {26.0f, 130}, {28.0f, 120}, {30.0f, 110},
+		{32.0f, 100}, {34.0f,  90}, {36.0f,  80}, {38.0f,  70},
+		{40.0f,  60}, {42.0f,  50}, {44.0f,  40}
+};
+
+/* Cadence (RPM) and inclination (degrees) gauges, same needle range: */
+static const ftm_speed_cal_t g_cadence_cal[] = {
+		{  0.0f, 260}, {150.0f,  40}
+};
+
+static const ftm_speed_cal_t g_inclination_cal[] = {
+		{-20.0f, 260}, { 20.0f,  40}
+};
+
+static const ftm_gauge_cfg_t g_gauges[FTM_GAUGES] = {
+		{0, PORTC, 1u, g_speed_cal,       CAL_POINTS(g_speed_cal)},
+		{3, PORTC, 4u, g_cadence_cal,     CAL_POINTS(g_cadence_cal)},
+		{5, PORTD, 5u, g_inclination_cal, CAL_POINTS(g_inclination_cal)}
+};
+
+// Target channel values, and the ones currently on the needles:
+static volatile uint16_t g_dutyCycle[FTM_GAUGES] = {0};
+static volatile uint16_t g_needle[FTM_GAUGES]    = {0};
+
+// Profile being streamed into the speed gauge:
+static uint32_t g_profile[FTM_ANIM_STEPS] = {0};
+static const uint32_t * g_anim_profile = NULL;
+static uint32_t g_anim_steps = 0;
+static volatile bool g_animating = false;
+
+// Written to FTM0->SYNC after each streamed value, to load it:
+static const uint32_t g_sync_word = FTM_SYNC_CNTMAX_MASK | FTM_SYNC_SWSYNC_MASK;
+
+static void ftm_speed_dma_init(void);
+static uint16_t ftm_speed_anim_stop(void);
 
 void ftm_speed_init(void)
 {
+	uint32_t i = 0;
+	uint32_t load_mask = 0;
+
 	/** Clock gating for the FlexTimer 0*/
-		SIM->SCGC6 |= FLEX_TIMER_0_CLOCK_GATING;
-		/**When write protection is enabled (WPDIS = 0), write protected bits cannot be written.
-		* When write protection is disabled (WPDIS = 1), write protected bits can be written.*/
-		FTM0->MODE |= FLEX_TIMER_WPDIS;
-		/**Enables the writing over all registers*/
-		FTM0->MODE &= ~FLEX_TIMER_FTMEN;
-		/**Assigning a default value for modulo register*/
-		FTM0->MOD = 0x00FF;
-		/**Selects the Edge-Aligned PWM mode mode*/
-		FTM0->CONTROLS[0].CnSC = FLEX_TIMER_MSB | FLEX_TIMER_ELSB;
-		/**Assign a duty cycle of 50%*/
-		FTM0->CONTROLS[0].CnV = 260;
-		/**Configure the times*/
-		FTM0->SC = FLEX_TIMER_CLKS_1|FLEX_TIMER_PS_128;
+	SIM->SCGC6 |= FLEX_TIMER_0_CLOCK_GATING;
+	/**When write protection is enabled (WPDIS = 0), write protected bits cannot be written.
+	* When write protection is disabled (WPDIS = 1), write protected bits can be written.*/
+	FTM0->MODE |= FLEX_TIMER_WPDIS;
+	/**Enhanced features, channel values only loaded by software trigger*/
+	FTM0->MODE |= FLEX_TIMER_FTMEN | FLEX_TIMER_PWMSYNC;
+	/**Assigning the modulo register, 12-bit duty resolution*/
+	FTM0->CNTIN = 0;
+	FTM0->MOD = FTM_SPEED_MOD;
 
-		SIM->CLKDIV1 = 0x01240000U;
+	for (i = 0; i < FTM_GAUGES; i++)
+	{
+		/**Selects the Edge-Aligned PWM mode, needles start at zero*/
+		g_dutyCycle[i] = ftm_speed_interpolate(g_gauges[i].cal, g_gauges[i].cal_points, 0.0f);
+		g_needle[i] = g_dutyCycle[i];
+		FTM0->CONTROLS[g_gauges[i].channel].CnSC = FLEX_TIMER_MSB | FLEX_TIMER_ELSB;
+		FTM0->CONTROLS[g_gauges[i].channel].CnV  = g_needle[i];
+		/**Channel values are synchronized by channel pairs*/
+		FTM0->COMBINE |= (FTM_COMBINE_SYNCEN0_MASK << (8U * (g_gauges[i].channel / 2U)));
+		load_mask |= (FLEX_TIMER_PWMLOAD_CH0 << g_gauges[i].channel);
+	}
 
-		CLOCK_EnableClock(kCLOCK_PortC);
-		PORT_SetPinMux(PORTC, 1u, kPORT_MuxAlt4);
+	/**Software compare right after each overflow, requests a DMA transfer*/
+	FTM0->CONTROLS[FTM_TRIGGER_CHNL].CnSC = FLEX_TIMER_MSA | FLEX_TIMER_CHIE | FLEX_TIMER_DMA;
+	FTM0->CONTROLS[FTM_TRIGGER_CHNL].CnV  = 0;
+	FTM0->COMBINE |= (FTM_COMBINE_SYNCEN0_MASK << (8U * (FTM_TRIGGER_CHNL / 2U)));
+	load_mask |= (FLEX_TIMER_PWMLOAD_CH0 << FTM_TRIGGER_CHNL);
+
+	/**Enhanced synchronization: a software trigger loads the channel
+	 * buffers at the next counter maximum, the end of the PWM period*/
+	FTM0->SYNCONF = FTM_SYNCONF_SYNCMODE_MASK | FTM_SYNCONF_SWWRBUF_MASK;
+	FTM0->SYNC = FTM_SYNC_CNTMAX_MASK;
+	FTM0->PWMLOAD = load_mask | FLEX_TIMER_LDOK;
+	FTM0->SYNC |= FTM_SYNC_SWSYNC_MASK;
+
+	/**Configure the times, overflow interrupt moves the needles*/
+	FTM0->SC = FLEX_TIMER_CLKS_1|FLEX_TIMER_PS_8|FLEX_TIMER_TOIE;
+
+	CLOCK_EnableClock(kCLOCK_PortC);
+	CLOCK_EnableClock(kCLOCK_PortD);
+	for (i = 0; i < FTM_GAUGES; i++)
+	{
+		PORT_SetPinMux(g_gauges[i].port, g_gauges[i].pin, kPORT_MuxAlt4);
+	}
+
+	ftm_speed_dma_init();
+
+	NVIC_enable_interrupt_and_priotity(FTM0_IRQ, PRIORITY_5);
 }
 
-void FTM0_ISR()
+/*
+ * @brief: FTM0 overflow interrupt, once per PWM period. Moves every needle
+ *         towards its target, FTM_SPEED_SLEW counts at most, and loads the
+ *         new values together.
+ */
+void FTM0_IRQHandler(void)
 {
+	uint16_t needles[FTM_GAUGES] = {0};
+	uint32_t needle = 0;
+	uint32_t target = 0;
+	bool moved = false;
+	uint32_t i = 0;
+
 	FTM0->SC &= ~FLEX_TIMER_TOF;
-	GPIOD->PDOR ^= 0xFF;
+
+	for (i = 0; i < FTM_GAUGES; i++)
+	{
+		needle = g_needle[i];
+		target = g_dutyCycle[i];
+
+		// The speed needle is driven by DMA while animating:
+		if ((FTM_GAUGE_SPEED == i) && g_animating)
+		{
+			target = needle;
+		}
+
+		if (needle < target)
+		{
+			needle = ((target - needle) > FTM_SPEED_SLEW) ? (needle + FTM_SPEED_SLEW) : target;
+		}
+		else if (needle > target)
+		{
+			needle = ((needle - target) > FTM_SPEED_SLEW) ? (needle - FTM_SPEED_SLEW) : target;
+		}
+
+		moved |= (needle != g_needle[i]);
+		needles[i] = (uint16_t)needle;
+		g_needle[i] = (uint16_t)needle;
+	}
+
+	if (moved)
+	{
+		ftm_speed_write_gauges(needles);
+	}
 }
 
+/*
+ * @brief: Moves the speed needle straight to a channel value, without slew
+ *         limit.
+ */
 void ftm_speed_chnnlVal(uint16_t channelValue)
 {
+	uint16_t needles[FTM_GAUGES] = {0};
+	uint32_t primask = 0;
+	uint32_t i = 0;
+
+	ftm_speed_anim_stop();
 
+	primask = __get_PRIMASK();
+	NVIC_disable_interrupts;
+	g_dutyCycle[FTM_GAUGE_SPEED] = channelValue;
+	g_needle[FTM_GAUGE_SPEED]    = channelValue;
+	for (i = 0; i < FTM_GAUGES; i++)
+	{
+		needles[i] = g_needle[i];
+	}
 	/**Assigns a new value for the duty cycle*/
-	FTM0->CONTROLS[0].CnV = channelValue;
-}
-
-void ftm_speed_update(uint16_t speed)
-{
-	switch (speed)
-	{
-		case 0:
-			g_dutyCycle = 260;
-		break;
-		case 2:
-			g_dutyCycle = 250;
-		break;
-		case 4:
-			g_dutyCycle = 240;
-		break;
-		case 6:
-			g_dutyCycle = 230;
-		break;
-		case 8:
-			g_dutyCycle = 220;
-		break;
-		case 10:
-			g_dutyCycle = 210;
-		break;
-		case 12:
-			g_dutyCycle = 200;
-		break;
-		case 14:
-			g_dutyCycle = 190;
-		break;
-		case 16:
-			g_dutyCycle = 180;
-		break;
-		case 18:
-			g_dutyCycle = 170;
-		break;
-		case 20:
-			g_dutyCycle = 160;
-		break;
-		case 22:
-			g_dutyCycle = 150;
-		break;
-		case 24:
-			g_dutyCycle = 140;
-		break;
-		case 26:
-			g_dutyCycle = 130;
-		break;
-		case 28:
-			g_dutyCycle = 120;
-		break;
-		case 30:
-			g_dutyCycle = 110;
-		break;
-		case 32:
-			g_dutyCycle = 100;
-		break;
-		case 34:
-			g_dutyCycle = 90;
-		break;
-		case 36:
-			g_dutyCycle = 80;
-		break;
-		case 38:
-			g_dutyCycle = 70;
-		break;
-		case 40:
-			g_dutyCycle = 60;
-		break;
-		case 42:
-			g_dutyCycle = 50;
-		break;
-		case 44:
-			g_dutyCycle = 40;
-		break;
-		default:
-			g_dutyCycle = 260;
-		break;
-	}
-	ftm_speed_chnnlVal(g_dutyCycle);
+	ftm_speed_write_gauges(needles);
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief: Sets the speed the needle must point to. The needle goes from its
+ *         current position to the new one in FTM_UPDATE_STEPS PWM periods,
+ *         streamed by DMA. It eases in and out from rest, and only out if it
+ *         was still moving, so frequent updates don't stop it each time.
+ *         Changes below FTM_SPEED_DEADBAND are ignored.
+ *
+ * @param: speed Speed in km/h.
+ */
+void ftm_speed_update(float speed)
+{
+	uint16_t to     = ftm_speed_duty(speed);
+	uint16_t target = g_dutyCycle[FTM_GAUGE_SPEED];
+	uint16_t from   = 0;
+	uint32_t change = 0;
+	bool moving     = false;
+
+	// Nothing to do if the needle is already headed there, or close to it:
+	change = (to > target) ? (uint32_t)(to - target) : (uint32_t)(target - to);
+	if (change < FTM_SPEED_DEADBAND)
+	{
+		return;
+	}
+
+	// A running animation is cut short where it is:
+	moving = g_animating;
+	from   = ftm_speed_anim_stop();
+	g_dutyCycle[FTM_GAUGE_SPEED] = to;
+
+	if (from != to)
+	{
+		if (moving)
+		{
+			ftm_speed_ease_out_profile(g_profile, FTM_UPDATE_STEPS, from, to);
+		}
+		else
+		{
+			ftm_speed_ease_profile(g_profile, FTM_UPDATE_STEPS, from, to);
+		}
+		ftm_speed_animate(g_profile, FTM_UPDATE_STEPS);
+	}
+}
+
+/*
+ * @brief: Streams a profile of channel values into the speed gauge, one
+ *         value per PWM period, by DMA. The profile must remain valid until
+ *         ftm_speed_animating() returns false.
+ *
+ * @param: profile Channel values, 32 bits each (the CnV register width).
+ * @param: steps   Number of values in the profile.
+ */
+void ftm_speed_animate(const uint32_t * profile, uint32_t steps)
+{
+	edma_transfer_config_t config = {0};
+	uint32_t primask = 0;
+
+	ftm_speed_anim_stop();
+
+	if ((NULL == profile) || (0U == steps))
+	{
+		return;
+	}
+
+	// One CnV value per request, each one followed by a synchronization:
+	config.srcAddr          = (uint32_t)profile;
+	config.destAddr         = (uint32_t)&FTM0->CONTROLS[g_gauges[FTM_GAUGE_SPEED].channel].CnV;
+	config.srcTransferSize  = kEDMA_TransferSize4Bytes;
+	config.destTransferSize = kEDMA_TransferSize4Bytes;
+	config.srcOffset        = sizeof(uint32_t);
+	config.destOffset       = 0;
+	config.minorLoopBytes   = sizeof(uint32_t);
+	config.majorLoopCounts  = steps;
+
+	EDMA_SetTransferConfig(DMA0, FTM_ANIM_DMA_CHNL, &config, NULL);
+	EDMA_SetChannelLink(DMA0, FTM_ANIM_DMA_CHNL, kEDMA_MinorLink, FTM_SYNC_DMA_CHNL);
+	EDMA_SetChannelLink(DMA0, FTM_ANIM_DMA_CHNL, kEDMA_MajorLink, FTM_SYNC_DMA_CHNL);
+	EDMA_EnableAutoStopRequest(DMA0, FTM_ANIM_DMA_CHNL, true);
+	EDMA_EnableChannelInterrupts(DMA0, FTM_ANIM_DMA_CHNL, kEDMA_MajorInterruptEnable);
+
+	primask = __get_PRIMASK();
+	NVIC_disable_interrupts;
+	EDMA_ClearChannelStatusFlags(DMA0, FTM_ANIM_DMA_CHNL, kEDMA_DoneFlag | kEDMA_InterruptFlag);
+	NVIC_ClearPendingIRQ(DMA0_IRQn);
+	g_anim_profile = profile;
+	g_anim_steps   = steps;
+	g_animating    = true;
+	EDMA_EnableChannelRequest(DMA0, FTM_ANIM_DMA_CHNL);
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief: Indicates whether a profile is still being streamed.
+ */
+bool ftm_speed_animating(void)
+{
+	return g_animating;
+}
+
+/*
+ * @brief: Sweeps the speed needle to full scale and back, as a start-up
+ *         self-test.
+ */
+void ftm_speed_self_test(void)
+{
+	uint16_t zero = ftm_speed_anim_stop();
+	uint16_t full = ftm_speed_interpolate(g_speed_cal, CAL_POINTS(g_speed_cal),
+			g_speed_cal[CAL_POINTS(g_speed_cal) - 1U].value);
+
+	ftm_speed_ease_profile(g_profile, FTM_ANIM_STEPS / 2U, zero, full);
+	ftm_speed_ease_profile(&g_profile[FTM_ANIM_STEPS / 2U], FTM_ANIM_STEPS / 2U, full, zero);
+	ftm_speed_animate(g_profile, FTM_ANIM_STEPS);
+}
+
+/*
+ * @brief: Fills a profile that eases in and out from one channel value to
+ *         another (smoothstep). The last value is always the destination.
+ *
+ * @param: profile Array where the profile is written.
+ * @param: steps   Number of values to write.
+ * @param: from    Starting channel value (not included in the profile).
+ * @param: to      Final channel value.
+ */
+void ftm_speed_ease_profile(uint32_t * profile, uint32_t steps, uint16_t from, uint16_t to)
+{
+	float delta = (float)to - (float)from;
+	float u = 0.0f;
+	uint32_t i = 0;
+
+	for (i = 0; i < steps; i++)
+	{
+		// Progress goes from 1/steps to 1, eased with 3u^2 - 2u^3:
+		u = (float)(i + 1U) / (float)steps;
+		u = u * u * (3.0f - (2.0f * u));
+		profile[i] = (uint32_t)((float)from + (delta * u) + 0.5f);
+	}
+}
+
+/*
+ * @brief: Fills a profile that starts moving and eases out from one channel
+ *         value to another (1 - (1 - u)^2). The last value is always the
+ *         destination.
+ *
+ * @param: profile Array where the profile is written.
+ * @param: steps   Number of values to write.
+ * @param: from    Starting channel value (not included in the profile).
+ * @param: to      Final channel value.
+ */
+void ftm_speed_ease_out_profile(uint32_t * profile, uint32_t steps, uint16_t from, uint16_t to)
+{
+	float delta = (float)to - (float)from;
+	float u = 0.0f;
+	uint32_t i = 0;
+
+	for (i = 0; i < steps; i++)
+	{
+		u = 1.0f - ((float)(i + 1U) / (float)steps);
+		u = 1.0f - (u * u);
+		profile[i] = (uint32_t)((float)from + (delta * u) + 0.5f);
+	}
+}
+
+/*
+ * @brief: eDMA interrupt at the end of a profile. The needle stays on the
+ *         profile's last value.
+ */
+void DMA0_IRQHandler(void)
+{
+	uint32_t flags = EDMA_GetChannelStatusFlags(DMA0, FTM_ANIM_DMA_CHNL);
+
+	EDMA_ClearChannelStatusFlags(DMA0, FTM_ANIM_DMA_CHNL, kEDMA_InterruptFlag);
+
+	// Only the end of the profile running now, DONE is cleared whenever a
+	// profile is stopped or started:
+	if (g_animating && (flags & kEDMA_DoneFlag))
+	{
+		EDMA_ClearChannelStatusFlags(DMA0, FTM_ANIM_DMA_CHNL, kEDMA_DoneFlag);
+		g_needle[FTM_GAUGE_SPEED] = (uint16_t)g_anim_profile[g_anim_steps - 1U];
+		g_animating = false;
+	}
+}
+
+/*
+ * @brief: Sets the targets of all gauges in one call. Needles move towards
+ *         them together, with the same slew limit as ftm_speed_update().
+ *
+ * @param: speed       Speed in km/h.
+ * @param: cadence     Cadence in RPM.
+ * @param: inclination Inclination in degrees.
+ */
+void ftm_speed_update_gauges(float speed, float cadence, float inclination)
+{
+	uint16_t targets[FTM_GAUGES] = {0};
+	uint32_t primask = 0;
+	uint32_t i = 0;
+
+	ftm_speed_update(speed);
+
+	targets[FTM_GAUGE_CADENCE] = ftm_speed_interpolate(g_cadence_cal,
+			CAL_POINTS(g_cadence_cal), cadence);
+	targets[FTM_GAUGE_INCLINATION] = ftm_speed_interpolate(g_inclination_cal,
+			CAL_POINTS(g_inclination_cal), inclination);
+
+	// The overflow interrupt must see all new targets, or none:
+	primask = __get_PRIMASK();
+	NVIC_disable_interrupts;
+	for (i = FTM_GAUGE_CADENCE; i < FTM_GAUGES; i++)
+	{
+		g_dutyCycle[i] = targets[i];
+	}
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief: Writes the channel values of all gauges, which take effect
+ *         together at the end of the current PWM period.
+ *
+ * @param: values One channel value per gauge, in ftm_gauge_t order.
+ */
+void ftm_speed_write_gauges(const uint16_t values[FTM_GAUGES])
+{
+	uint32_t i = 0;
+
+	// Values written here stay in the channel buffers...
+	for (i = 0; i < FTM_GAUGES; i++)
+	{
+		if ((FTM_GAUGE_SPEED == i) && g_animating)
+		{
+			continue;
+		}
+		FTM0->CONTROLS[g_gauges[i].channel].CnV = values[i];
+	}
+	// ...until the software trigger loads them all at the counter maximum:
+	FTM0->SYNC |= FTM_SYNC_SWSYNC_MASK;
+}
+
+/*
+ * @brief: Channel value for a measure, linearly interpolated between the
+ *         calibration points and clamped to the ends of the table.
+ *
+ * @param: cal    Calibration table, sorted by increasing value.
+ * @param: points Number of calibration points.
+ * @param: value  Measure to be shown.
+ */
+uint16_t ftm_speed_interpolate(const ftm_speed_cal_t * cal, uint32_t points, float value)
+{
+	const ftm_speed_cal_t * lo = &cal[0];
+	const ftm_speed_cal_t * hi = &cal[points - 1U];
+	float duty = 0.0f;
+	uint32_t i = 0;
+
+	if (value <= lo->value)
+	{
+		duty = lo->duty;
+	}
+	else if (value >= hi->value)
+	{
+		duty = hi->duty;
+	}
+	else
+	{
+		// Segment of the table containing the value:
+		for (i = 1; i < points; i++)
+		{
+			if (value < cal[i].value)
+			{
+				lo = &cal[i - 1U];
+				hi = &cal[i];
+				break;
+			}
+		}
+		duty = lo->duty + (((float)hi->duty - (float)lo->duty) *
+		       (value - lo->value) / (hi->value - lo->value));
+	}
+
+	// From calibration scale to timer counts, a full period at most:
+	duty = (duty * FTM_SPEED_FULL) / FTM_SPEED_CAL_FULL;
+	if (duty > FTM_SPEED_FULL)
+	{
+		duty = FTM_SPEED_FULL;
+	}
+
+	return (uint16_t)(duty + 0.5f);
+}
+
+/*
+ * @brief: Channel value of the speed gauge for a speed.
+ *
+ * @param: speed Speed in km/h.
+ */
+uint16_t ftm_speed_duty(float speed)
+{
+	return ftm_speed_interpolate(g_speed_cal, CAL_POINTS(g_speed_cal), speed);
+}
+
+/*
+ * @brief: eDMA setup: the animation channel is requested by the FTM0
+ *         trigger channel, and links to a second channel that writes the
+ *         synchronization trigger after every transfer.
+ */
+static void ftm_speed_dma_init(void)
+{
+	edma_config_t dma_config;
+	edma_transfer_config_t sync_config = {0};
+
+	DMAMUX_Init(DMAMUX);
+	DMAMUX_SetSource(DMAMUX, FTM_ANIM_DMA_CHNL, FTM_ANIM_DMA_SOURCE);
+	DMAMUX_EnableChannel(DMAMUX, FTM_ANIM_DMA_CHNL);
+
+	EDMA_GetDefaultConfig(&dma_config);
+	EDMA_Init(DMA0, &dma_config);
+	EDMA_ResetChannel(DMA0, FTM_ANIM_DMA_CHNL);
+	EDMA_ResetChannel(DMA0, FTM_SYNC_DMA_CHNL);
+
+	// Only started through links, the major count just keeps it reloading:
+	sync_config.srcAddr          = (uint32_t)&g_sync_word;
+	sync_config.destAddr         = (uint32_t)&FTM0->SYNC;
+	sync_config.srcTransferSize  = kEDMA_TransferSize4Bytes;
+	sync_config.destTransferSize = kEDMA_TransferSize4Bytes;
+	sync_config.srcOffset        = 0;
+	sync_config.destOffset       = 0;
+	sync_config.minorLoopBytes   = sizeof(uint32_t);
+	sync_config.majorLoopCounts  = FTM_ANIM_STEPS;
+	EDMA_SetTransferConfig(DMA0, FTM_SYNC_DMA_CHNL, &sync_config, NULL);
+
+	NVIC_enable_interrupt_and_priotity(FTM_ANIM_DMA_IRQ, PRIORITY_5);
+}
+
+/*
+ * @brief: Stops the profile being streamed, if any, and leaves the needle
+ *         where it is.
+ *
+ * @retval: Channel value currently on the speed needle.
+ */
+static uint16_t ftm_speed_anim_stop(void)
+{
+	uint32_t done = 0;
+	uint16_t needle = 0;
+	uint32_t primask = __get_PRIMASK();
+
+	NVIC_disable_interrupts;
+	if (g_animating)
+	{
+		EDMA_DisableChannelRequest(DMA0, FTM_ANIM_DMA_CHNL);
+
+		// Values already streamed, all of them if the end is pending:
+		if (EDMA_GetChannelStatusFlags(DMA0, FTM_ANIM_DMA_CHNL) & kEDMA_DoneFlag)
+		{
+			done = g_anim_steps;
+		}
+		else
+		{
+			done = g_anim_steps - EDMA_GetRemainingMajorLoopCount(DMA0, FTM_ANIM_DMA_CHNL);
+		}
+		// An end of profile interrupt may already be pending, it must not
+		// reach the next profile:
+		EDMA_ClearChannelStatusFlags(DMA0, FTM_ANIM_DMA_CHNL,
+				kEDMA_DoneFlag | kEDMA_InterruptFlag);
+		NVIC_ClearPendingIRQ(DMA0_IRQn);
+
+		if (done)
+		{
+			g_needle[FTM_GAUGE_SPEED] = (uint16_t)g_anim_profile[done - 1U];
+		}
+		g_animating = false;
+	}
+	needle = g_needle[FTM_GAUGE_SPEED];
+	__set_PRIMASK(primask);
+
+	return needle;
 }
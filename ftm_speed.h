@@ -13,8 +13,12 @@
 
 #include "fsl_ftm.h"
 #include <stdint.h>
+#include <stdbool.h>
 #include "MK64F12.h"
 #include "fsl_port.h"
+#include "fsl_edma.h"
+#include "fsl_dmamux.h"
+#include "NVIC.h"
 
 #define FLEX_TIMER_0_CLOCK_GATING 0x01000000
 
@@ -64,10 +68,154 @@
 #define  FLEX_TIMER_CHIE  0x40
 #define  FLEX_TIMER_CHF   0x80
 
+// PWM period in timer counts (MOD + 1), at 10.5 MHz / 8 gives ~320 Hz:
+#define FTM_SPEED_MOD        0x0FFFU
+#define FTM_SPEED_FULL       (FTM_SPEED_MOD + 1U)
+// Duty scale of the calibration tables (counts of a 256-count period):
+#define FTM_SPEED_CAL_FULL   256U
+// Largest needle change per PWM period, in counts:
+#define FTM_SPEED_SLEW       16U
+
+// Channel without pin, used as DMA trigger right after each overflow:
+#define FTM_TRIGGER_CHNL     7U
+// eDMA channels streaming a profile, and triggering its synchronization:
+#define FTM_ANIM_DMA_CHNL    0U
+#define FTM_SYNC_DMA_CHNL    1U
+#define FTM_ANIM_DMA_IRQ     DMA_CH0_IRQ
+#define FTM_ANIM_DMA_SOURCE  kDmaRequestMux0FTM0Channel7
+// Steps of a needle animation, one per PWM period (~800 ms):
+#define FTM_ANIM_STEPS       256U
+// Steps of a speed update, done before the next one (100 ms refresh):
+#define FTM_UPDATE_STEPS     32U
+// Smallest speed needle change that is animated, in counts (~0.1 km/h):
+#define FTM_SPEED_DEADBAND   8U
+
+/* Gauges driven by FTM0, each one on its own channel: */
+typedef enum {
+	FTM_GAUGE_SPEED,          // Channel 0, PTC1
+	FTM_GAUGE_CADENCE,        // Channel 3, PTC4
+	FTM_GAUGE_INCLINATION,    // Channel 5, PTD5
+	FTM_GAUGES
+} ftm_gauge_t;
+
+/* Calibration point: needle duty at a given measure. */
+typedef struct {
+	float value;       // Measure, in the gauge's units.
+	uint16_t duty;     // 1/FTM_SPEED_CAL_FULL of the period
+} ftm_speed_cal_t;
+
+/* Pin, channel and calibration of a gauge: */
+typedef struct {
+	uint8_t channel;
+	PORT_Type * port;
+	uint32_t pin;
+	const ftm_speed_cal_t * cal;
+	uint32_t cal_points;
+} ftm_gauge_cfg_t;
+
+/*
+ * @brief: FTM0 setup for the gauges, edge-aligned PWM with enhanced
+ *         synchronization: channel values written together are loaded
+ *         together at the end of a PWM period.
+ */
 void ftm_speed_init(void);
 
+/*
+ * @brief: Moves the speed needle straight to a channel value, without slew
+ *         limit.
+ */
 void ftm_speed_chnnlVal(uint16_t channelValue);
 
-void ftm_speed_update(uint16_t speed);
+/*
+ * @brief: Sets the speed the needle must point to. The needle goes from its
+ *         current position to the new one in FTM_UPDATE_STEPS PWM periods,
+ *         streamed by DMA. It eases in and out from rest, and only out if it
+ *         was still moving, so frequent updates don't stop it each time.
+ *         Changes below FTM_SPEED_DEADBAND are ignored.
+ *
+ * @param: speed Speed in km/h.
+ */
+void ftm_speed_update(float speed);
+
+/*
+ * @brief: Streams a profile of channel values into the speed gauge, one
+ *         value per PWM period, by DMA. The profile must remain valid until
+ *         ftm_speed_animating() returns false.
+ *
+ * @param: profile Channel values, 32 bits each (the CnV register width).
+ * @param: steps   Number of values in the profile.
+ */
+void ftm_speed_animate(const uint32_t * profile, uint32_t steps);
+
+/*
+ * @brief: Indicates whether a profile is still being streamed.
+ */
+bool ftm_speed_animating(void);
+
+/*
+ * @brief: Sweeps the speed needle to full scale and back, as a start-up
+ *         self-test.
+ */
+void ftm_speed_self_test(void);
+
+/*
+ * @brief: Fills a profile that eases in and out from one channel value to
+ *         another (smoothstep). The last value is always the destination.
+ *
+ * @param: profile Array where the profile is written.
+ * @param: steps   Number of values to write.
+ * @param: from    Starting channel value (not included in the profile).
+ * @param: to      Final channel value.
+ */
+void ftm_speed_ease_profile(uint32_t * profile, uint32_t steps, uint16_t from, uint16_t to);
+
+/*
+ * @brief: Fills a profile that starts moving and eases out from one channel
+ *         value to another (1 - (1 - u)^2). The last value is always the
+ *         destination.
+ *
+ * @param: profile Array where the profile is written.
+ * @param: steps   Number of values to write.
+ * @param: from    Starting channel value (not included in the profile).
+ * @param: to      Final channel value.
+ */
+void ftm_speed_ease_out_profile(uint32_t * profile, uint32_t steps, uint16_t from, uint16_t to);
+
+/*
+ * @brief: Sets the targets of all gauges in one call. The speed needle is
+ *         animated as in ftm_speed_update(), the others move towards their
+ *         targets FTM_SPEED_SLEW counts per PWM period at most.
+ *
+ * @param: speed       Speed in km/h.
+ * @param: cadence     Cadence in RPM.
+ * @param: inclination Inclination in degrees.
+ */
+void ftm_speed_update_gauges(float speed, float cadence, float inclination);
+
+/*
+ * @brief: Writes the channel values of all gauges, which take effect
+ *         together at the end of the current PWM period. The speed gauge is
+ *         left alone while a profile is being streamed into it.
+ *
+ * @param: values One channel value per gauge, in ftm_gauge_t order.
+ */
+void ftm_speed_write_gauges(const uint16_t values[FTM_GAUGES]);
+
+/*
+ * @brief: Channel value for a measure, linearly interpolated between the
+ *         calibration points and clamped to the ends of the table.
+ *
+ * @param: cal    Calibration table, sorted by increasing value.
+ * @param: points Number of calibration points.
+ * @param: value  Measure to be shown.
+ */
+uint16_t ftm_speed_interpolate(const ftm_speed_cal_t * cal, uint32_t points, float value);
+
+/*
+ * @brief: Channel value of the speed gauge for a speed.
+ *
+ * @param: speed Speed in km/h.
+ */
+uint16_t ftm_speed_duty(float speed);
 
 #endif /* FTM_SPEED_H_ */
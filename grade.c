@@ -0,0 +1,87 @@
+/*
+ * @file     grade.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the road grade estimator. The accelerometer
+ *           sees the longitudinal acceleration of the bicycle as a tilt of
+ *           atan(a / g), so the acceleration measured from the wheel speed
+ *           is removed before the attitude filter, and the grade is read
+ *           from the filtered gravity direction.
+ */
+
+#include "grade.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static float g_degrees = 0.0f;
+static float g_percent = 0.0f;
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Removes the longitudinal acceleration measured by the wheel
+ *         sensor from an accelerometer sample in the bicycle frame
+ *         (Y-axis forward), leaving gravity and vibration.
+ *
+ * @param: acc Accelerometer reading in the bicycle frame, in g. Corrected
+ *             in place.
+ */
+void grade_compensate(float acc[3])
+{
+	// The bicycle moves along its own Y-axis, whatever the grade:
+	acc[1] -= freq_get_accel() / GRADE_GRAVITY;
+}
+
+/*
+ * @brief: Reads the grade from the attitude filter. Called once per IMU
+ *         sample, after attitude_update().
+ */
+void grade_update(void)
+{
+	float v[3];
+	float rise = 0.0f;
+	float run = 0.0f;
+	float percent = 0.0f;
+
+	attitude_get_gravity(v);
+
+	// Forward component of gravity against the one in the vertical plane:
+	run = fast_math_sqrt(v[0] * v[0] + v[2] * v[2]);
+	g_degrees = fast_math_atan2(v[1], run) * GRADE_RAD_2_DEG;
+
+	// Rise over run, checked against the limit before dividing:
+	rise = (v[1] < 0.0f) ? -v[1] : v[1];
+	percent = GRADE_MAX_PERCENT;
+	if ((100.0f * rise) < (GRADE_MAX_PERCENT * run))
+	{
+		percent = (100.0f * rise) / run;
+	}
+	g_percent = (v[1] < 0.0f) ? -percent : percent;
+}
+
+/*
+ * @brief: Road grade in degrees, positive uphill.
+ */
+float grade_get_degrees(void)
+{
+	return g_degrees;
+}
+
+/*
+ * @brief: Road grade in percent (rise over run times 100), positive
+ *         uphill, limited to +-GRADE_MAX_PERCENT.
+ */
+float grade_get_percent(void)
+{
+	return g_percent;
+}
@@ -0,0 +1,67 @@
+/*
+ * @file     grade.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the road grade estimator. The accelerometer
+ *           sees the longitudinal acceleration of the bicycle as a tilt of
+ *           atan(a / g), so the acceleration measured from the wheel speed
+ *           is removed before the attitude filter, and the grade is read
+ *           from the filtered gravity direction.
+ */
+
+#ifndef GRADE_H_
+#define GRADE_H_
+
+#include <stdint.h>
+#include "fast_math.h"
+#include "attitude.h"
+#include "freq.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define GRADE_GRAVITY        9.80665f     // m/s^2 per g
+#define GRADE_RAD_2_DEG      57.295779f
+
+// Percent grade shown is limited to what fits the display (and any road):
+#define GRADE_MAX_PERCENT    99.9f
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Removes the longitudinal acceleration measured by the wheel
+ *         sensor from an accelerometer sample in the bicycle frame
+ *         (Y-axis forward), leaving gravity and vibration.
+ *
+ * @param: acc Accelerometer reading in the bicycle frame, in g. Corrected
+ *             in place.
+ */
+void grade_compensate(float acc[3]);
+
+/*
+ * @brief: Reads the grade from the attitude filter. Called once per IMU
+ *         sample, after attitude_update().
+ */
+void grade_update(void);
+
+/*
+ * @brief: Road grade in degrees, positive uphill.
+ */
+float grade_get_degrees(void);
+
+/*
+ * @brief: Road grade in percent (rise over run times 100), positive
+ *         uphill, limited to +-GRADE_MAX_PERCENT.
+ */
+float grade_get_percent(void);
+
+#endif /* GRADE_H_ */
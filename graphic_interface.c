@@ -543,6 +543,21 @@ uint8_t g_deg_char[CHAR_SIZE] = {
 		0,0,0,0,0,0,0,0
 };
 
+uint8_t g_minus_char[CHAR_SIZE] = {
+		0,0,0,0,0,0,0,0,
+		0,0,0,0,0,0,0,0,
+		0,0,0,1,1,0,0,0,
+		0,0,0,1,1,0,0,0,
+		0,0,0,1,1,0,0,0,
+		0,0,0,1,1,0,0,0,
+		0,0,0,1,1,0,0,0,
+		0,0,0,1,1,0,0,0,
+		0,0,0,0,0,0,0,0,
+		0,0,0,0,0,0,0,0,
+		0,0,0,0,0,0,0,0,
+		0,0,0,0,0,0,0,0
+};
+
 uint8_t g_blank_char[CHAR_SIZE] = {0};
 
 uint8_t * g_char_decode[CHAR_SIZE] = {
@@ -620,6 +635,10 @@ void GUI_write_char(uint8_t c)
 	{
 		char_array = g_deg_char;
 	}
+	else if ('-' == c)
+	{
+		char_array = g_minus_char;
+	}
 	else
 	{
 		char_array = g_blank_char;
@@ -672,10 +691,6 @@ void GUI_create_button(button_t * btn_info)
 bool GUI_button_pressed(button_t * btn_info)
 {
 	Coordinate_t pressed_spot = {0};
-	uint16_t x1_btn = btn_info->x - 24;
-	uint16_t x2_btn = btn_info->x + btn_info->w + 24;
-	uint16_t y1_btn = btn_info->y - 24;
-	uint16_t y2_btn = btn_info->y + btn_info->h + 24;
 	bool pressed = false;
 
 	if (Touch_pressed())
@@ -683,14 +698,33 @@ bool GUI_button_pressed(button_t * btn_info)
 		Touch_clear_irq_flag();
 		pressed_spot = Touch_get_coordinates();
 
-		if ((pressed_spot.x_position >= x1_btn) && (pressed_spot.x_position <= x2_btn))
+		pressed = GUI_button_hit(btn_info, pressed_spot);
+	}
+
+	return pressed;
+}
+
+
+/*
+ * @brief: Tells if a touch spot falls on a button (with the same margin as
+ *         GUI_button_pressed). Used when a screen has several buttons and
+ *         the touch is read only once.
+ */
+bool GUI_button_hit(button_t * btn_info, Coordinate_t spot)
+{
+	uint16_t x1_btn = btn_info->x - 24;
+	uint16_t x2_btn = btn_info->x + btn_info->w + 24;
+	uint16_t y1_btn = btn_info->y - 24;
+	uint16_t y2_btn = btn_info->y + btn_info->h + 24;
+	bool hit = false;
+
+	if ((spot.x_position >= x1_btn) && (spot.x_position <= x2_btn))
+	{
+		if ((spot.y_position >= y1_btn) && (spot.y_position <= y2_btn))
 		{
-			if ((pressed_spot.y_position >= y1_btn) && (pressed_spot.y_position <= y2_btn))
-			{
-				pressed = true;
-			}
+			hit = true;
 		}
 	}
 
-	return pressed;
+	return hit;
 }
@@ -92,4 +92,12 @@ void GUI_create_button(button_t * btn_info);
  */
 bool GUI_button_pressed(button_t * btn_info);
 
+
+/*
+ * @brief: Tells if a touch spot falls on a button (with the same margin as
+ *         GUI_button_pressed). Used when a screen has several buttons and
+ *         the touch is read only once.
+ */
+bool GUI_button_hit(button_t * btn_info, Coordinate_t spot);
+
 #endif /* GRAPHIC_INTERFACE_H_ */
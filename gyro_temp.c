@@ -0,0 +1,336 @@
+/*
+ * @file     gyro_temp.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the gyro temperature compensation: a table of
+ *           gyro bias against the MPU6050 die temperature, learned while
+ *           the bicycle stands still and kept in the RTC module EEPROM.
+ */
+
+#include "gyro_temp.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static gyro_temp_table_t g_table;
+static bool g_dirty = false;
+
+// Current standstill window:
+static volatile bool g_stopped = false;
+static bool g_window_valid = false;
+static uint32_t g_count = 0;
+static float g_temp_sum = 0.0f;
+static float g_mean[3];
+static float g_m2[3];
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static void gyro_temp_clear(void);
+static void gyro_temp_window_reset(void);
+static void gyro_temp_learn(float temp, const float bias[3]);
+static uint32_t gyro_temp_checksum(const gyro_temp_table_t * table);
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Loads the table from the EEPROM, or starts an empty one if none
+ *         is stored or its checksum does not match.
+ *
+ * @retval: true if a stored table was loaded.
+ */
+bool gyro_temp_load(void)
+{
+	bool loaded = false;
+	mem_data_t mem_data = {
+			(uint8_t *)(&g_table),
+			sizeof(gyro_temp_table_t), GYRO_TEMP_EEPROM_ADDR
+	};
+
+	if ((kStatus_Success == RTC_mod_read_mem(&mem_data)) &&
+		(GYRO_TEMP_MAGIC == g_table.magic) &&
+		(gyro_temp_checksum(&g_table) == g_table.checksum))
+	{
+		loaded = true;
+	}
+	else
+	{
+		gyro_temp_clear();
+	}
+	g_dirty = false;
+	gyro_temp_window_reset();
+
+	return loaded;
+}
+
+/*
+ * @brief: Writes the table to the EEPROM if it has learned something
+ *         since the last save. Blocking, the IMU must be kept off the I2C
+ *         bus meanwhile.
+ *
+ * @retval: I2C status, kStatus_Success (0) when written or not needed.
+ */
+uint32_t gyro_temp_save(void)
+{
+	uint32_t status = kStatus_Success;
+	mem_data_t mem_data = {
+			(uint8_t *)(&g_table),
+			sizeof(gyro_temp_table_t), GYRO_TEMP_EEPROM_ADDR
+	};
+
+	if (g_dirty)
+	{
+		g_table.magic = GYRO_TEMP_MAGIC;
+		g_table.checksum = gyro_temp_checksum(&g_table);
+		status = RTC_mod_write_block(&mem_data);
+		if (kStatus_Success == status)
+		{
+			g_dirty = false;
+		}
+	}
+
+	return status;
+}
+
+/*
+ * @brief: Returns true if the table changed since it was loaded or saved.
+ */
+bool gyro_temp_dirty(void)
+{
+	return g_dirty;
+}
+
+/*
+ * @brief: Converts the raw temperature register to degC.
+ */
+float gyro_temp_celsius(int16_t raw)
+{
+	return ((float)raw / GYRO_TEMP_LSB) + GYRO_TEMP_OFFSET;
+}
+
+/*
+ * @brief: Tells the learning whether the wheel is stopped. A window in
+ *         which the wheel turned is never learned.
+ */
+void gyro_temp_set_stopped(bool stopped)
+{
+	g_stopped = stopped;
+}
+
+/*
+ * @brief: Feeds one raw gyro sample. Every GYRO_TEMP_WINDOW samples, the
+ *         window mean is learned into the bin of its mean temperature if
+ *         the bicycle stood still.
+ *
+ * @param: temp Die temperature, in degC.
+ * @param: gyro Angular rates, in rad/s, without any correction.
+ */
+void gyro_temp_add_sample(float temp, const float gyro[3])
+{
+	float delta = 0.0f;
+	float limit = GYRO_TEMP_STILL_STD * GYRO_TEMP_STILL_STD * GYRO_TEMP_WINDOW;
+	uint32_t i = 0;
+
+	if (!g_stopped)
+	{
+		g_window_valid = false;
+	}
+
+	g_count++;
+	g_temp_sum += temp;
+	for (i = 0; i < 3; i++)
+	{
+		delta = gyro[i] - g_mean[i];
+		g_mean[i] += delta / g_count;
+		g_m2[i] += delta * (gyro[i] - g_mean[i]);
+	}
+
+	if (g_count < GYRO_TEMP_WINDOW)
+	{
+		return;
+	}
+
+	if (g_window_valid && (g_m2[0] < limit) && (g_m2[1] < limit) && (g_m2[2] < limit))
+	{
+		gyro_temp_learn(g_temp_sum / g_count, g_mean);
+	}
+	gyro_temp_window_reset();
+}
+
+/*
+ * @brief: Gyro bias at a temperature, interpolated between the closest
+ *         learned bins on each side, or taken from the closest one if it
+ *         is within GYRO_TEMP_MAX_EXTRAP.
+ *
+ * @param: temp Die temperature, in degC.
+ * @param: bias Where the bias (rad/s) is written.
+ *
+ * @retval: false if no learned bin is close enough.
+ */
+bool gyro_temp_get_bias(float temp, float bias[3])
+{
+	int32_t lo = -1;
+	int32_t hi = -1;
+	int32_t bin = 0;
+	float t_lo = 0.0f;
+	float t_hi = 0.0f;
+	float w = 0.0f;
+	uint32_t i = 0;
+
+	// Closest learned bins at or below, and above, the temperature:
+	for (bin = 0; bin < (int32_t)GYRO_TEMP_BINS; bin++)
+	{
+		if (g_table.weight[bin])
+		{
+			if ((GYRO_TEMP_MIN + bin * GYRO_TEMP_STEP) <= temp)
+			{
+				lo = bin;
+			}
+			else if (hi < 0)
+			{
+				hi = bin;
+			}
+		}
+	}
+
+	t_lo = GYRO_TEMP_MIN + lo * GYRO_TEMP_STEP;
+	t_hi = GYRO_TEMP_MIN + hi * GYRO_TEMP_STEP;
+
+	if ((lo >= 0) && (hi >= 0))
+	{
+		w = (temp - t_lo) / (t_hi - t_lo);
+		for (i = 0; i < 3; i++)
+		{
+			bias[i] = g_table.bias[lo][i] + w * (g_table.bias[hi][i] - g_table.bias[lo][i]);
+		}
+		return true;
+	}
+
+	// Only one side learned, held flat close to it:
+	if ((lo >= 0) && ((temp - t_lo) <= GYRO_TEMP_MAX_EXTRAP))
+	{
+		bin = lo;
+	}
+	else if ((hi >= 0) && ((t_hi - temp) <= GYRO_TEMP_MAX_EXTRAP))
+	{
+		bin = hi;
+	}
+	else
+	{
+		return false;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		bias[i] = g_table.bias[bin][i];
+	}
+
+	return true;
+}
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: Empties the table.
+ */
+static void gyro_temp_clear(void)
+{
+	uint32_t bin = 0;
+	uint32_t i = 0;
+
+	g_table.magic = 0;
+	for (bin = 0; bin < GYRO_TEMP_BINS; bin++)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			g_table.bias[bin][i] = 0.0f;
+		}
+		g_table.weight[bin] = 0;
+	}
+	g_table.checksum = 0;
+}
+
+/*
+ * @brief: Starts a new standstill window.
+ */
+static void gyro_temp_window_reset(void)
+{
+	uint32_t i = 0;
+
+	g_count = 0;
+	g_temp_sum = 0.0f;
+	for (i = 0; i < 3; i++)
+	{
+		g_mean[i] = 0.0f;
+		g_m2[i] = 0.0f;
+	}
+	g_window_valid = g_stopped;
+}
+
+/*
+ * @brief: Averages a standstill bias into the bin of its temperature.
+ *         The first GYRO_TEMP_MAX_WEIGHT windows weigh the same, later
+ *         ones are an exponential average so the bin follows ageing.
+ */
+static void gyro_temp_learn(float temp, const float bias[3])
+{
+	float position = (temp - GYRO_TEMP_MIN) / GYRO_TEMP_STEP;
+	uint32_t bin = 0;
+	uint32_t weight = 0;
+	uint32_t i = 0;
+
+	if ((position < -0.5f) || (position > (GYRO_TEMP_BINS - 0.5f)))
+	{
+		return;
+	}
+	bin = (position < 0.0f) ? 0U : (uint32_t)(position + 0.5f);
+	if (bin >= GYRO_TEMP_BINS)
+	{
+		bin = GYRO_TEMP_BINS - 1U;
+	}
+
+	weight = g_table.weight[bin];
+	if (weight < GYRO_TEMP_MAX_WEIGHT)
+	{
+		weight++;
+		g_table.weight[bin] = weight;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		g_table.bias[bin][i] += (bias[i] - g_table.bias[bin][i]) / weight;
+	}
+	g_dirty = true;
+}
+
+/*
+ * @brief: Rotating sum of the words before the checksum field.
+ */
+static uint32_t gyro_temp_checksum(const gyro_temp_table_t * table)
+{
+	const uint32_t * word = (const uint32_t *)table;
+	uint32_t words = (sizeof(gyro_temp_table_t) / sizeof(uint32_t)) - 1U;
+	uint32_t sum = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < words; i++)
+	{
+		sum = ((sum << 1) | (sum >> 31)) + word[i];
+	}
+
+	return ~sum;
+}
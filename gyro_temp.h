@@ -0,0 +1,124 @@
+/*
+ * @file     gyro_temp.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the gyro temperature compensation: a table of
+ *           gyro bias against the MPU6050 die temperature, learned while
+ *           the bicycle stands still and kept in the RTC module EEPROM.
+ */
+
+#ifndef GYRO_TEMP_H_
+#define GYRO_TEMP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "rtc_mod.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Die temperature from the raw register (datasheet): T = raw / 340 + 36.53.
+#define GYRO_TEMP_LSB          340.0f
+#define GYRO_TEMP_OFFSET       36.53f
+
+// Table bins, every 5 degC from -10 to 60 degC:
+#define GYRO_TEMP_MIN          (-10.0f)
+#define GYRO_TEMP_STEP         5.0f
+#define GYRO_TEMP_BINS         15U
+
+// Standstill windows, 1 s at 200 Hz. A window is learned if the gyro
+// spread stays below GYRO_TEMP_STILL_STD and the wheel did not turn:
+#define GYRO_TEMP_WINDOW       200U
+#define GYRO_TEMP_STILL_STD    0.01f        // rad/s
+
+// Windows averaged per bin before it becomes an exponential average:
+#define GYRO_TEMP_MAX_WEIGHT   32U
+
+// A bin further than this from the temperature is not used alone:
+#define GYRO_TEMP_MAX_EXTRAP   10.0f        // degC
+
+// Page-aligned, after the IMU calibration:
+#define GYRO_TEMP_EEPROM_ADDR  0x0200U
+#define GYRO_TEMP_MAGIC        0x47544D50U  // "GTMP"
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+/* Bias table, stored as it is in the EEPROM: */
+typedef struct{
+	uint32_t magic;
+	float bias[GYRO_TEMP_BINS][3];         // rad/s
+	uint16_t weight[GYRO_TEMP_BINS];       // Windows learned, 0 = empty.
+	uint32_t checksum;
+}gyro_temp_table_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Loads the table from the EEPROM, or starts an empty one if none
+ *         is stored or its checksum does not match.
+ *
+ * @retval: true if a stored table was loaded.
+ */
+bool gyro_temp_load(void);
+
+/*
+ * @brief: Writes the table to the EEPROM if it has learned something
+ *         since the last save. Blocking, the IMU must be kept off the I2C
+ *         bus meanwhile.
+ *
+ * @retval: I2C status, kStatus_Success (0) when written or not needed.
+ */
+uint32_t gyro_temp_save(void);
+
+/*
+ * @brief: Returns true if the table changed since it was loaded or saved.
+ */
+bool gyro_temp_dirty(void);
+
+/*
+ * @brief: Converts the raw temperature register to degC.
+ */
+float gyro_temp_celsius(int16_t raw);
+
+/*
+ * @brief: Tells the learning whether the wheel is stopped. A window in
+ *         which the wheel turned is never learned.
+ */
+void gyro_temp_set_stopped(bool stopped);
+
+/*
+ * @brief: Feeds one raw gyro sample. Every GYRO_TEMP_WINDOW samples, the
+ *         window mean is learned into the bin of its mean temperature if
+ *         the bicycle stood still.
+ *
+ * @param: temp Die temperature, in degC.
+ * @param: gyro Angular rates, in rad/s, without any correction.
+ */
+void gyro_temp_add_sample(float temp, const float gyro[3]);
+
+/*
+ * @brief: Gyro bias at a temperature, interpolated between the closest
+ *         learned bins on each side, or taken from the closest one if it
+ *         is within GYRO_TEMP_MAX_EXTRAP.
+ *
+ * @param: temp Die temperature, in degC.
+ * @param: bias Where the bias (rad/s) is written.
+ *
+ * @retval: false if no learned bin is close enough.
+ */
+bool gyro_temp_get_bias(float temp, float bias[3]);
+
+#endif /* GYRO_TEMP_H_ */
@@ -0,0 +1,193 @@
+/*
+ * @file     imu_cadence.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the pedaling cadence estimation from the frame
+ *           sway: the roll rate of the bicycle is decimated and fed to a
+ *           bank of sliding DFT bins covering the cadence range, updated
+ *           incrementally with each sample.
+ */
+
+#include <math.h>
+#include "imu_cadence.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Decimated samples in the window:
+static float g_window[IMU_CAD_WINDOW];
+static uint32_t g_head = 0;
+static uint32_t g_filled = 0;
+
+// Decimation accumulator:
+static float g_acc_sum = 0.0f;
+static uint32_t g_acc_count = 0;
+
+// Bin values and their per-sample rotation (damped):
+static float g_bin_re[IMU_CAD_BINS];
+static float g_bin_im[IMU_CAD_BINS];
+static float g_rot_re[IMU_CAD_BINS];
+static float g_rot_im[IMU_CAD_BINS];
+// Damping after a whole window, applied to the sample leaving it:
+static float g_damping_n = 0.0f;
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Builds the bin rotation factors and empties the window.
+ */
+void imu_cadence_init(void)
+{
+	float angle = 0.0f;
+	uint32_t i = 0;
+
+	for (i = 0; i < IMU_CAD_BINS; i++)
+	{
+		angle = (2.0f * FAST_MATH_PI * (IMU_CAD_FIRST_BIN + i)) / IMU_CAD_WINDOW;
+		g_rot_re[i] = IMU_CAD_DAMPING * cosf(angle);
+		g_rot_im[i] = IMU_CAD_DAMPING * sinf(angle);
+		g_bin_re[i] = 0.0f;
+		g_bin_im[i] = 0.0f;
+	}
+	g_damping_n = powf(IMU_CAD_DAMPING, IMU_CAD_WINDOW);
+
+	for (i = 0; i < IMU_CAD_WINDOW; i++)
+	{
+		g_window[i] = 0.0f;
+	}
+	g_head = 0;
+	g_filled = 0;
+	g_acc_sum = 0.0f;
+	g_acc_count = 0;
+}
+
+/*
+ * @brief: Adds one IMU sample. Every IMU_CAD_DECIMATION samples, the
+ *         average goes into the window and each bin is updated with one
+ *         complex multiply-add, so the cost per sample is fixed.
+ *
+ * @param: roll_rate Angular rate about the forward axis, in rad/s.
+ */
+void imu_cadence_add_sample(float roll_rate)
+{
+	float sample = 0.0f;
+	float delta = 0.0f;
+	float re = 0.0f;
+	float im = 0.0f;
+	uint32_t i = 0;
+
+	g_acc_sum += roll_rate;
+	g_acc_count++;
+	if (g_acc_count < IMU_CAD_DECIMATION)
+	{
+		return;
+	}
+
+	sample = g_acc_sum / IMU_CAD_DECIMATION;
+	g_acc_sum = 0.0f;
+	g_acc_count = 0;
+
+	// The new sample comes in, the one a window old goes out:
+	delta = sample - g_damping_n * g_window[g_head];
+	g_window[g_head] = sample;
+	g_head = (g_head + 1U) & IMU_CAD_WINDOW_MASK;
+	if (g_filled < IMU_CAD_WINDOW)
+	{
+		g_filled++;
+	}
+
+	// Sliding DFT: X_k = r * e^(i*2*pi*k/N) * X_k + delta, per bin.
+	for (i = 0; i < IMU_CAD_BINS; i++)
+	{
+		re = g_bin_re[i] + delta;
+		im = g_bin_im[i];
+		g_bin_re[i] = re * g_rot_re[i] - im * g_rot_im[i];
+		g_bin_im[i] = re * g_rot_im[i] + im * g_rot_re[i];
+	}
+}
+
+/*
+ * @brief: Cadence from the strongest bin, refined between its neighbours.
+ *
+ * @param: confidence Where the share of the sway energy in the peak
+ *                    (0 to 1) is written. Can be NULL.
+ *
+ * @retval: Cadence in RPM, 0 when the sway shows no clear pedaling.
+ */
+float imu_cadence_get(float * confidence)
+{
+	float power[IMU_CAD_BINS];
+	float total = 0.0f;
+	float peak_power = 0.0f;
+	float conf = 0.0f;
+	float offset = 0.0f;
+	float den = 0.0f;
+	float rpm = 0.0f;
+	uint32_t peak = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < IMU_CAD_BINS; i++)
+	{
+		power[i] = g_bin_re[i] * g_bin_re[i] + g_bin_im[i] * g_bin_im[i];
+		total += power[i];
+		if (power[i] > power[peak])
+		{
+			peak = i;
+		}
+	}
+
+	// Mean square of the sway in the band is 2 * total / N^2 (Parseval):
+	if ((g_filled < IMU_CAD_WINDOW) ||
+		((2.0f * total) < (IMU_CAD_MIN_POWER * IMU_CAD_WINDOW * IMU_CAD_WINDOW)))
+	{
+		if (confidence)
+		{
+			*confidence = 0.0f;
+		}
+		return 0.0f;
+	}
+
+	// The peak leaks into its neighbours, counted as part of it:
+	peak_power = power[peak];
+	if (peak > 0)
+	{
+		peak_power += power[peak - 1U];
+	}
+	if (peak < (IMU_CAD_BINS - 1U))
+	{
+		peak_power += power[peak + 1U];
+	}
+	conf = peak_power / total;
+
+	// Parabolic interpolation on the magnitudes around the peak:
+	if ((peak > 0) && (peak < (IMU_CAD_BINS - 1U)))
+	{
+		float a = fast_math_sqrt(power[peak - 1U]);
+		float b = fast_math_sqrt(power[peak]);
+		float c = fast_math_sqrt(power[peak + 1U]);
+
+		den = a - 2.0f * b + c;
+		if (den < 0.0f)
+		{
+			offset = 0.5f * (a - c) / den;
+		}
+	}
+
+	rpm = (IMU_CAD_FIRST_BIN + peak + offset) * (IMU_CAD_RATE / IMU_CAD_WINDOW) * 60.0f;
+
+	if (confidence)
+	{
+		*confidence = conf;
+	}
+
+	return (conf >= IMU_CAD_MIN_CONF) ? rpm : 0.0f;
+}
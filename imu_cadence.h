@@ -0,0 +1,76 @@
+/*
+ * @file     imu_cadence.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the pedaling cadence estimation from the frame
+ *           sway: the roll rate of the bicycle is decimated and fed to a
+ *           bank of sliding DFT bins covering the cadence range, updated
+ *           incrementally with each sample.
+ */
+
+#ifndef IMU_CADENCE_H_
+#define IMU_CADENCE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fast_math.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// IMU samples averaged into one, 200 Hz down to 20 Hz:
+#define IMU_CAD_DECIMATION    10U
+#define IMU_CAD_RATE          20.0f
+
+// Sliding window, 12.8 s at 20 Hz, for bins 0.078 Hz (4.7 RPM) apart:
+#define IMU_CAD_WINDOW        256U
+#define IMU_CAD_WINDOW_MASK   (IMU_CAD_WINDOW - 1U)
+
+// Bins 8 to 27: 0.63 to 2.11 Hz, 38 to 127 RPM.
+#define IMU_CAD_FIRST_BIN     8U
+#define IMU_CAD_BINS          20U
+
+// Per-sample damping of the sliding DFT, keeps rounding errors from
+// building up in single precision:
+#define IMU_CAD_DAMPING       0.9999f
+
+// Below this confidence, or this sway energy, no cadence is given:
+#define IMU_CAD_MIN_CONF      0.3f
+#define IMU_CAD_MIN_POWER     1.0e-4f     // (rad/s)^2, 0.01 rad/s RMS
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Builds the bin rotation factors and empties the window.
+ */
+void imu_cadence_init(void);
+
+/*
+ * @brief: Adds one IMU sample. Every IMU_CAD_DECIMATION samples, the
+ *         average goes into the window and each bin is updated with one
+ *         complex multiply-add, so the cost per sample is fixed.
+ *
+ * @param: roll_rate Angular rate about the forward axis, in rad/s.
+ */
+void imu_cadence_add_sample(float roll_rate);
+
+/*
+ * @brief: Cadence from the strongest bin, refined between its neighbours.
+ *
+ * @param: confidence Where the share of the sway energy in the peak
+ *                    (0 to 1) is written. Can be NULL.
+ *
+ * @retval: Cadence in RPM, 0 when the sway shows no clear pedaling.
+ */
+float imu_cadence_get(float * confidence);
+
+#endif /* IMU_CADENCE_H_ */
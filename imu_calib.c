@@ -0,0 +1,378 @@
+/*
+ * @file     imu_calib.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the IMU calibration: accelerometer and gyro
+ *           biases and the rotation from the sensor mounting to the
+ *           bicycle frame, measured at standstill and kept in the RTC
+ *           module EEPROM.
+ */
+
+#include "imu_calib.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static imu_calib_t g_calib;
+static bool g_valid = false;
+static bool g_changed = true;
+static imu_calib_state_t g_state = IMU_CALIB_IDLE;
+static bool g_auto = false;
+
+// Running mean and sum of squared deviations (Welford) of the six axes
+// being calibrated, accelerometer first:
+static uint32_t g_count = 0;
+static float g_mean[6];
+static float g_m2[6];
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static void imu_calib_defaults(void);
+static uint32_t imu_calib_checksum(const imu_calib_t * calib);
+static bool imu_calib_finish(void);
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Loads the calibration from the EEPROM, or the defaults if none
+ *         is stored or its checksum does not match.
+ *
+ * @retval: true if a stored calibration was loaded.
+ */
+bool imu_calib_load(void)
+{
+	mem_data_t mem_data = {
+			(uint8_t *)(&g_calib),
+			sizeof(imu_calib_t), IMU_CALIB_EEPROM_ADDR
+	};
+
+	g_valid = false;
+	if ((kStatus_Success == RTC_mod_read_mem(&mem_data)) &&
+		(IMU_CALIB_MAGIC == g_calib.magic) &&
+		(imu_calib_checksum(&g_calib) == g_calib.checksum))
+	{
+		g_valid = true;
+	}
+	else
+	{
+		imu_calib_defaults();
+	}
+	g_changed = true;
+
+	return g_valid;
+}
+
+/*
+ * @brief: Writes the calibration in use to the EEPROM. Blocking, the IMU
+ *         must be kept off the I2C bus meanwhile.
+ *
+ * @retval: I2C status, kStatus_Success (0) when written.
+ */
+uint32_t imu_calib_save(void)
+{
+	mem_data_t mem_data = {
+			(uint8_t *)(&g_calib),
+			sizeof(imu_calib_t), IMU_CALIB_EEPROM_ADDR
+	};
+
+	g_calib.magic = IMU_CALIB_MAGIC;
+	g_calib.checksum = imu_calib_checksum(&g_calib);
+
+	return RTC_mod_write_block(&mem_data);
+}
+
+/*
+ * @brief: Starts averaging samples. The bicycle must stand still on level
+ *         ground for IMU_CALIB_SAMPLES samples.
+ */
+void imu_calib_start(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < 6; i++)
+	{
+		g_mean[i] = 0.0f;
+		g_m2[i] = 0.0f;
+	}
+	g_count = 0;
+	g_auto = false;
+	g_state = IMU_CALIB_RUNNING;
+}
+
+/*
+ * @brief: Starts a calibration that was not asked for by the rider. Like
+ *         imu_calib_start(), but it fails unless gravity is within
+ *         IMU_CALIB_AUTO_MIN_COS of the vertical of the default mounting.
+ */
+void imu_calib_start_auto(void)
+{
+	imu_calib_start();
+	g_auto = true;
+}
+
+/*
+ * @brief: Stops a calibration in progress, keeping the previous values.
+ */
+void imu_calib_abort(void)
+{
+	if (IMU_CALIB_RUNNING == g_state)
+	{
+		g_state = IMU_CALIB_IDLE;
+	}
+}
+
+/*
+ * @brief: Feeds one sample to the calibration in progress, if any. When
+ *         the last sample arrives, the new values are computed and, if
+ *         the bike stood still, put in use.
+ *
+ * @param: acc  Accelerometer reading, in g, without any correction.
+ * @param: gyro Angular rates, in rad/s, without any correction.
+ */
+void imu_calib_add_sample(const float acc[3], const float gyro[3])
+{
+	float value = 0.0f;
+	float delta = 0.0f;
+	uint32_t i = 0;
+
+	if (IMU_CALIB_RUNNING != g_state)
+	{
+		return;
+	}
+
+	g_count++;
+	for (i = 0; i < 6; i++)
+	{
+		value = (i < 3) ? acc[i] : gyro[i - 3];
+		delta = value - g_mean[i];
+		g_mean[i] += delta / g_count;
+		g_m2[i] += delta * (value - g_mean[i]);
+	}
+
+	if (g_count >= IMU_CALIB_SAMPLES)
+	{
+		g_state = imu_calib_finish() ? IMU_CALIB_DONE : IMU_CALIB_FAILED;
+	}
+}
+
+/*
+ * @brief: Removes the accelerometer bias and rotates a sample into the
+ *         bicycle frame: Z up on level ground, X and Y the sensor axes
+ *         leveled by the shortest rotation (Y forward with the sensor
+ *         Y-axis along the frame). The gyro bias, which depends on the
+ *         temperature, must be removed before.
+ *
+ * @param: acc  Accelerometer reading, in g. Corrected in place.
+ * @param: gyro Angular rates, in rad/s, without bias. Rotated in place.
+ */
+void imu_calib_apply(float acc[3], float gyro[3])
+{
+	const float * r = g_calib.rotation;
+	float a[3];
+	float g[3];
+	uint32_t i = 0;
+
+	for (i = 0; i < 3; i++)
+	{
+		a[i] = acc[i] - g_calib.acc_bias[i];
+		g[i] = gyro[i];
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		acc[i]  = r[3 * i] * a[0] + r[3 * i + 1] * a[1] + r[3 * i + 2] * a[2];
+		gyro[i] = r[3 * i] * g[0] + r[3 * i + 1] * g[1] + r[3 * i + 2] * g[2];
+	}
+}
+
+/*
+ * @brief: Gyro bias measured by the last calibration, used when the
+ *         temperature table has nothing close to the current temperature.
+ *
+ * @param: bias Where the bias (rad/s) is written.
+ */
+void imu_calib_get_gyro_bias(float bias[3])
+{
+	bias[0] = g_calib.gyro_bias[0];
+	bias[1] = g_calib.gyro_bias[1];
+	bias[2] = g_calib.gyro_bias[2];
+}
+
+/*
+ * @brief: Returns the state of the last calibration started.
+ */
+imu_calib_state_t imu_calib_get_state(void)
+{
+	return g_state;
+}
+
+/*
+ * @brief: Sets the state back to IMU_CALIB_IDLE, once the result of a
+ *         calibration has been handled.
+ */
+void imu_calib_clear_state(void)
+{
+	if (IMU_CALIB_RUNNING != g_state)
+	{
+		g_state = IMU_CALIB_IDLE;
+	}
+}
+
+/*
+ * @brief: Returns true if the values in use come from a calibration
+ *         (stored or just done) instead of the defaults.
+ */
+bool imu_calib_is_valid(void)
+{
+	return g_valid;
+}
+
+/*
+ * @brief: Returns true once after the values in use have changed, so the
+ *         attitude filter can be restarted in the new frame.
+ */
+bool imu_calib_changed(void)
+{
+	bool changed = g_changed;
+
+	g_changed = false;
+
+	return changed;
+}
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: Values used until a calibration is stored.
+ */
+static void imu_calib_defaults(void)
+{
+	float rotation[9] = {
+			1.0f, 0.0f,               0.0f,
+			0.0f, IMU_CALIB_DEF_COS, -IMU_CALIB_DEF_SIN,
+			0.0f, IMU_CALIB_DEF_SIN,  IMU_CALIB_DEF_COS
+	};
+	uint32_t i = 0;
+
+	g_calib.magic = 0;
+	g_calib.acc_bias[0] = IMU_CALIB_DEF_ACC_X;
+	g_calib.acc_bias[1] = IMU_CALIB_DEF_ACC_Y;
+	g_calib.acc_bias[2] = IMU_CALIB_DEF_ACC_Z;
+	for (i = 0; i < 3; i++)
+	{
+		g_calib.gyro_bias[i] = 0.0f;
+	}
+	for (i = 0; i < 9; i++)
+	{
+		g_calib.rotation[i] = rotation[i];
+	}
+	g_calib.checksum = 0;
+}
+
+/*
+ * @brief: Rotating sum of the words before the checksum field.
+ */
+static uint32_t imu_calib_checksum(const imu_calib_t * calib)
+{
+	const uint32_t * word = (const uint32_t *)calib;
+	uint32_t words = (sizeof(imu_calib_t) / sizeof(uint32_t)) - 1U;
+	uint32_t sum = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < words; i++)
+	{
+		sum = ((sum << 1) | (sum >> 31)) + word[i];
+	}
+
+	return ~sum;
+}
+
+/*
+ * @brief: Turns the averages into biases and a mounting rotation, unless
+ *         the sample spread shows the bike moved.
+ *
+ * @retval: true if the new values were put in use.
+ */
+static bool imu_calib_finish(void)
+{
+	float n = (float)g_count;
+	float norm = 0.0f;
+	float gx = 0.0f;
+	float gy = 0.0f;
+	float gz = 0.0f;
+	float k = 0.0f;
+	uint32_t i = 0;
+
+	for (i = 0; i < 6; i++)
+	{
+		float limit = (i < 3) ? IMU_CALIB_ACC_STD : IMU_CALIB_GYRO_STD;
+
+		if ((g_m2[i] / n) > (limit * limit))
+		{
+			return false;
+		}
+	}
+
+	// A single position can not tell the accelerometer bias from the
+	// mounting tilt, so the stored bias is kept and only the direction of
+	// gravity is measured (the bike must be on level ground):
+	gx = g_mean[0] - g_calib.acc_bias[0];
+	gy = g_mean[1] - g_calib.acc_bias[1];
+	gz = g_mean[2] - g_calib.acc_bias[2];
+	norm = fast_math_sqrt(gx * gx + gy * gy + gz * gz);
+	if ((norm < IMU_CALIB_ACC_MIN) || (norm > IMU_CALIB_ACC_MAX))
+	{
+		return false;
+	}
+	gx /= norm;
+	gy /= norm;
+	gz /= norm;
+	if ((1.0f + gz) < IMU_CALIB_MIN_1_PLUS_C)
+	{
+		return false;
+	}
+
+	// Third row of the default rotation, the bicycle vertical as seen by
+	// a sensor mounted as expected:
+	if (g_auto && (((IMU_CALIB_DEF_SIN * gy) + (IMU_CALIB_DEF_COS * gz)) < IMU_CALIB_AUTO_MIN_COS))
+	{
+		return false;
+	}
+
+	// Shortest rotation taking gravity to +Z, R = I + K + K^2 / (1 + c),
+	// with K the cross product matrix of gravity x Z and c = gz:
+	k = 1.0f / (1.0f + gz);
+	g_calib.rotation[0] = 1.0f - gx * gx * k;
+	g_calib.rotation[1] = -gx * gy * k;
+	g_calib.rotation[2] = -gx;
+	g_calib.rotation[3] = -gx * gy * k;
+	g_calib.rotation[4] = 1.0f - gy * gy * k;
+	g_calib.rotation[5] = -gy;
+	g_calib.rotation[6] = gx;
+	g_calib.rotation[7] = gy;
+	g_calib.rotation[8] = 1.0f - (gx * gx + gy * gy) * k;
+
+	g_calib.gyro_bias[0] = g_mean[3];
+	g_calib.gyro_bias[1] = g_mean[4];
+	g_calib.gyro_bias[2] = g_mean[5];
+
+	g_valid = true;
+	g_changed = true;
+
+	return true;
+}
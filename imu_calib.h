@@ -0,0 +1,169 @@
+/*
+ * @file     imu_calib.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the IMU calibration: accelerometer and gyro
+ *           biases and the rotation from the sensor mounting to the
+ *           bicycle frame, measured at standstill and kept in the RTC
+ *           module EEPROM.
+ */
+
+#ifndef IMU_CALIB_H_
+#define IMU_CALIB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fast_math.h"
+#include "rtc_mod.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Samples averaged by a calibration, 10 s at 200 Hz:
+#define IMU_CALIB_SAMPLES      2000U
+
+// A calibration fails if the bike moved while it ran:
+#define IMU_CALIB_GYRO_STD     0.02f        // rad/s
+#define IMU_CALIB_ACC_STD      0.05f        // g
+#define IMU_CALIB_ACC_MIN      0.8f         // g
+#define IMU_CALIB_ACC_MAX      1.2f         // g
+// Gravity this close to the sensor -Z axis has no unique shortest rotation:
+#define IMU_CALIB_MIN_1_PLUS_C 0.1f
+// Automatic calibrations only accept gravity within 5 deg of the default
+// mounting, so a leaning bike or a slope is never stored as level:
+#define IMU_CALIB_AUTO_MIN_COS 0.99619470f  // cos(5 deg)
+
+// Page-aligned, after the trip records:
+#define IMU_CALIB_EEPROM_ADDR  0x0100U
+#define IMU_CALIB_MAGIC        0x494D5543U  // "IMUC"
+
+// Defaults until a calibration is stored: the accelerometer offsets
+// measured on the prototype (+350, +350, +1350 LSB at 16384 LSB/g) and a
+// 55 deg sensor tilt about the X-axis.
+#define IMU_CALIB_DEF_ACC_X    (-350.0f / 16384.0f)
+#define IMU_CALIB_DEF_ACC_Y    (-350.0f / 16384.0f)
+#define IMU_CALIB_DEF_ACC_Z    (-1350.0f / 16384.0f)
+#define IMU_CALIB_DEF_COS      0.57357644f  // cos(55 deg)
+#define IMU_CALIB_DEF_SIN      0.81915204f  // sin(55 deg)
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+/* Calibration values, stored as they are in the EEPROM: */
+typedef struct{
+	uint32_t magic;
+	float acc_bias[3];        // g, subtracted from the accelerometer.
+	float gyro_bias[3];       // rad/s, subtracted from the gyro.
+	float rotation[9];        // Sensor to bicycle frame, row major.
+	uint32_t checksum;
+}imu_calib_t;
+
+typedef enum{
+	IMU_CALIB_IDLE,
+	IMU_CALIB_RUNNING,
+	IMU_CALIB_DONE,           // New values in use, not saved yet.
+	IMU_CALIB_FAILED
+}imu_calib_state_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Loads the calibration from the EEPROM, or the defaults if none
+ *         is stored or its checksum does not match.
+ *
+ * @retval: true if a stored calibration was loaded.
+ */
+bool imu_calib_load(void);
+
+/*
+ * @brief: Writes the calibration in use to the EEPROM. Blocking, the IMU
+ *         must be kept off the I2C bus meanwhile.
+ *
+ * @retval: I2C status, kStatus_Success (0) when written.
+ */
+uint32_t imu_calib_save(void);
+
+/*
+ * @brief: Starts averaging samples. The bicycle must stand still on level
+ *         ground for IMU_CALIB_SAMPLES samples.
+ */
+void imu_calib_start(void);
+
+/*
+ * @brief: Starts a calibration that was not asked for by the rider. Like
+ *         imu_calib_start(), but it fails unless gravity is within
+ *         IMU_CALIB_AUTO_MIN_COS of the vertical of the default mounting.
+ */
+void imu_calib_start_auto(void);
+
+/*
+ * @brief: Stops a calibration in progress, keeping the previous values.
+ */
+void imu_calib_abort(void);
+
+/*
+ * @brief: Feeds one sample to the calibration in progress, if any. When
+ *         the last sample arrives, the new values are computed and, if
+ *         the bike stood still, put in use.
+ *
+ * @param: acc  Accelerometer reading, in g, without any correction.
+ * @param: gyro Angular rates, in rad/s, without any correction.
+ */
+void imu_calib_add_sample(const float acc[3], const float gyro[3]);
+
+/*
+ * @brief: Removes the accelerometer bias and rotates a sample into the
+ *         bicycle frame: Z up on level ground, X and Y the sensor axes
+ *         leveled by the shortest rotation (Y forward with the sensor
+ *         Y-axis along the frame). The gyro bias, which depends on the
+ *         temperature, must be removed before.
+ *
+ * @param: acc  Accelerometer reading, in g. Corrected in place.
+ * @param: gyro Angular rates, in rad/s, without bias. Rotated in place.
+ */
+void imu_calib_apply(float acc[3], float gyro[3]);
+
+/*
+ * @brief: Gyro bias measured by the last calibration, used when the
+ *         temperature table has nothing close to the current temperature.
+ *
+ * @param: bias Where the bias (rad/s) is written.
+ */
+void imu_calib_get_gyro_bias(float bias[3]);
+
+/*
+ * @brief: Returns the state of the last calibration started.
+ */
+imu_calib_state_t imu_calib_get_state(void);
+
+/*
+ * @brief: Sets the state back to IMU_CALIB_IDLE, once the result of a
+ *         calibration has been handled.
+ */
+void imu_calib_clear_state(void);
+
+/*
+ * @brief: Returns true if the values in use come from a calibration
+ *         (stored or just done) instead of the defaults.
+ */
+bool imu_calib_is_valid(void);
+
+/*
+ * @brief: Returns true once after the values in use have changed, so the
+ *         attitude filter can be restarted in the new frame.
+ */
+bool imu_calib_changed(void);
+
+#endif /* IMU_CALIB_H_ */
@@ -13,9 +13,8 @@ int main(void)
 {
 	bicyclye_init_modules();
 
-	while (true)
-	{
-		bicycle_update_FSM();
-	}
+	// Runs the tasks posted by the interrupts, asleep in between:
+	scheduler_run();
+
     return 0 ;
 }
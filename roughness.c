@@ -0,0 +1,446 @@
+/*
+ * @file     roughness.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the road roughness analysis: vertical
+ *           acceleration is collected in double-buffered blocks at the IMU
+ *           rate, each block goes through a windowed real FFT, and the
+ *           band energies are averaged over fixed distance intervals into
+ *           an RMS roughness index.
+ */
+
+#include <math.h>
+#include "roughness.h"
+
+#if ROUGHNESS_USE_CMSIS_DSP
+#include "arm_math.h"
+#endif
+
+#if ROUGHNESS_BENCHMARK
+#include "fsl_common.h"
+#endif
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Double buffer: one block fills while the other waits to be processed.
+static float g_block[2][ROUGH_FFT_SIZE];
+static uint32_t g_fill = 0;              // Buffer being filled.
+static uint32_t g_count = 0;             // Samples in it.
+static volatile bool g_ready[2] = {false, false};
+
+static float g_work[ROUGH_FFT_SIZE];
+static float g_window[ROUGH_FFT_SIZE];
+// Mean square of the Hann window, to undo its attenuation:
+static float g_window_power = 0.0f;
+
+#if ROUGHNESS_USE_CMSIS_DSP
+static arm_rfft_fast_instance_f32 g_rfft;
+#else
+// e^(-2*pi*i*k/(N/2)) for the complex FFT, e^(-2*pi*i*k/N) for the split:
+static float g_twiddle[ROUGH_FFT_SIZE / 2];
+static float g_split[ROUGH_FFT_SIZE];
+#endif
+
+// Band limits as FFT bins:
+static uint32_t g_band_bin[ROUGH_BANDS + 1];
+
+// Interval being accumulated, and the completed ones:
+static roughness_segment_t g_current;
+static roughness_segment_t g_history[ROUGH_HISTORY];
+static uint32_t g_history_head = 0;
+static roughness_stats_t g_stats = {0};
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static void roughness_segment_clear(roughness_segment_t * segment);
+#if !ROUGHNESS_USE_CMSIS_DSP
+static void roughness_cfft(float * data, uint32_t points);
+#endif
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Builds the window and twiddle tables and empties the buffers.
+ */
+void roughness_init(void)
+{
+	const float edges[ROUGH_BANDS + 1] = ROUGH_BAND_EDGES;
+	const float two_pi = 2.0f * FAST_MATH_PI;
+	float sum = 0.0f;
+	uint32_t i = 0;
+
+	// Hann window:
+	for (i = 0; i < ROUGH_FFT_SIZE; i++)
+	{
+		g_window[i] = 0.5f - 0.5f * cosf((two_pi * i) / ROUGH_FFT_SIZE);
+		sum += g_window[i] * g_window[i];
+	}
+	g_window_power = sum / ROUGH_FFT_SIZE;
+
+#if ROUGHNESS_USE_CMSIS_DSP
+	arm_rfft_fast_init_f32(&g_rfft, ROUGH_FFT_SIZE);
+#else
+	for (i = 0; i < (ROUGH_FFT_SIZE / 4); i++)
+	{
+		g_twiddle[2 * i]     =  cosf((two_pi * i) / (ROUGH_FFT_SIZE / 2));
+		g_twiddle[2 * i + 1] = -sinf((two_pi * i) / (ROUGH_FFT_SIZE / 2));
+	}
+	for (i = 0; i < (ROUGH_FFT_SIZE / 2); i++)
+	{
+		g_split[2 * i]     =  cosf((two_pi * i) / ROUGH_FFT_SIZE);
+		g_split[2 * i + 1] = -sinf((two_pi * i) / ROUGH_FFT_SIZE);
+	}
+#endif
+
+	for (i = 0; i <= ROUGH_BANDS; i++)
+	{
+		g_band_bin[i] = (uint32_t)((edges[i] / ROUGH_BIN_HZ) + 0.5f);
+		if (g_band_bin[i] > (ROUGH_FFT_SIZE / 2))
+		{
+			g_band_bin[i] = ROUGH_FFT_SIZE / 2;
+		}
+	}
+
+	g_fill = 0;
+	g_count = 0;
+	g_ready[0] = false;
+	g_ready[1] = false;
+	roughness_segment_clear(&g_current);
+}
+
+/*
+ * @brief: Adds a vertical acceleration sample to the block being filled.
+ *         When it is full, it is handed to roughness_process() and the
+ *         other buffer starts filling.
+ *
+ * @param: acc_z Vertical acceleration in the bicycle frame, in g.
+ */
+void roughness_add_sample(float acc_z)
+{
+	g_block[g_fill][g_count] = acc_z * ROUGH_GRAVITY;
+	g_count++;
+
+	if (g_count < ROUGH_FFT_SIZE)
+	{
+		return;
+	}
+
+	g_count = 0;
+	g_ready[g_fill] = true;
+
+	if (g_ready[g_fill ^ 1U])
+	{
+		// The other block is still waiting, this one is written again:
+		g_stats.overruns++;
+		g_ready[g_fill] = false;
+	}
+	else
+	{
+		g_fill ^= 1U;
+	}
+}
+
+/*
+ * @brief: Transforms the block waiting, if any, and adds its band energies
+ *         to the current distance interval. Meant for the main loop.
+ *
+ * @retval: true if a block was processed.
+ */
+bool roughness_process(void)
+{
+	const float * spectrum = g_work;
+	float mean = 0.0f;
+	float scale = 0.0f;
+	float power = 0.0f;
+	float total = 0.0f;
+	float meters = 0.0f;
+	uint32_t block = g_fill ^ 1U;
+	uint32_t band = 0;
+	uint32_t k = 0;
+
+	if (!g_ready[block])
+	{
+		return false;
+	}
+
+	for (k = 0; k < ROUGH_FFT_SIZE; k++)
+	{
+		mean += g_block[block][k];
+	}
+	mean /= ROUGH_FFT_SIZE;
+
+	// Without gravity and windowed:
+	for (k = 0; k < ROUGH_FFT_SIZE; k++)
+	{
+		g_work[k] = (g_block[block][k] - mean) * g_window[k];
+	}
+	g_ready[block] = false;
+
+	roughness_fft(g_work);
+	g_stats.blocks++;
+
+	// Only blocks ridden count, by the distance they covered:
+	meters = freq_get_freq() * FREQ_WHEEL_CIRC * (ROUGH_FFT_SIZE / ROUGH_SAMPLE_RATE);
+	if (meters <= 0.0f)
+	{
+		return true;
+	}
+
+	// One-sided spectrum to mean square (Parseval), window corrected:
+	scale = 2.0f / ((float)ROUGH_FFT_SIZE * ROUGH_FFT_SIZE * g_window_power);
+	for (band = 0; band < ROUGH_BANDS; band++)
+	{
+		power = 0.0f;
+		for (k = g_band_bin[band]; (k < g_band_bin[band + 1]) && (k < (ROUGH_FFT_SIZE / 2)); k++)
+		{
+			power += spectrum[2 * k] * spectrum[2 * k] + spectrum[2 * k + 1] * spectrum[2 * k + 1];
+		}
+		power *= scale;
+		g_current.band[band] += power;
+		total += power;
+	}
+	g_current.rms += total;
+	g_current.distance += meters;
+	g_current.blocks++;
+
+	if (g_current.distance >= ROUGH_INTERVAL_M)
+	{
+		// Means over the interval, RMS of the total:
+		for (band = 0; band < ROUGH_BANDS; band++)
+		{
+			g_current.band[band] /= g_current.blocks;
+		}
+		g_current.rms = fast_math_sqrt(g_current.rms / g_current.blocks);
+
+		g_history_head++;
+		g_history[g_history_head & ROUGH_HISTORY_MASK] = g_current;
+		g_stats.segments++;
+		roughness_segment_clear(&g_current);
+	}
+
+	return true;
+}
+
+/*
+ * @brief: Real FFT of ROUGH_FFT_SIZE samples, in place. Output is packed
+ *         as in CMSIS-DSP: [0] DC, [1] Nyquist, then real and imaginary
+ *         parts of bins 1 to N/2 - 1.
+ *
+ * @param: data Samples in, spectrum out.
+ */
+void roughness_fft(float * data)
+{
+#if ROUGHNESS_USE_CMSIS_DSP
+	float out[ROUGH_FFT_SIZE];
+	uint32_t i = 0;
+
+	arm_rfft_fast_f32(&g_rfft, data, out, 0);
+	for (i = 0; i < ROUGH_FFT_SIZE; i++)
+	{
+		data[i] = out[i];
+	}
+#else
+	const uint32_t half = ROUGH_FFT_SIZE / 2;
+	float ar = 0.0f;
+	float ai = 0.0f;
+	float br = 0.0f;
+	float bi = 0.0f;
+	float er = 0.0f;
+	float ei = 0.0f;
+	float odd_r = 0.0f;
+	float odd_i = 0.0f;
+	float wr = 0.0f;
+	float wi = 0.0f;
+	float dc = 0.0f;
+	uint32_t k = 0;
+
+	// Even samples as real parts, odd ones as imaginary parts:
+	roughness_cfft(data, half);
+
+	dc = data[0];
+	data[0] = dc + data[1];
+	data[1] = dc - data[1];
+
+	// Split the half-size spectrum Z into the real one X, pairing bin k
+	// with bin N/2 - k so it is done in place:
+	for (k = 1; k <= (half / 2); k++)
+	{
+		ar = data[2 * k];
+		ai = data[2 * k + 1];
+		br = data[2 * (half - k)];
+		bi = data[2 * (half - k) + 1];
+
+		// Even part (Z[k] + conj(Z[N/2-k])) / 2, odd part rotated:
+		er = 0.5f * (ar + br);
+		ei = 0.5f * (ai - bi);
+		odd_r = 0.5f * (ai + bi);
+		odd_i = -0.5f * (ar - br);
+
+		wr = g_split[2 * k];
+		wi = g_split[2 * k + 1];
+
+		data[2 * k]     = er + (odd_r * wr - odd_i * wi);
+		data[2 * k + 1] = ei + (odd_r * wi + odd_i * wr);
+
+		if (k != (half - k))
+		{
+			// X[N/2-k] = conj(E[k]) - conj(W^k * O[k]), with W^(N/2-k) = -conj(W^k):
+			data[2 * (half - k)]     = er - (odd_r * wr - odd_i * wi);
+			data[2 * (half - k) + 1] = -ei + (odd_r * wi + odd_i * wr);
+		}
+	}
+#endif
+}
+
+/*
+ * @brief: Gets a completed distance interval.
+ *
+ * @param: age     0 for the last one, 1 for the one before, etc.
+ * @param: segment Where the result is copied.
+ *
+ * @retval: false if there is no such interval yet.
+ */
+bool roughness_get_segment(uint32_t age, roughness_segment_t * segment)
+{
+	if ((age >= ROUGH_HISTORY) || (age >= g_stats.segments))
+	{
+		return false;
+	}
+
+	*segment = g_history[(g_history_head - age) & ROUGH_HISTORY_MASK];
+
+	return true;
+}
+
+/*
+ * @brief: Returns the block, overrun and interval counters.
+ */
+roughness_stats_t roughness_get_stats(void)
+{
+	return g_stats;
+}
+
+#if ROUGHNESS_BENCHMARK
+/*
+ * @brief: Core clock cycles of one roughness_fft() call, measured with the
+ *         DWT cycle counter.
+ */
+uint32_t roughness_benchmark(void)
+{
+	uint32_t start = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < ROUGH_FFT_SIZE; i++)
+	{
+		g_work[i] = g_window[i];
+	}
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	start = DWT->CYCCNT;
+	roughness_fft(g_work);
+
+	return DWT->CYCCNT - start;
+}
+#endif
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: Empties a distance interval.
+ */
+static void roughness_segment_clear(roughness_segment_t * segment)
+{
+	uint32_t band = 0;
+
+	segment->rms = 0.0f;
+	for (band = 0; band < ROUGH_BANDS; band++)
+	{
+		segment->band[band] = 0.0f;
+	}
+	segment->distance = 0.0f;
+	segment->blocks = 0;
+}
+
+#if !ROUGHNESS_USE_CMSIS_DSP
+/*
+ * @brief: In-place radix-2 complex FFT, interleaved real and imaginary
+ *         parts. Bit reversal, then log2(points) butterfly stages.
+ */
+static void roughness_cfft(float * data, uint32_t points)
+{
+	uint32_t i = 0;
+	uint32_t j = 0;
+	uint32_t bit = 0;
+	uint32_t span = 0;
+	uint32_t start = 0;
+	uint32_t k = 0;
+	uint32_t step = 0;
+	float tr = 0.0f;
+	float ti = 0.0f;
+	float wr = 0.0f;
+	float wi = 0.0f;
+
+	for (i = 1; i < points; i++)
+	{
+		bit = points >> 1;
+		while (j & bit)
+		{
+			j ^= bit;
+			bit >>= 1;
+		}
+		j |= bit;
+
+		if (i < j)
+		{
+			tr = data[2 * i];
+			ti = data[2 * i + 1];
+			data[2 * i]     = data[2 * j];
+			data[2 * i + 1] = data[2 * j + 1];
+			data[2 * j]     = tr;
+			data[2 * j + 1] = ti;
+		}
+	}
+
+	for (span = 1; span < points; span <<= 1)
+	{
+		// Twiddle index stride for this stage:
+		step = points / (2 * span);
+		for (start = 0; start < points; start += 2 * span)
+		{
+			for (k = 0; k < span; k++)
+			{
+				i = start + k;
+				j = i + span;
+				wr = g_twiddle[2 * k * step];
+				wi = g_twiddle[2 * k * step + 1];
+
+				tr = data[2 * j] * wr - data[2 * j + 1] * wi;
+				ti = data[2 * j] * wi + data[2 * j + 1] * wr;
+
+				data[2 * j]     = data[2 * i] - tr;
+				data[2 * j + 1] = data[2 * i + 1] - ti;
+				data[2 * i]     += tr;
+				data[2 * i + 1] += ti;
+			}
+		}
+	}
+}
+#endif
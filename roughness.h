@@ -0,0 +1,141 @@
+/*
+ * @file     roughness.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the road roughness analysis: vertical
+ *           acceleration is collected in double-buffered blocks at the IMU
+ *           rate, each block goes through a windowed real FFT, and the
+ *           band energies are averaged over fixed distance intervals into
+ *           an RMS roughness index.
+ */
+
+#ifndef ROUGHNESS_H_
+#define ROUGHNESS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fast_math.h"
+#include "freq.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Uses arm_rfft_fast_f32() from CMSIS-DSP when set to 1 (needs arm_math.h
+// and the CMSIS-DSP library in the build). The built-in radix-2 real FFT
+// gives the same packed output.
+#ifndef ROUGHNESS_USE_CMSIS_DSP
+#define ROUGHNESS_USE_CMSIS_DSP 0
+#endif
+
+// Builds the DWT cycle benchmark of the FFT stage when set to 1:
+#ifndef ROUGHNESS_BENCHMARK
+#define ROUGHNESS_BENCHMARK 0
+#endif
+
+// Block length (power of 2) and the rate it is sampled at: 1.28 s blocks,
+// 0.78 Hz bins up to 100 Hz.
+#define ROUGH_FFT_SIZE        256U
+#define ROUGH_FFT_LOG2        8U
+#define ROUGH_SAMPLE_RATE     200.0f
+#define ROUGH_BIN_HZ          (ROUGH_SAMPLE_RATE / ROUGH_FFT_SIZE)
+
+// Frequency bands, in Hz: body and frame motion, large defects, surface
+// texture (cobbles, gravel), and fine texture up to the Nyquist limit.
+#define ROUGH_BANDS           4U
+#define ROUGH_BAND_EDGES      {1.0f, 5.0f, 15.0f, 40.0f, 100.0f}
+
+// Distance over which one roughness value is given:
+#define ROUGH_INTERVAL_M      100.0f
+// Segments kept for logging:
+#define ROUGH_HISTORY         16U
+#define ROUGH_HISTORY_MASK    (ROUGH_HISTORY - 1U)
+
+#define ROUGH_GRAVITY         9.80665f     // m/s^2 per g
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+/* Result for one distance interval: */
+typedef struct{
+	float rms;                      // m/s^2, all bands together.
+	float band[ROUGH_BANDS];        // Mean square per band, (m/s^2)^2.
+	float distance;                 // m covered, ROUGH_INTERVAL_M or more.
+	uint32_t blocks;                // FFT blocks averaged.
+}roughness_segment_t;
+
+/* Counters: */
+typedef struct{
+	uint32_t blocks;                // Blocks transformed.
+	uint32_t overruns;              // Blocks lost, none free to fill.
+	uint32_t segments;              // Distance intervals completed.
+}roughness_stats_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Builds the window and twiddle tables and empties the buffers.
+ */
+void roughness_init(void);
+
+/*
+ * @brief: Adds a vertical acceleration sample to the block being filled.
+ *         When it is full, it is handed to roughness_process() and the
+ *         other buffer starts filling.
+ *
+ * @param: acc_z Vertical acceleration in the bicycle frame, in g.
+ */
+void roughness_add_sample(float acc_z);
+
+/*
+ * @brief: Transforms the block waiting, if any, and adds its band energies
+ *         to the current distance interval. Meant for the main loop.
+ *
+ * @retval: true if a block was processed.
+ */
+bool roughness_process(void);
+
+/*
+ * @brief: Real FFT of ROUGH_FFT_SIZE samples, in place. Output is packed
+ *         as in CMSIS-DSP: [0] DC, [1] Nyquist, then real and imaginary
+ *         parts of bins 1 to N/2 - 1.
+ *
+ * @param: data Samples in, spectrum out.
+ */
+void roughness_fft(float * data);
+
+/*
+ * @brief: Gets a completed distance interval.
+ *
+ * @param: age     0 for the last one, 1 for the one before, etc.
+ * @param: segment Where the result is copied.
+ *
+ * @retval: false if there is no such interval yet.
+ */
+bool roughness_get_segment(uint32_t age, roughness_segment_t * segment);
+
+/*
+ * @brief: Returns the block, overrun and interval counters.
+ */
+roughness_stats_t roughness_get_stats(void);
+
+#if ROUGHNESS_BENCHMARK
+/*
+ * @brief: Core clock cycles of one roughness_fft() call, measured with the
+ *         DWT cycle counter.
+ */
+uint32_t roughness_benchmark(void);
+#endif
+
+#endif /* ROUGHNESS_H_ */
@@ -101,3 +101,46 @@ uint32_t RTC_mod_read_mem(mem_data_t * data)
 	// Returns I2C status to let the user know if the transmission was correct:
 	return status;
 }
+
+
+/*
+ * @brief: Writes a block of any size to the RTC module's EEPROM, split
+ *         at page boundaries. Each page is retried while the EEPROM does
+ *         not acknowledge because it is still writing the previous one.
+ *
+ * @param: data Pointer to a memory data structure where the data to be
+ *         written, its length and its address are stored.
+ *
+ * @retval: Returns the I2C transmission status flag of the last page. On
+ *          a successful data transmission, returns kStatus_Success (0).
+ */
+uint32_t RTC_mod_write_block(mem_data_t * data)
+{
+	uint32_t status = kStatus_Success;
+	uint32_t written = 0;
+	uint32_t retries = 0;
+	mem_data_t page;
+
+	while ((written < data->size) && (kStatus_Success == status))
+	{
+		page.address    = data->address + written;
+		page.data_array = data->data_array + written;
+		// Up to the end of the current page:
+		page.size       = MEM_PAGE_SIZE - (page.address % MEM_PAGE_SIZE);
+		if (page.size > (data->size - written))
+		{
+			page.size = data->size - written;
+		}
+
+		retries = 0;
+		do
+		{
+			status = RTC_mod_write_mem(&page);
+			retries++;
+		} while ((kStatus_Success != status) && (retries < MEM_WRITE_RETRIES));
+
+		written += page.size;
+	}
+
+	return status;
+}
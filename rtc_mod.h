@@ -39,6 +39,10 @@
 #define DATE_REG_BASE_ADDR    0x04U
 #define CONTROL_REG_ADDR      0x07U
 #define SQW_FREQ              0x10U
+// EEPROM page size, writes wrap inside a page:
+#define MEM_PAGE_SIZE         32U
+// Attempts while the EEPROM is busy with its internal write cycle (~5 ms):
+#define MEM_WRITE_RETRIES     1000U
 
 #define TENS_SHIFT            4U
 #define UNITS_MASK            0xFU
@@ -107,4 +111,18 @@ uint32_t RTC_mod_write_mem(mem_data_t * data);
 uint32_t RTC_mod_read_mem(mem_data_t * data);
 
 
+/*
+ * @brief: Writes a block of any size to the RTC module's EEPROM, split
+ *         at page boundaries. Each page is retried while the EEPROM does
+ *         not acknowledge because it is still writing the previous one.
+ *
+ * @param: data Pointer to a memory data structure where the data to be
+ *         written, its length and its address are stored.
+ *
+ * @retval: Returns the I2C transmission status flag of the last page. On
+ *          a successful data transmission, returns kStatus_Success (0).
+ */
+uint32_t RTC_mod_write_block(mem_data_t * data);
+
+
 #endif /* RTC_MOD_H_ */
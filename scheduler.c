@@ -0,0 +1,210 @@
+/*
+ * @file     scheduler.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the cooperative scheduler: interrupts post
+ *           ready bits, the main loop runs the ready tasks to completion in
+ *           priority order, and the core sleeps in WFI when none is ready.
+ *           Keeps run counts and execution times per task, and the share
+ *           of time spent idle.
+ */
+
+#include "scheduler.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Bit n set while task n is waiting to run:
+static volatile uint32_t g_ready = 0;
+
+static void (*g_tasks[SCHEDULER_MAX_TASKS])(void);
+static scheduler_task_stats_t g_stats[SCHEDULER_MAX_TASKS];
+
+// Time base ticks at init and asleep since:
+static uint64_t g_start = 0;
+static uint64_t g_idle_ticks = 0;
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Removes all tasks and clears the counters. timebase_init() must
+ *         have been called.
+ */
+void scheduler_init(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < SCHEDULER_MAX_TASKS; i++)
+	{
+		g_tasks[i] = NULL;
+		g_stats[i].runs = 0;
+		g_stats[i].max_us = 0;
+		g_stats[i].total_us = 0;
+	}
+	g_ready = 0;
+	g_idle_ticks = 0;
+	g_start = timebase_ticks();
+}
+
+/*
+ * @brief: Adds a task, not ready until it is posted.
+ *
+ * @param: task    Priority of the task, 0 is the highest.
+ * @param: handler Function run each time the task is posted. It must
+ *                 return, other tasks only run in between.
+ */
+void scheduler_add_task(uint32_t task, void (*handler)(void))
+{
+	if (task < SCHEDULER_MAX_TASKS)
+	{
+		g_tasks[task] = handler;
+	}
+}
+
+/*
+ * @brief: Marks a task as ready. Safe to call from any context, several
+ *         posts before it runs make a single run.
+ */
+void scheduler_post(uint32_t task)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	if (task < SCHEDULER_MAX_TASKS)
+	{
+		NVIC_disable_interrupts;
+		g_ready |= (1U << task);
+		__set_PRIMASK(primask);
+	}
+}
+
+/*
+ * @brief: Runs the highest priority ready task, if any.
+ *
+ * @retval: false if no task was ready.
+ */
+bool scheduler_run_once(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t task = 0;
+	uint32_t elapsed = 0;
+	uint64_t start = 0;
+
+	NVIC_disable_interrupts;
+	if (0U == g_ready)
+	{
+		__set_PRIMASK(primask);
+		return false;
+	}
+	// Lowest bit set, the highest priority:
+	task = __CLZ(__RBIT(g_ready));
+	g_ready &= ~(1U << task);
+	__set_PRIMASK(primask);
+
+	if (NULL != g_tasks[task])
+	{
+		start = timebase_ticks();
+		g_tasks[task]();
+		elapsed = (uint32_t)timebase_ticks_to_us(timebase_ticks() - start);
+
+		// Readers take all counters of a task at once:
+		NVIC_disable_interrupts;
+		g_stats[task].runs++;
+		g_stats[task].total_us += elapsed;
+		if (elapsed > g_stats[task].max_us)
+		{
+			g_stats[task].max_us = elapsed;
+		}
+		__set_PRIMASK(primask);
+	}
+
+	return true;
+}
+
+/*
+ * @brief: Sleeps until an interrupt, unless a task was posted meanwhile.
+ *         The time asleep is counted as idle.
+ */
+void scheduler_idle(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint64_t start = 0;
+
+	// With interrupts masked, a post can't slip in between the check and
+	// the WFI. A pending interrupt still wakes the core up, and is serviced
+	// once they are unmasked:
+	NVIC_disable_interrupts;
+	if (0U == g_ready)
+	{
+		start = timebase_ticks();
+		__DSB();
+		__WFI();
+		g_idle_ticks += timebase_ticks() - start;
+	}
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief: Runs the tasks forever, sleeping whenever none is ready.
+ */
+void scheduler_run(void)
+{
+	while (true)
+	{
+		if (!scheduler_run_once())
+		{
+			scheduler_idle();
+		}
+	}
+}
+
+/*
+ * @brief: Returns the counters of a task, all taken at the same time. Safe
+ *         to call from any context.
+ */
+scheduler_task_stats_t scheduler_get_task_stats(uint32_t task)
+{
+	scheduler_task_stats_t stats = {0};
+	uint32_t primask = __get_PRIMASK();
+
+	if (task < SCHEDULER_MAX_TASKS)
+	{
+		NVIC_disable_interrupts;
+		stats = g_stats[task];
+		__set_PRIMASK(primask);
+	}
+
+	return stats;
+}
+
+/*
+ * @brief: Share of the time since scheduler_init() spent asleep, in %.
+ *         Safe to call from any context.
+ */
+float scheduler_get_idle_percent(void)
+{
+	uint64_t idle = 0;
+	uint64_t total = 0;
+	uint32_t primask = __get_PRIMASK();
+
+	// The 64-bit counters take two loads each:
+	NVIC_disable_interrupts;
+	idle  = g_idle_ticks;
+	total = timebase_ticks() - g_start;
+	__set_PRIMASK(primask);
+
+	if (0U == total)
+	{
+		return 0.0f;
+	}
+
+	return ((float)idle * 100.0f) / (float)total;
+}
@@ -0,0 +1,101 @@
+/*
+ * @file     scheduler.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the cooperative scheduler: interrupts post
+ *           ready bits, the main loop runs the ready tasks to completion in
+ *           priority order, and the core sleeps in WFI when none is ready.
+ *           Keeps run counts and execution times per task, and the share
+ *           of time spent idle.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "NVIC.h"
+#include "timebase.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Tasks are identified by their priority, 0 is the highest:
+#define SCHEDULER_MAX_TASKS     8U
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+/* Counters of a task: */
+typedef struct{
+	uint32_t runs;
+	uint32_t max_us;          // Longest run.
+	uint64_t total_us;        // All runs together.
+}scheduler_task_stats_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Removes all tasks and clears the counters. timebase_init() must
+ *         have been called.
+ */
+void scheduler_init(void);
+
+/*
+ * @brief: Adds a task, not ready until it is posted.
+ *
+ * @param: task    Priority of the task, 0 is the highest.
+ * @param: handler Function run each time the task is posted. It must
+ *                 return, other tasks only run in between.
+ */
+void scheduler_add_task(uint32_t task, void (*handler)(void));
+
+/*
+ * @brief: Marks a task as ready. Safe to call from any context, several
+ *         posts before it runs make a single run.
+ */
+void scheduler_post(uint32_t task);
+
+/*
+ * @brief: Runs the highest priority ready task, if any.
+ *
+ * @retval: false if no task was ready.
+ */
+bool scheduler_run_once(void);
+
+/*
+ * @brief: Sleeps until an interrupt, unless a task was posted meanwhile.
+ *         The time asleep is counted as idle.
+ */
+void scheduler_idle(void);
+
+/*
+ * @brief: Runs the tasks forever, sleeping whenever none is ready.
+ */
+void scheduler_run(void);
+
+/*
+ * @brief: Returns the counters of a task, all taken at the same time. Safe
+ *         to call from any context.
+ */
+scheduler_task_stats_t scheduler_get_task_stats(uint32_t task);
+
+/*
+ * @brief: Share of the time since scheduler_init() spent asleep, in %.
+ *         Safe to call from any context.
+ */
+float scheduler_get_idle_percent(void);
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,395 @@
+/*
+ * @file     skid.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the wheel skid and slip detection: a reference
+ *           speed is integrated from the IMU longitudinal acceleration at
+ *           the sample rate, and the distance it covers is checked against
+ *           the wheel turns. A wheel that rolls much less than the bicycle
+ *           travels is a locked brake, one that rolls much more is spinning.
+ */
+
+#include "skid.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static float g_reference = 0.0f;
+static float g_accel = 0.0f;
+
+// Distance travelled, at each sample and at the last wheel edge:
+static float g_travel[SKID_HISTORY];
+static uint32_t g_head = 0;
+static float g_total = 0.0f;
+static float g_edge_travel = 0.0f;
+static bool g_edge_valid = false;
+
+// Wheel timing at the previous sample, a change is a new edge:
+static float g_last_period = 0.0f;
+static float g_last_age = 0.0f;
+
+// Duration of the turn checked before the last one, 0 if unknown:
+static float g_turn_period = 0.0f;
+
+// Event in progress, SKID_NONE if there is none:
+static skid_event_t g_event;
+static skid_type_t g_active = SKID_NONE;
+
+// Alert of the last event, held until this sample time:
+static skid_type_t g_alert = SKID_NONE;
+static uint32_t g_alert_until = 0;
+static uint32_t g_now = 0;
+static float g_dt = 0.005f;
+
+static skid_event_t g_log[SKID_LOG_SIZE];
+static uint32_t g_log_head = 0;
+static uint32_t g_log_count = 0;
+static skid_stats_t g_stats = {0};
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static void skid_turn(uint32_t timestamp, float travel, float period, float age);
+static void skid_start(uint32_t timestamp, skid_type_t type, float slip, float latency);
+static void skid_end(uint32_t timestamp);
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Clears the reference speed, the current event and the log.
+ */
+void skid_init(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < SKID_HISTORY; i++)
+	{
+		g_travel[i] = 0.0f;
+	}
+	g_head = 0;
+	g_total = 0.0f;
+	g_edge_valid = false;
+	g_last_period = 0.0f;
+	g_last_age = 0.0f;
+	g_turn_period = 0.0f;
+
+	g_reference = 0.0f;
+	g_accel = 0.0f;
+	g_active = SKID_NONE;
+	g_alert = SKID_NONE;
+	g_alert_until = 0;
+	g_log_head = 0;
+	g_log_count = 0;
+	g_stats.locks = 0;
+	g_stats.spins = 0;
+	g_stats.max_latency = 0;
+}
+
+/*
+ * @brief: Integrates one IMU sample into the reference speed and the
+ *         travelled distance.
+ *
+ * @param: timestamp Sample time, in ms.
+ * @param: accel     Longitudinal acceleration of the bicycle, gravity
+ *                   removed, in m/s^2.
+ * @param: dt        Time since the previous sample, in s.
+ */
+void skid_add_sample(uint32_t timestamp, float accel, float dt)
+{
+	uint32_t i = 0;
+
+	g_now = timestamp;
+	g_dt = dt;
+
+	g_reference += accel * dt;
+	g_accel += (accel - g_accel) * (dt / SKID_DECEL_TAU);
+	if (g_reference < 0.0f)
+	{
+		g_reference = 0.0f;
+	}
+
+	g_total += g_reference * dt;
+	g_travel[g_head] = g_total;
+	g_head = (g_head + 1U) & SKID_HISTORY_MASK;
+	if (g_total > SKID_REBASE_M)
+	{
+		for (i = 0; i < SKID_HISTORY; i++)
+		{
+			g_travel[i] -= SKID_REBASE_M;
+		}
+		g_total -= SKID_REBASE_M;
+		g_edge_travel -= SKID_REBASE_M;
+	}
+}
+
+/*
+ * @brief: Checks the distance travelled against the wheel turns, up to the
+ *         last sample added. Called right after each batch of samples, so
+ *         the wheel timing read now belongs to the same moment.
+ */
+void skid_check(void)
+{
+	float period = 0.0f;
+	float age = 0.0f;
+	float since = 0.0f;
+	uint32_t back = 0;
+	bool edge = false;
+
+	freq_get_timing(FREQ_WHEEL, &period, &age);
+
+	if (SKID_NONE == g_active)
+	{
+		if (0.0f == period)
+		{
+			// Stopped wheel and no skid: the bicycle is stopped.
+			g_reference = 0.0f;
+		}
+		else if (0.0f == g_last_period)
+		{
+			// First turn measured after a stop, the speed so far is unknown:
+			g_reference = FREQ_WHEEL_CIRC / period;
+		}
+	}
+
+	// An edge came since the last check: compare the turn that ended with
+	// the distance travelled meanwhile.
+	edge = (0.0f != period) && ((period != g_last_period) || (age < g_last_age));
+	g_last_period = period;
+	g_last_age = age;
+	if (0.0f == period)
+	{
+		g_edge_valid = false;
+		g_turn_period = 0.0f;
+	}
+	else if (edge)
+	{
+		back = (uint32_t)((age / g_dt) + 0.5f);
+		if (back < SKID_HISTORY)
+		{
+			since = g_travel[(g_head - 1U - back) & SKID_HISTORY_MASK];
+			if (g_edge_valid)
+			{
+				skid_turn(g_now, since - g_edge_travel, period, age);
+			}
+			g_edge_travel = since;
+			g_edge_valid = true;
+		}
+		else
+		{
+			g_edge_valid = false;
+		}
+	}
+
+	// Locked wheel: no edge while the bicycle travels well over a turn,
+	// and slows down as it does under braking.
+	since = g_total - g_edge_travel;
+	if (g_edge_valid && ((since * (1.0f - SKID_LOCK_SLIP)) > FREQ_WHEEL_CIRC))
+	{
+		if ((SKID_NONE == g_active) && (g_reference >= SKID_MIN_SPEED) &&
+			(g_accel <= -SKID_LOCK_DECEL))
+		{
+			skid_start(g_now, SKID_LOCK, (FREQ_WHEEL_CIRC / since) - 1.0f, age);
+		}
+		else if (SKID_LOCK == g_active)
+		{
+			g_event.slip = (FREQ_WHEEL_CIRC / since) - 1.0f;
+		}
+	}
+
+	if (((SKID_LOCK == g_active) && (g_reference < SKID_MIN_SPEED)) ||
+		((SKID_NONE != g_active) && ((g_now - g_event.timestamp) > SKID_MAX_MS)))
+	{
+		// Stopped while skidding, or the IMU has been on its own for too
+		// long: back to the wheel speed.
+		skid_end(g_now);
+		g_reference = (0.0f != period) ? (FREQ_WHEEL_CIRC / period) : 0.0f;
+	}
+}
+
+/*
+ * @brief: Type of the event in progress, or of the last one while its
+ *         alert is held. SKID_NONE otherwise.
+ */
+skid_type_t skid_get_alert(void)
+{
+	if (SKID_NONE != g_active)
+	{
+		return g_active;
+	}
+	if ((int32_t)(g_alert_until - g_now) > 0)
+	{
+		return g_alert;
+	}
+
+	return SKID_NONE;
+}
+
+/*
+ * @brief: Speed of the bicycle integrated from the IMU, in m/s.
+ */
+float skid_get_reference(void)
+{
+	return g_reference;
+}
+
+/*
+ * @brief: Gets a finished event.
+ *
+ * @param: age   0 for the last one, 1 for the one before, etc.
+ * @param: event Where the event is copied.
+ *
+ * @retval: false if there is no such event.
+ */
+bool skid_get_event(uint32_t age, skid_event_t * event)
+{
+	if ((age >= SKID_LOG_SIZE) || (age >= g_log_count))
+	{
+		return false;
+	}
+
+	*event = g_log[(g_log_head - 1U - age) & SKID_LOG_MASK];
+
+	return true;
+}
+
+/*
+ * @brief: Returns the event counters and the worst latency.
+ */
+skid_stats_t skid_get_stats(void)
+{
+	return g_stats;
+}
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: Checks a whole wheel turn against the distance travelled during
+ *         it. Turns without slip correct the reference speed.
+ *
+ * @param: timestamp Sample time, in ms.
+ * @param: travel    Distance travelled by the bicycle during the turn, m.
+ * @param: period    Duration of the turn, s.
+ * @param: age       Time since the edge that ended it, s.
+ */
+static void skid_turn(uint32_t timestamp, float travel, float period, float age)
+{
+	bool spinning = (FREQ_WHEEL_CIRC > (travel * (1.0f + SKID_SPIN_SLIP)));
+	bool locking = ((travel * (1.0f - SKID_LOCK_SLIP)) > FREQ_WHEEL_CIRC);
+	float slip = (travel > 0.0f) ? ((FREQ_WHEEL_CIRC / travel) - 1.0f) : SKID_SPIN_SLIP;
+	float before = g_turn_period;
+
+	g_turn_period = period;
+
+	switch (g_active)
+	{
+		case SKID_NONE:
+			// A spin needs the wheel turning fast, the bicycle may not be.
+			// It may have started within the turn before, too short of
+			// slip to be flagged on its own:
+			if (spinning && ((FREQ_WHEEL_CIRC / period) >= SKID_MIN_SPEED))
+			{
+				skid_start(timestamp, SKID_SPIN, slip, before + period + age);
+				return;
+			}
+		break;
+
+		case SKID_LOCK:
+			if (locking)
+			{
+				if (slip < g_event.slip)
+				{
+					g_event.slip = slip;
+				}
+				return;
+			}
+			skid_end(timestamp);
+		break;
+
+		case SKID_SPIN:
+			if (spinning)
+			{
+				if (slip > g_event.slip)
+				{
+					g_event.slip = slip;
+				}
+				return;
+			}
+			skid_end(timestamp);
+		break;
+
+		default:
+		break;
+	}
+
+	// The wheel rolled with the bicycle: its mean speed over the turn is
+	// the better one.
+	if (!spinning && !locking)
+	{
+		g_reference += ((FREQ_WHEEL_CIRC - travel) / period) * SKID_TRACK_GAIN;
+	}
+}
+
+/*
+ * @brief: Flags an event.
+ *
+ * @param: timestamp Sample time, in ms.
+ * @param: type      Lock-up or spin.
+ * @param: slip      Wheel turn against travel, minus 1.
+ * @param: latency   Time since the last edge at which the wheel still
+ *                   rolled with the bicycle, s.
+ */
+static void skid_start(uint32_t timestamp, skid_type_t type, float slip, float latency)
+{
+	g_event.timestamp = timestamp;
+	g_event.duration = 0;
+	g_event.latency = (uint32_t)(latency * 1000.0f);
+	g_event.type = type;
+	g_event.speed = g_reference;
+	g_event.slip = slip;
+
+	if (g_event.latency > g_stats.max_latency)
+	{
+		g_stats.max_latency = g_event.latency;
+	}
+	if (SKID_LOCK == type)
+	{
+		g_stats.locks++;
+	}
+	else
+	{
+		g_stats.spins++;
+	}
+
+	g_active = type;
+}
+
+/*
+ * @brief: Logs the event in progress and holds its alert.
+ */
+static void skid_end(uint32_t timestamp)
+{
+	g_event.duration = timestamp - g_event.timestamp;
+
+	g_log[g_log_head] = g_event;
+	g_log_head = (g_log_head + 1U) & SKID_LOG_MASK;
+	g_log_count++;
+
+	g_alert = g_active;
+	g_alert_until = timestamp + SKID_ALERT_MS;
+
+	g_active = SKID_NONE;
+}
@@ -0,0 +1,145 @@
+/*
+ * @file     skid.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the wheel skid and slip detection: a reference
+ *           speed is integrated from the IMU longitudinal acceleration at
+ *           the sample rate, and the distance it covers is checked against
+ *           the wheel turns. A wheel that rolls much less than the bicycle
+ *           travels is a locked brake, one that rolls much more is spinning.
+ */
+
+#ifndef SKID_H_
+#define SKID_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freq.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Below this reference speed nothing is flagged, m/s (7.2 km/h):
+#define SKID_MIN_SPEED        2.0f
+// The wheel rolling less than (1 - this) of the distance travelled is a
+// lock-up, more than (1 + this) a spin:
+#define SKID_LOCK_SLIP        0.3f
+#define SKID_SPIN_SLIP        0.3f
+// A lock-up needs the brakes on: the IMU must show the bicycle slowing
+// down at least this much (m/s^2), filtered with this time constant (s):
+#define SKID_LOCK_DECEL       1.0f
+#define SKID_DECEL_TAU        0.2f
+// Share of the speed error found at each wheel turn that is corrected, so
+// the IMU bias does not build up:
+#define SKID_TRACK_GAIN       0.5f
+
+// Distance travelled at each sample, 2.56 s at 200 Hz. An edge older
+// than that is not compared (below 0.8 m/s):
+#define SKID_HISTORY          512U
+#define SKID_HISTORY_MASK     (SKID_HISTORY - 1U)
+// The travelled distance is kept small for single precision:
+#define SKID_REBASE_M         1000.0f
+// An event longer than this ends, the reference can't be trusted longer:
+#define SKID_MAX_MS           3000U
+// The screen alert stays up after the event ends:
+#define SKID_ALERT_MS         2000U
+
+// Events kept for logging:
+#define SKID_LOG_SIZE         16U
+#define SKID_LOG_MASK         (SKID_LOG_SIZE - 1U)
+
+#define SKID_GRAVITY          9.80665f     // m/s^2 per g
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+typedef enum{
+	SKID_NONE,
+	SKID_LOCK,                // Wheel slower than the bicycle: locked brake.
+	SKID_SPIN                 // Wheel faster than the bicycle: wheel slip.
+}skid_type_t;
+
+/* A detected event: */
+typedef struct{
+	uint32_t timestamp;       // Sample time (ms) when it was flagged.
+	uint32_t duration;        // ms, until the wheel matched again.
+	uint32_t latency;         // ms from the last wheel edge before the
+	                          // onset to the flag, bound of the delay:
+	                          // 1.43 turns for a lock-up, 2 for a spin.
+	uint32_t type;            // skid_type_t.
+	float speed;              // Reference speed when flagged, m/s.
+	float slip;               // Worst wheel turn against travel, -1 for
+	                          // a locked wheel, +0.5 for 50 % spin.
+}skid_event_t;
+
+/* Counters: */
+typedef struct{
+	uint32_t locks;
+	uint32_t spins;
+	uint32_t max_latency;     // ms, worst of all events.
+}skid_stats_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Clears the reference speed, the current event and the log.
+ */
+void skid_init(void);
+
+/*
+ * @brief: Integrates one IMU sample into the reference speed and the
+ *         travelled distance.
+ *
+ * @param: timestamp Sample time, in ms.
+ * @param: accel     Longitudinal acceleration of the bicycle, gravity
+ *                   removed, in m/s^2.
+ * @param: dt        Time since the previous sample, in s.
+ */
+void skid_add_sample(uint32_t timestamp, float accel, float dt);
+
+/*
+ * @brief: Checks the distance travelled against the wheel turns, up to the
+ *         last sample added. Called right after each batch of samples, so
+ *         the wheel timing read now belongs to the same moment.
+ */
+void skid_check(void);
+
+/*
+ * @brief: Type of the event in progress, or of the last one while its
+ *         alert is held. SKID_NONE otherwise.
+ */
+skid_type_t skid_get_alert(void);
+
+/*
+ * @brief: Speed of the bicycle integrated from the IMU, in m/s.
+ */
+float skid_get_reference(void);
+
+/*
+ * @brief: Gets a finished event.
+ *
+ * @param: age   0 for the last one, 1 for the one before, etc.
+ * @param: event Where the event is copied.
+ *
+ * @retval: false if there is no such event.
+ */
+bool skid_get_event(uint32_t age, skid_event_t * event);
+
+/*
+ * @brief: Returns the event counters and the worst latency.
+ */
+skid_stats_t skid_get_stats(void);
+
+#endif /* SKID_H_ */
@@ -0,0 +1,405 @@
+/*
+ * @file     soft_timer.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the software timers: any number of one-shot and
+ *           periodic timers share a single PIT channel. They are kept in a
+ *           hierarchical timer wheel, and the channel is loaded with the
+ *           time left to the next deadline only, so there is no periodic
+ *           tick interrupt.
+ */
+
+#include "soft_timer.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Timers of each slot, and a bit per slot that has any, for each level:
+static soft_timer_t * g_slots[SOFT_TIMER_LEVELS * SOFT_TIMER_SLOTS];
+static uint32_t g_occupied[SOFT_TIMER_LEVELS];
+
+// Time (ms) up to which the wheel has been run, never ahead of the time
+// base. Timers are placed in the wheel from it:
+static uint64_t g_wheel_time = 0;
+// Deadline the PIT channel is loaded with, UINT64_MAX if stopped:
+static uint64_t g_deadline = UINT64_MAX;
+static uint32_t g_active = 0;
+static bool g_advancing = false;
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static void soft_timer_irq(void);
+static uint64_t soft_timer_now(void);
+static void soft_timer_program(uint64_t deadline);
+static bool soft_timer_next(uint64_t * next);
+static void soft_timer_insert(soft_timer_t * timer);
+static void soft_timer_remove(soft_timer_t * timer);
+static void soft_timer_cascade(uint32_t level, uint32_t slot);
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Empties the wheel and sets up its PIT channel. timebase_init()
+ *         must have been called.
+ */
+void soft_timer_init(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < (SOFT_TIMER_LEVELS * SOFT_TIMER_SLOTS); i++)
+	{
+		g_slots[i] = NULL;
+	}
+	for (i = 0; i < SOFT_TIMER_LEVELS; i++)
+	{
+		g_occupied[i] = 0;
+	}
+	g_wheel_time = soft_timer_now();
+	g_deadline = UINT64_MAX;
+	g_active = 0;
+	g_advancing = false;
+
+	PIT_EnableInterrupts(PIT, SOFT_TIMER_PIT_CHNL, kPIT_TimerInterruptEnable);
+	PIT_callback_init(SOFT_TIMER_PIT_CHNL, soft_timer_irq);
+	NVIC_enable_interrupt_and_priotity(SOFT_TIMER_PIT_IRQ, SOFT_TIMER_PRIORITY);
+}
+
+/*
+ * @brief: Sets the function a timer calls when it expires. The callback
+ *         runs in interrupt context and may start or stop any timer.
+ *
+ * @param: timer    Timer to be set up, stopped.
+ * @param: callback Function to be called.
+ * @param: context  Pointer passed to the callback.
+ */
+void soft_timer_setup(soft_timer_t * timer, void (*callback)(void * context), void * context)
+{
+	timer->next = NULL;
+	timer->prev = NULL;
+	timer->expires = 0;
+	timer->period = 0;
+	timer->slot = 0;
+	timer->active = false;
+	timer->callback = callback;
+	timer->context = context;
+}
+
+/*
+ * @brief: Starts a timer, or starts it again if it was running. O(1).
+ *
+ * @param: timer   Timer to be started.
+ * @param: timeout ms until the first expiry, at least 1.
+ * @param: period  ms between the following ones, 0 for a one-shot timer.
+ *                 Expiries are kept at whole periods from the first one, so
+ *                 they don't drift with the interrupt latency.
+ */
+void soft_timer_start(soft_timer_t * timer, uint32_t timeout, uint32_t period)
+{
+	uint64_t now = 0;
+	uint32_t primask = __get_PRIMASK();
+
+	NVIC_disable_interrupts;
+	// Read with the interrupt masked, and never behind the wheel: timers
+	// are placed from the wheel time, and it must not move back.
+	now = soft_timer_now();
+	if (now < g_wheel_time)
+	{
+		now = g_wheel_time;
+	}
+
+	if (timer->active)
+	{
+		soft_timer_remove(timer);
+	}
+	else if (0U == g_active)
+	{
+		// Nothing to run in between, the wheel can jump to now:
+		g_wheel_time = now;
+	}
+
+	timer->expires = now + ((0U != timeout) ? timeout : 1U);
+	timer->period = period;
+	soft_timer_insert(timer);
+
+	// From the interrupt, the channel is loaded once all callbacks ran:
+	if (!g_advancing && (timer->expires < g_deadline))
+	{
+		soft_timer_program(timer->expires);
+	}
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief: Stops a timer, nothing happens if it was not running. O(1).
+ */
+void soft_timer_stop(soft_timer_t * timer)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	NVIC_disable_interrupts;
+	if (timer->active)
+	{
+		// The channel is left as it is, waking up early costs nothing:
+		soft_timer_remove(timer);
+	}
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief: Returns true while the timer is waiting to expire.
+ */
+bool soft_timer_is_active(const soft_timer_t * timer)
+{
+	return timer->active;
+}
+
+/*
+ * @brief: Runs the callbacks of all the timers expired up to a time and
+ *         returns the next deadline. Called from the PIT interrupt, and
+ *         exposed so the wheel can be driven without the hardware.
+ *
+ * @param: now  Time base ms.
+ * @param: next Where the next deadline is stored, in ms.
+ *
+ * @retval: false if no timer is running.
+ */
+bool soft_timer_advance(uint64_t now, uint64_t * next)
+{
+	soft_timer_t * timer = NULL;
+	uint64_t time = 0;
+	uint32_t level = 0;
+	uint32_t slot = 0;
+
+	g_advancing = true;
+	while (soft_timer_next(&time) && (time <= now))
+	{
+		g_wheel_time = time;
+
+		// A level's slot is placed into the ones below when the wheel gets
+		// to its start:
+		for (level = 1; level < SOFT_TIMER_LEVELS; level++)
+		{
+			if (time & ((1ULL << (level * SOFT_TIMER_SLOT_BITS)) - 1U))
+			{
+				break;
+			}
+			soft_timer_cascade(level, (uint32_t)(time >> (level * SOFT_TIMER_SLOT_BITS)) &
+					SOFT_TIMER_SLOT_MASK);
+		}
+
+		// Everything left in the first level slot expires now:
+		slot = (uint32_t)time & SOFT_TIMER_SLOT_MASK;
+		while (NULL != g_slots[slot])
+		{
+			timer = g_slots[slot];
+			soft_timer_remove(timer);
+			if (timer->period)
+			{
+				timer->expires += timer->period;
+				soft_timer_insert(timer);
+			}
+			timer->callback(timer->context);
+		}
+	}
+
+	// No slot starts before the next deadline, so the wheel can skip to now:
+	if (now > g_wheel_time)
+	{
+		g_wheel_time = now;
+	}
+	g_advancing = false;
+
+	return soft_timer_next(next);
+}
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: PIT callback, at the programmed deadline or at the longest load.
+ */
+static void soft_timer_irq(void)
+{
+	uint64_t next = 0;
+
+	PIT_StopTimer(PIT, SOFT_TIMER_PIT_CHNL);
+	g_deadline = UINT64_MAX;
+
+	if (soft_timer_advance(soft_timer_now(), &next))
+	{
+		soft_timer_program(next);
+	}
+}
+
+/*
+ * @brief: Time base, in ms.
+ */
+static uint64_t soft_timer_now(void)
+{
+	return timebase_ticks() / SOFT_TIMER_TICKS_PER_MS;
+}
+
+/*
+ * @brief: Loads the PIT channel with the time left to a deadline.
+ *
+ * @param: deadline Time base ms.
+ */
+static void soft_timer_program(uint64_t deadline)
+{
+	uint64_t target = deadline * SOFT_TIMER_TICKS_PER_MS;
+	uint64_t now = timebase_ticks();
+	uint32_t count = 1U;
+
+	if (target > now)
+	{
+		count = ((target - now) > SOFT_TIMER_MAX_COUNT) ?
+				SOFT_TIMER_MAX_COUNT : (uint32_t)(target - now);
+	}
+
+	PIT_StopTimer(PIT, SOFT_TIMER_PIT_CHNL);
+	PIT_ClearStatusFlags(PIT, SOFT_TIMER_PIT_CHNL, kPIT_TimerFlag);
+	PIT_SetTimerPeriod(PIT, SOFT_TIMER_PIT_CHNL, count);
+	PIT_StartTimer(PIT, SOFT_TIMER_PIT_CHNL);
+	g_deadline = deadline;
+}
+
+/*
+ * @brief: Finds when the wheel has to run next: the expiry of the nearest
+ *         first level slot, or the start of the nearest slot of a level
+ *         above, whichever comes first.
+ *
+ * @param: next Where the time is stored, in ms.
+ *
+ * @retval: false if the wheel is empty.
+ */
+static bool soft_timer_next(uint64_t * next)
+{
+	uint64_t time = 0;
+	uint64_t best = UINT64_MAX;
+	uint32_t level = 0;
+	uint32_t shift = 0;
+	uint32_t from = 0;
+	uint32_t ahead = 0;
+
+	for (level = 0; level < SOFT_TIMER_LEVELS; level++)
+	{
+		if (0U == g_occupied[level])
+		{
+			continue;
+		}
+		shift = level * SOFT_TIMER_SLOT_BITS;
+
+		// Slots are looked at in the order they come, from the next one:
+		from = ((uint32_t)(g_wheel_time >> shift) + 1U) & SOFT_TIMER_SLOT_MASK;
+		ahead = __CLZ(__RBIT(__ROR(g_occupied[level], from)));
+
+		time = ((g_wheel_time >> shift) + 1U + ahead) << shift;
+		if (time < best)
+		{
+			best = time;
+		}
+	}
+	*next = best;
+
+	return (UINT64_MAX != best);
+}
+
+/*
+ * @brief: Links a timer into the slot its expiry falls in, in the lowest
+ *         level that reaches that far from the wheel time.
+ */
+static void soft_timer_insert(soft_timer_t * timer)
+{
+	uint64_t expires = timer->expires;
+	uint64_t delta = expires - g_wheel_time;
+	uint32_t level = 0;
+	uint32_t index = 0;
+
+	if (delta >= SOFT_TIMER_RANGE)
+	{
+		// Too far: waits in the last slot and is placed again from there.
+		expires = g_wheel_time + SOFT_TIMER_RANGE - 1U;
+		delta = SOFT_TIMER_RANGE - 1U;
+	}
+	while ((level < (SOFT_TIMER_LEVELS - 1U)) &&
+			(delta >= (1ULL << ((level + 1U) * SOFT_TIMER_SLOT_BITS))))
+	{
+		level++;
+	}
+
+	index = (uint32_t)(expires >> (level * SOFT_TIMER_SLOT_BITS)) & SOFT_TIMER_SLOT_MASK;
+	timer->slot = (uint8_t)((level * SOFT_TIMER_SLOTS) + index);
+	timer->prev = NULL;
+	timer->next = g_slots[timer->slot];
+	if (timer->next)
+	{
+		timer->next->prev = timer;
+	}
+	g_slots[timer->slot] = timer;
+	g_occupied[level] |= (1U << index);
+
+	timer->active = true;
+	g_active++;
+}
+
+/*
+ * @brief: Unlinks a timer from its slot.
+ */
+static void soft_timer_remove(soft_timer_t * timer)
+{
+	uint32_t level = timer->slot / SOFT_TIMER_SLOTS;
+	uint32_t index = timer->slot & SOFT_TIMER_SLOT_MASK;
+
+	if (timer->prev)
+	{
+		timer->prev->next = timer->next;
+	}
+	else
+	{
+		g_slots[timer->slot] = timer->next;
+	}
+	if (timer->next)
+	{
+		timer->next->prev = timer->prev;
+	}
+	if (NULL == g_slots[timer->slot])
+	{
+		g_occupied[level] &= ~(1U << index);
+	}
+
+	timer->next = NULL;
+	timer->prev = NULL;
+	timer->active = false;
+	g_active--;
+}
+
+/*
+ * @brief: Places again the timers of a slot, once the wheel gets to its
+ *         start. They all fall in lower levels, or wait in the last one.
+ */
+static void soft_timer_cascade(uint32_t level, uint32_t slot)
+{
+	soft_timer_t * timer = NULL;
+	uint32_t index = (level * SOFT_TIMER_SLOTS) + slot;
+
+	while (NULL != g_slots[index])
+	{
+		timer = g_slots[index];
+		soft_timer_remove(timer);
+		soft_timer_insert(timer);
+	}
+}
@@ -0,0 +1,123 @@
+/*
+ * @file     soft_timer.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the software timers: any number of one-shot and
+ *           periodic timers share a single PIT channel. They are kept in a
+ *           hierarchical timer wheel, and the channel is loaded with the
+ *           time left to the next deadline only, so there is no periodic
+ *           tick interrupt.
+ */
+
+#ifndef SOFT_TIMER_H_
+#define SOFT_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fsl_pit.h"
+#include "NVIC.h"
+#include "PIT.h"
+#include "timebase.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SOFT_TIMER_PIT_CHNL     kPIT_Chnl_0
+#define SOFT_TIMER_PIT_IRQ      PIT_CH0_IRQ
+// Callbacks run at the same priority as the pulse inputs and the time base:
+#define SOFT_TIMER_PRIORITY     TIMEBASE_PRIORITY
+
+// Wheel resolution, in time base ticks (1 ms):
+#define SOFT_TIMER_TICKS_PER_MS (TIMEBASE_TICKS_PER_SEC / 1000U)
+
+// Levels of the wheel, each one with 32 slots that span a whole slot of the
+// level above: 1 ms, 32 ms, 1 s and 33 s slots, up to 17 minutes ahead.
+// Longer timeouts wait in the last slot and are placed again from there.
+#define SOFT_TIMER_LEVELS       4U
+#define SOFT_TIMER_SLOT_BITS    5U
+#define SOFT_TIMER_SLOTS        (1U << SOFT_TIMER_SLOT_BITS)
+#define SOFT_TIMER_SLOT_MASK    (SOFT_TIMER_SLOTS - 1U)
+#define SOFT_TIMER_RANGE        (1ULL << (SOFT_TIMER_LEVELS * SOFT_TIMER_SLOT_BITS))
+
+// Longest PIT load, the channel wakes up and is loaded again past it:
+#define SOFT_TIMER_MAX_COUNT    (60U * TIMEBASE_TICKS_PER_SEC)
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+/* A timer, owned by its user and linked into the wheel while running: */
+typedef struct soft_timer_s{
+	struct soft_timer_s * next;
+	struct soft_timer_s * prev;
+	uint64_t expires;         // Time base ms of the next expiry.
+	uint32_t period;          // ms between expiries, 0 for one-shot.
+	uint8_t slot;             // Level * SOFT_TIMER_SLOTS + slot, while active.
+	bool active;
+	void (*callback)(void * context);
+	void * context;
+}soft_timer_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Empties the wheel and sets up its PIT channel. timebase_init()
+ *         must have been called.
+ */
+void soft_timer_init(void);
+
+/*
+ * @brief: Sets the function a timer calls when it expires. The callback
+ *         runs in interrupt context and may start or stop any timer.
+ *
+ * @param: timer    Timer to be set up, stopped.
+ * @param: callback Function to be called.
+ * @param: context  Pointer passed to the callback.
+ */
+void soft_timer_setup(soft_timer_t * timer, void (*callback)(void * context), void * context);
+
+/*
+ * @brief: Starts a timer, or starts it again if it was running. O(1).
+ *
+ * @param: timer   Timer to be started.
+ * @param: timeout ms until the first expiry, at least 1.
+ * @param: period  ms between the following ones, 0 for a one-shot timer.
+ *                 Expiries are kept at whole periods from the first one, so
+ *                 they don't drift with the interrupt latency.
+ */
+void soft_timer_start(soft_timer_t * timer, uint32_t timeout, uint32_t period);
+
+/*
+ * @brief: Stops a timer, nothing happens if it was not running. O(1).
+ */
+void soft_timer_stop(soft_timer_t * timer);
+
+/*
+ * @brief: Returns true while the timer is waiting to expire.
+ */
+bool soft_timer_is_active(const soft_timer_t * timer);
+
+/*
+ * @brief: Runs the callbacks of all the timers expired up to a time and
+ *         returns the next deadline. Called from the PIT interrupt, and
+ *         exposed so the wheel can be driven without the hardware.
+ *
+ * @param: now  Time base ms.
+ * @param: next Where the next deadline is stored, in ms.
+ *
+ * @retval: false if no timer is running.
+ */
+bool soft_timer_advance(uint64_t now, uint64_t * next);
+
+#endif /* SOFT_TIMER_H_ */
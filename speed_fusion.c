@@ -0,0 +1,217 @@
+/*
+ * @file     speed_fusion.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the fused speed estimate: a single state Kalman
+ *           filter predicts the speed from the IMU longitudinal acceleration
+ *           at the sample rate, and corrects it with the mean speed of each
+ *           wheel turn measured by the Hall sensor.
+ */
+
+#include "speed_fusion.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// State and its variance:
+static float g_speed = 0.0f;
+static float g_variance = 0.0f;
+
+static float g_history[SF_HISTORY];
+static uint32_t g_head = 0;
+static float g_dt = 0.005f;
+
+// Wheel timing at the previous correction, a change is a new edge:
+static float g_last_period = 0.0f;
+static float g_last_age = 0.0f;
+static uint32_t g_rejects_in_row = 0;
+
+static speed_fusion_stats_t g_stats = {0};
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static void speed_fusion_restart(float speed, float variance);
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Starts stopped, with no uncertainty.
+ */
+void speed_fusion_init(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < SF_HISTORY; i++)
+	{
+		g_history[i] = 0.0f;
+	}
+	g_head = 0;
+	g_speed = 0.0f;
+	g_variance = 0.0f;
+	g_last_period = 0.0f;
+	g_last_age = 0.0f;
+	g_rejects_in_row = 0;
+	g_stats.updates = 0;
+	g_stats.rejects = 0;
+	g_stats.restarts = 0;
+}
+
+/*
+ * @brief: Prediction step, for each IMU sample.
+ *
+ * @param: accel Longitudinal acceleration of the bicycle, gravity removed,
+ *               in m/s^2.
+ * @param: dt    Time since the previous sample, in s.
+ */
+void speed_fusion_predict(float accel, float dt)
+{
+	g_speed += accel * dt;
+	if (g_speed < 0.0f)
+	{
+		g_speed = 0.0f;
+	}
+	g_variance += (SF_ACCEL_NOISE * dt) * (SF_ACCEL_NOISE * dt);
+	g_dt = dt;
+
+	g_history[g_head] = g_speed;
+	g_head = (g_head + 1U) & SF_HISTORY_MASK;
+}
+
+/*
+ * @brief: Correction step with the wheel turn completed since the last
+ *         call, if any. Called right after each batch of samples, so the
+ *         wheel timing read now belongs to the newest sample.
+ */
+void speed_fusion_correct(void)
+{
+	float period = 0.0f;
+	float age = 0.0f;
+	float measured = 0.0f;
+	float noise = 0.0f;
+	float innovation = 0.0f;
+	float total = 0.0f;
+	float gain = 0.0f;
+	uint32_t back = 0;
+	bool edge = false;
+	// The wheel does not tell the bicycle speed while it skids:
+	bool skidding = (SKID_NONE != skid_get_alert());
+
+	freq_get_timing(FREQ_WHEEL, &period, &age);
+	edge = (0.0f != period) && ((period != g_last_period) || (age < g_last_age));
+
+	if (0.0f == period)
+	{
+		// Stopped wheel, unless it just started its first turn or skids:
+		if (!skidding && ((0.0f == age) || (age > SF_START_TIME)))
+		{
+			speed_fusion_restart(0.0f, 0.0f);
+		}
+	}
+	else if (edge && !skidding)
+	{
+		measured = FREQ_WHEEL_CIRC / period;
+		noise = SF_MEAS_NOISE + (SF_MEAS_NOISE_REL * measured);
+		noise *= noise;
+
+		// The turn's mean speed belongs to its middle:
+		back = (uint32_t)(((age + (0.5f * period)) / g_dt) + 0.5f);
+
+		if ((0.0f == g_last_period) || (back >= SF_HISTORY))
+		{
+			// First turn after a stop, or too slow to look back to:
+			speed_fusion_restart(measured, noise);
+		}
+		else
+		{
+			innovation = measured - g_history[(g_head - 1U - back) & SF_HISTORY_MASK];
+			total = g_variance + noise;
+
+			if ((innovation * innovation) > (SF_GATE * SF_GATE * total))
+			{
+				g_stats.rejects++;
+				g_rejects_in_row++;
+				if (g_rejects_in_row >= SF_MAX_REJECTS)
+				{
+					speed_fusion_restart(g_speed + innovation, noise);
+				}
+			}
+			else
+			{
+				gain = g_variance / total;
+				g_speed += gain * innovation;
+				g_variance -= gain * g_variance;
+				g_rejects_in_row = 0;
+				g_stats.updates++;
+			}
+		}
+	}
+
+	// No edge since, so the wheel has not made a full turn yet:
+	if (!skidding && (0.0f != period) && (age > 0.0f) && (g_speed > (FREQ_WHEEL_CIRC / age)))
+	{
+		g_speed = FREQ_WHEEL_CIRC / age;
+	}
+	if (g_speed < 0.0f)
+	{
+		g_speed = 0.0f;
+	}
+
+	g_last_period = period;
+	g_last_age = age;
+}
+
+/*
+ * @brief: Returns the fused speed, in m/s.
+ */
+float speed_fusion_get(void)
+{
+	return g_speed;
+}
+
+/*
+ * @brief: Returns the standard deviation of the fused speed, in m/s.
+ */
+float speed_fusion_get_std(void)
+{
+	return fast_math_sqrt(g_variance);
+}
+
+/*
+ * @brief: Returns the correction counters.
+ */
+speed_fusion_stats_t speed_fusion_get_stats(void)
+{
+	return g_stats;
+}
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: Sets the state directly, for a stopped wheel, the first turn
+ *         after a stop, or after the wheel kept disagreeing.
+ */
+static void speed_fusion_restart(float speed, float variance)
+{
+	if (variance > 0.0f)
+	{
+		g_stats.restarts++;
+	}
+	g_speed = speed;
+	g_variance = variance;
+	g_rejects_in_row = 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * @file     speed_fusion.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the fused speed estimate: a single state Kalman
+ *           filter predicts the speed from the IMU longitudinal acceleration
+ *           at the sample rate, and corrects it with the mean speed of each
+ *           wheel turn measured by the Hall sensor.
+ */
+
+#ifndef SPEED_FUSION_H_
+#define SPEED_FUSION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fast_math.h"
+#include "freq.h"
+#include "skid.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Process noise: acceleration error not modelled (sensor noise, bias,
+// gravity leaking through the attitude), in m/s^2.
+#define SF_ACCEL_NOISE        3.0f
+// Measurement noise of a turn's mean speed, in m/s and as a share of it
+// (wheel circumference, magnet position):
+#define SF_MEAS_NOISE         0.05f
+#define SF_MEAS_NOISE_REL     0.01f
+// Turns whose innovation is above this many standard deviations are not
+// used, and after this many in a row the filter restarts from the wheel:
+#define SF_GATE               4.0f
+#define SF_MAX_REJECTS        3U
+
+// A wheel edge this recent, with no period measured yet, is a start: the
+// IMU alone gives the speed until the first turn completes, in s.
+#define SF_START_TIME         2.0f
+
+// Fused speed at each sample, to compare with a turn's mean speed at its
+// middle, 2.56 s at 200 Hz. Slower turns (under 0.8 m/s) restart the
+// filter from the wheel instead.
+#define SF_HISTORY            512U
+#define SF_HISTORY_MASK       (SF_HISTORY - 1U)
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+/* Counters: */
+typedef struct{
+	uint32_t updates;         // Turns used to correct the speed.
+	uint32_t rejects;         // Turns out of the gate.
+	uint32_t restarts;        // Times started again from the wheel.
+}speed_fusion_stats_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Starts stopped, with no uncertainty.
+ */
+void speed_fusion_init(void);
+
+/*
+ * @brief: Prediction step, for each IMU sample.
+ *
+ * @param: accel Longitudinal acceleration of the bicycle, gravity removed,
+ *               in m/s^2.
+ * @param: dt    Time since the previous sample, in s.
+ */
+void speed_fusion_predict(float accel, float dt);
+
+/*
+ * @brief: Correction step with the wheel turn completed since the last
+ *         call, if any. Called right after each batch of samples, so the
+ *         wheel timing read now belongs to the newest sample.
+ */
+void speed_fusion_correct(void);
+
+/*
+ * @brief: Returns the fused speed, in m/s.
+ */
+float speed_fusion_get(void);
+
+/*
+ * @brief: Returns the standard deviation of the fused speed, in m/s.
+ */
+float speed_fusion_get_std(void);
+
+/*
+ * @brief: Returns the correction counters.
+ */
+speed_fusion_stats_t speed_fusion_get_stats(void);
+
+#endif /* SPEED_FUSION_H_ */
@@ -0,0 +1,106 @@
+/*
+ * @file     spsc_ring.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the single producer, single consumer ring
+ *           buffers that hand data from an interrupt to the main loop
+ *           without disabling interrupts. Each side only writes its own
+ *           index, and a DMB orders the item copy against the index update.
+ */
+
+#include "spsc_ring.h"
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Producer side. Copies an item into the ring.
+ *
+ * @param: ring Ring buffer.
+ * @param: item Item to be copied, item_size bytes.
+ *
+ * @retval: false if the ring is full, the item is not stored.
+ */
+bool spsc_ring_push(spsc_ring_t * ring, const void * item)
+{
+	uint32_t head = ring->head;
+	uint32_t tail = ring->tail;
+
+	if ((head - tail) > ring->mask)
+	{
+		return false;
+	}
+
+	// The slot was freed by the consumer once it published the tail, so
+	// its last read is over before it is written again:
+	__DMB();
+	memcpy(&ring->buffer[(head & ring->mask) * ring->item_size], item, ring->item_size);
+
+	// The item must be complete before the consumer can see it:
+	__DMB();
+	ring->head = head + 1U;
+
+	return true;
+}
+
+/*
+ * @brief: Consumer side. Takes the oldest item out of the ring.
+ *
+ * @param: ring Ring buffer.
+ * @param: item Where the item is copied, item_size bytes.
+ *
+ * @retval: false if the ring is empty.
+ */
+bool spsc_ring_pop(spsc_ring_t * ring, void * item)
+{
+	uint32_t tail = ring->tail;
+	uint32_t head = ring->head;
+
+	if (tail == head)
+	{
+		return false;
+	}
+
+	// The item is read only after the head that published it:
+	__DMB();
+	memcpy(item, &ring->buffer[(tail & ring->mask) * ring->item_size], ring->item_size);
+
+	// And the copy is over before the producer can reuse the slot:
+	__DMB();
+	ring->tail = tail + 1U;
+
+	return true;
+}
+
+/*
+ * @brief: Consumer side. Drops all the items in the ring.
+ */
+void spsc_ring_flush(spsc_ring_t * ring)
+{
+	uint32_t head = ring->head;
+
+	__DMB();
+	ring->tail = head;
+}
+
+/*
+ * @brief: Items waiting in the ring, as seen now. The other side may
+ *         change it at any time.
+ */
+uint32_t spsc_ring_count(const spsc_ring_t * ring)
+{
+	return ring->head - ring->tail;
+}
+
+/*
+ * @brief: Returns true if there is no item to take.
+ */
+bool spsc_ring_is_empty(const spsc_ring_t * ring)
+{
+	return (ring->head == ring->tail);
+}
@@ -0,0 +1,92 @@
+/*
+ * @file     spsc_ring.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the single producer, single consumer ring
+ *           buffers that hand data from an interrupt to the main loop
+ *           without disabling interrupts. Each side only writes its own
+ *           index, and a DMB orders the item copy against the index update.
+ */
+
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "MK64F12.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+/*
+ * Defines a ring of `size` items of `type` with static storage. The size
+ * must be a power of 2, the indices run freely and wrap with the mask.
+ */
+#define SPSC_RING_DEFINE(name, type, size)                                   \
+	typedef char name##_size_check[((((size) & ((size) - 1U)) == 0U) && ((size) > 0U)) ? 1 : -1]; \
+	static type name##_storage[size];                                        \
+	static spsc_ring_t name = {(uint8_t *)name##_storage, (size) - 1U, sizeof(type), 0, 0}
+
+/*
+ * ******************************************************************
+ * Structures and enums:
+ * ******************************************************************
+ */
+
+typedef struct{
+	uint8_t * buffer;
+	uint32_t mask;            // Items - 1.
+	uint32_t item_size;       // Bytes per item.
+	volatile uint32_t head;   // Written by the producer only.
+	volatile uint32_t tail;   // Written by the consumer only.
+}spsc_ring_t;
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Producer side. Copies an item into the ring.
+ *
+ * @param: ring Ring buffer.
+ * @param: item Item to be copied, item_size bytes.
+ *
+ * @retval: false if the ring is full, the item is not stored.
+ */
+bool spsc_ring_push(spsc_ring_t * ring, const void * item);
+
+/*
+ * @brief: Consumer side. Takes the oldest item out of the ring.
+ *
+ * @param: ring Ring buffer.
+ * @param: item Where the item is copied, item_size bytes.
+ *
+ * @retval: false if the ring is empty.
+ */
+bool spsc_ring_pop(spsc_ring_t * ring, void * item);
+
+/*
+ * @brief: Consumer side. Drops all the items in the ring.
+ */
+void spsc_ring_flush(spsc_ring_t * ring);
+
+/*
+ * @brief: Items waiting in the ring, as seen now. The other side may
+ *         change it at any time.
+ */
+uint32_t spsc_ring_count(const spsc_ring_t * ring);
+
+/*
+ * @brief: Returns true if there is no item to take.
+ */
+bool spsc_ring_is_empty(const spsc_ring_t * ring);
+
+#endif /* SPSC_RING_H_ */
@@ -0,0 +1,8 @@
+/*
+ * @file     fsl_i2c.h
+ *
+ * @brief    Host stand-in for the SDK header of the same name, all of them
+ *           share sdk_stubs.h.
+ */
+
+#include "sdk_stubs.h"
@@ -0,0 +1,68 @@
+/*
+ * @file     host_timebase.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Simulated system time base for the host tests: the time only
+ *           moves when a test sets it, so replays run as fast as the host
+ *           allows and give the same results every time.
+ */
+
+#include "host_timebase.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static uint64_t g_host_ticks = 0;
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Sets the simulated time, in time base ticks.
+ */
+void host_timebase_set(uint64_t ticks)
+{
+	g_host_ticks = ticks;
+}
+
+/*
+ * @brief: Sets the simulated time, in seconds.
+ */
+void host_timebase_set_sec(double seconds)
+{
+	g_host_ticks = (uint64_t)(seconds * (double)TIMEBASE_TICKS_PER_SEC);
+}
+
+void timebase_init(void)
+{
+	g_host_ticks = 0;
+}
+
+uint64_t timebase_ticks(void)
+{
+	return g_host_ticks;
+}
+
+uint64_t timebase_us(void)
+{
+	return timebase_ticks_to_us(g_host_ticks);
+}
+
+uint32_t timebase_ms(void)
+{
+	return (uint32_t)(timebase_us() / 1000U);
+}
+
+uint64_t timebase_ticks_to_us(uint64_t ticks)
+{
+	return ((ticks / TIMEBASE_TICKS_PER_SEC) * 1000000U) +
+			(((ticks % TIMEBASE_TICKS_PER_SEC) * 1000000U) / TIMEBASE_TICKS_PER_SEC);
+}
@@ -0,0 +1,27 @@
+/*
+ * @file     host_timebase.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Simulated system time base for the host tests: the time only
+ *           moves when a test sets it, so replays run as fast as the host
+ *           allows and give the same results every time.
+ */
+
+#ifndef HOST_TIMEBASE_H_
+#define HOST_TIMEBASE_H_
+
+#include "timebase.h"
+
+/*
+ * @brief: Sets the simulated time, in time base ticks.
+ */
+void host_timebase_set(uint64_t ticks);
+
+/*
+ * @brief: Sets the simulated time, in seconds.
+ */
+void host_timebase_set_sec(double seconds);
+
+#endif /* HOST_TIMEBASE_H_ */
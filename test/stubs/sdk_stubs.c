@@ -0,0 +1,152 @@
+/*
+ * @file     sdk_stubs.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host stand-ins for the SDK drivers and for the board glue
+ *           (NVIC.c, PIT.c, gpio.c) used by the modules under test. Most
+ *           calls do nothing, the ones a test needs to drive or observe
+ *           keep their state in g_stub_ variables.
+ */
+
+#include "sdk_stubs.h"
+#include "NVIC.h"
+#include "PIT.h"
+#include "gpio.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static GPIO_Type g_gpio[5];
+static FTM_Type g_ftm0;
+static SIM_Type g_sim;
+static PIT_Type g_pit;
+static I2C_Type g_i2c0;
+static DWT_Type g_dwt;
+static CoreDebug_Type g_core_debug;
+static DMA_Type g_dma0;
+static DMAMUX_Type g_dmamux;
+
+GPIO_Type * GPIOA = &g_gpio[0];
+GPIO_Type * GPIOB = &g_gpio[1];
+GPIO_Type * GPIOC = &g_gpio[2];
+GPIO_Type * GPIOD = &g_gpio[3];
+GPIO_Type * GPIOE = &g_gpio[4];
+FTM_Type * FTM0 = &g_ftm0;
+SIM_Type * SIM = &g_sim;
+PIT_Type * PIT = &g_pit;
+I2C_Type * I2C0 = &g_i2c0;
+DWT_Type * DWT = &g_dwt;
+CoreDebug_Type * CoreDebug = &g_core_debug;
+DMA_Type * DMA0 = &g_dma0;
+DMAMUX_Type * DMAMUX = &g_dmamux;
+
+uint32_t g_stub_i2c_started = 0;
+i2c_master_transfer_t g_stub_i2c_last;
+
+uint32_t g_stub_edma_flags[16];
+uint32_t g_stub_edma_remaining[16];
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+void CLOCK_EnableClock(clock_ip_name_t name) { (void)name; }
+uint32_t CLOCK_GetFreq(clock_name_t name) { (void)name; return 10500000U; }
+
+void PORT_SetPinConfig(PORT_Type * base, uint32_t pin, const port_pin_config_t * config)
+{ (void)base; (void)pin; (void)config; }
+void PORT_SetPinMux(PORT_Type * base, uint32_t pin, port_mux_t mux)
+{ (void)base; (void)pin; (void)mux; }
+void PORT_SetPinInterruptConfig(PORT_Type * base, uint32_t pin, port_interrupt_t config)
+{ (void)base; (void)pin; (void)config; }
+void PORT_EnablePinsDigitalFilter(PORT_Type * base, uint32_t mask, bool enable)
+{ (void)base; (void)mask; (void)enable; }
+void PORT_SetDigitalFilterConfig(PORT_Type * base, const port_digital_filter_config_t * config)
+{ (void)base; (void)config; }
+
+void GPIO_PinInit(GPIO_Type * base, uint32_t pin, const gpio_pin_config_t * config)
+{ (void)base; (void)pin; (void)config; }
+uint32_t GPIO_PortGetInterruptFlags(GPIO_Type * base) { (void)base; return 0; }
+void GPIO_PortClearInterruptFlags(GPIO_Type * base, uint32_t mask) { (void)base; (void)mask; }
+uint32_t GPIO_PinRead(GPIO_Type * base, uint32_t pin) { (void)base; (void)pin; return 0; }
+
+void PIT_GetDefaultConfig(pit_config_t * config) { config->enableRunInDebug = false; }
+void PIT_Init(PIT_Type * base, const pit_config_t * config) { (void)base; (void)config; }
+void PIT_SetTimerPeriod(PIT_Type * base, pit_chnl_t channel, uint32_t count)
+{ base->CHANNEL[channel].LDVAL = count - 1U; }
+void PIT_EnableInterrupts(PIT_Type * base, pit_chnl_t channel, uint32_t mask)
+{ (void)base; (void)channel; (void)mask; }
+void PIT_DisableInterrupts(PIT_Type * base, pit_chnl_t channel, uint32_t mask)
+{ (void)base; (void)channel; (void)mask; }
+void PIT_StartTimer(PIT_Type * base, pit_chnl_t channel)
+{ base->CHANNEL[channel].CVAL = base->CHANNEL[channel].LDVAL; base->CHANNEL[channel].TCTRL |= 1U; }
+void PIT_StopTimer(PIT_Type * base, pit_chnl_t channel) { base->CHANNEL[channel].TCTRL &= ~1U; }
+uint32_t PIT_GetCurrentTimerCount(PIT_Type * base, pit_chnl_t channel)
+{ return base->CHANNEL[channel].CVAL; }
+void PIT_ClearStatusFlags(PIT_Type * base, pit_chnl_t channel, uint32_t mask)
+{ base->CHANNEL[channel].TFLG &= ~mask; }
+uint32_t PIT_GetStatusFlags(PIT_Type * base, pit_chnl_t channel)
+{ return base->CHANNEL[channel].TFLG; }
+
+void I2C_MasterGetDefaultConfig(i2c_master_config_t * config) { (void)config; }
+void I2C_MasterInit(I2C_Type * base, const i2c_master_config_t * config, uint32_t clock)
+{ (void)base; (void)config; (void)clock; }
+status_t I2C_MasterTransferBlocking(I2C_Type * base, i2c_master_transfer_t * xfer)
+{ (void)base; (void)xfer; return kStatus_Success; }
+void I2C_MasterTransferCreateHandle(I2C_Type * base, i2c_master_handle_t * handle,
+		i2c_master_transfer_callback_t callback, void * userData)
+{ (void)base; (void)handle; (void)callback; (void)userData; }
+
+status_t I2C_MasterTransferNonBlocking(I2C_Type * base, i2c_master_handle_t * handle,
+		i2c_master_transfer_t * xfer)
+{
+	(void)base;
+	(void)handle;
+
+	g_stub_i2c_started++;
+	g_stub_i2c_last = *xfer;
+
+	return kStatus_Success;
+}
+
+void EDMA_GetDefaultConfig(edma_config_t * config) { (void)config; }
+void EDMA_Init(DMA_Type * base, const edma_config_t * config) { (void)base; (void)config; }
+void EDMA_ResetChannel(DMA_Type * base, uint32_t channel) { (void)base; g_stub_edma_flags[channel] = 0; }
+void EDMA_SetTransferConfig(DMA_Type * base, uint32_t channel,
+		const edma_transfer_config_t * config, void * next)
+{ (void)base; g_stub_edma_remaining[channel] = config->majorLoopCounts; (void)next; }
+void EDMA_SetChannelLink(DMA_Type * base, uint32_t channel,
+		edma_channel_link_type_t type, uint32_t linked)
+{ (void)base; (void)channel; (void)type; (void)linked; }
+void EDMA_EnableChannelInterrupts(DMA_Type * base, uint32_t channel, uint32_t mask)
+{ (void)base; (void)channel; (void)mask; }
+void EDMA_EnableAutoStopRequest(DMA_Type * base, uint32_t channel, bool enable)
+{ (void)base; (void)channel; (void)enable; }
+void EDMA_EnableChannelRequest(DMA_Type * base, uint32_t channel) { base->ERQ |= (1U << channel); }
+void EDMA_DisableChannelRequest(DMA_Type * base, uint32_t channel) { base->ERQ &= ~(1U << channel); }
+uint32_t EDMA_GetRemainingMajorLoopCount(DMA_Type * base, uint32_t channel)
+{ (void)base; return g_stub_edma_remaining[channel]; }
+void EDMA_ClearChannelStatusFlags(DMA_Type * base, uint32_t channel, uint32_t mask)
+{ (void)base; g_stub_edma_flags[channel] &= ~mask; }
+uint32_t EDMA_GetChannelStatusFlags(DMA_Type * base, uint32_t channel)
+{ (void)base; return g_stub_edma_flags[channel]; }
+
+void DMAMUX_Init(DMAMUX_Type * base) { (void)base; }
+void DMAMUX_SetSource(DMAMUX_Type * base, uint32_t channel, uint32_t source)
+{ (void)base; (void)channel; (void)source; }
+void DMAMUX_EnableChannel(DMAMUX_Type * base, uint32_t channel) { (void)base; (void)channel; }
+void DMAMUX_DisableChannel(DMAMUX_Type * base, uint32_t channel) { (void)base; (void)channel; }
+
+void NVIC_enable_interrupt_and_priotity(interrupt_t interrupt_number, priority_level_t priority)
+{ (void)interrupt_number; (void)priority; }
+void PIT_callback_init(pit_chnl_t pit_channel, void (*handler)(void))
+{ (void)pit_channel; (void)handler; }
+void GPIO_callback_init(gpio_name_t gpio, void (*handler)(uint32_t flags))
+{ (void)gpio; (void)handler; }
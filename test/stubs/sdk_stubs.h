@@ -0,0 +1,378 @@
+/*
+ * @file     sdk_stubs.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host stand-ins for the parts of MK64F12.h, CMSIS and the SDK
+ *           drivers used by the modules under test. Peripherals are plain
+ *           structs in RAM, driver calls do nothing unless a test needs to
+ *           see them (see sdk_stubs.c).
+ */
+
+#ifndef SDK_STUBS_H_
+#define SDK_STUBS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * ******************************************************************
+ * Common:
+ * ******************************************************************
+ */
+
+typedef int32_t status_t;
+enum { kStatus_Success = 0, kStatus_Fail = 1 };
+
+#define USEC_TO_COUNT(us, clockFreqInHz)    (uint64_t)(((uint64_t)(us) * (clockFreqInHz)) / 1000000U)
+#define COUNT_TO_USEC(count, clockFreqInHz) (uint64_t)((uint64_t)(count) * 1000000U / (clockFreqInHz))
+
+/*
+ * ******************************************************************
+ * Peripherals:
+ * ******************************************************************
+ */
+
+typedef struct {
+	volatile uint32_t PCR[32];
+	volatile uint32_t GPCLR, GPCHR;
+	uint8_t reserved0[24];
+	volatile uint32_t ISFR;
+	uint8_t reserved1[28];
+	volatile uint32_t DFER, DFCR, DFWR;
+} PORT_Type;
+
+typedef struct {
+	volatile uint32_t PDOR, PSOR, PCOR, PTOR, PDIR, PDDR;
+} GPIO_Type;
+
+typedef struct {
+	volatile uint32_t CnSC;
+	volatile uint32_t CnV;
+} FTM_CONTROLS_Type;
+
+typedef struct {
+	volatile uint32_t SC, CNT, MOD;
+	FTM_CONTROLS_Type CONTROLS[8];
+	volatile uint32_t CNTIN, STATUS, MODE, SYNC, OUTINIT, OUTMASK, COMBINE,
+			DEADTIME, EXTTRIG, POL, FMS, FILTER, FLTCTRL, QDCTRL, CONF, FLTPOL,
+			SYNCONF, INVCTRL, SWOCTRL, PWMLOAD;
+} FTM_Type;
+
+typedef struct {
+	volatile uint32_t SCGC5, SCGC6, CLKDIV1;
+} SIM_Type;
+
+typedef struct {
+	volatile uint32_t LDVAL, CVAL, TCTRL, TFLG;
+} PIT_CHANNEL_Type;
+
+typedef struct {
+	volatile uint32_t MCR;
+	volatile uint32_t LTMR64H, LTMR64L;
+	PIT_CHANNEL_Type CHANNEL[4];
+} PIT_Type;
+
+typedef struct {
+	volatile uint8_t A1;
+} I2C_Type;
+
+typedef struct {
+	volatile uint32_t CTRL, CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+	volatile uint32_t CR, ES, ERQ;
+} DMA_Type;
+
+typedef struct {
+	volatile uint8_t CHCFG[16];
+} DMAMUX_Type;
+
+#define PORTA    ((PORT_Type *)0x40049000U)
+#define PORTB    ((PORT_Type *)0x4004A000U)
+#define PORTC    ((PORT_Type *)0x4004B000U)
+#define PORTD    ((PORT_Type *)0x4004C000U)
+#define PORTE    ((PORT_Type *)0x4004D000U)
+
+extern GPIO_Type * GPIOA;
+extern GPIO_Type * GPIOB;
+extern GPIO_Type * GPIOC;
+extern GPIO_Type * GPIOD;
+extern GPIO_Type * GPIOE;
+extern FTM_Type * FTM0;
+extern SIM_Type * SIM;
+extern PIT_Type * PIT;
+extern I2C_Type * I2C0;
+extern DWT_Type * DWT;
+extern CoreDebug_Type * CoreDebug;
+extern DMA_Type * DMA0;
+extern DMAMUX_Type * DMAMUX;
+
+#define DWT_CTRL_CYCCNTENA_Msk      1U
+#define CoreDebug_DEMCR_TRCENA_Msk  (1U << 24)
+#define FTM_SYNC_CNTMAX_MASK        0x2U
+#define FTM_SYNC_SWSYNC_MASK        0x80U
+#define FTM_SYNCONF_CNTINC_MASK     0x4U
+#define FTM_SYNCONF_SYNCMODE_MASK   0x80U
+#define FTM_SYNCONF_SWWRBUF_MASK    0x200U
+#define FTM_COMBINE_SYNCEN0_MASK    0x20U
+
+#define FSL_FEATURE_PORT_HAS_DIGITAL_FILTER 1
+
+/*
+ * ******************************************************************
+ * Core (CMSIS):
+ * ******************************************************************
+ */
+
+typedef int IRQn_Type;
+enum { DMA0_IRQn = 0 };
+
+// Tests run single threaded where interrupts are concerned, masking them
+// does nothing. The barrier is a real one for the thread stress tests:
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __set_BASEPRI(uint32_t basepri) { (void)basepri; }
+static inline void __DMB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __DSB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+static inline uint32_t __RBIT(uint32_t value)
+{
+	uint32_t result = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < 32U; i++)
+	{
+		result = (result << 1) | (value & 1U);
+		value >>= 1;
+	}
+
+	return result;
+}
+
+static inline uint32_t __CLZ(uint32_t value)
+{
+	return value ? (uint32_t)__builtin_clz(value) : 32U;
+}
+
+static inline uint32_t __ROR(uint32_t value, uint32_t shift)
+{
+	shift %= 32U;
+
+	return shift ? ((value >> shift) | (value << (32U - shift))) : value;
+}
+
+// WFI is left to each test, the scheduler test jumps to the next event:
+#ifndef __WFI
+static inline void __WFI(void) {}
+#endif
+
+static inline void NVIC_EnableIRQ(IRQn_Type irq) { (void)irq; }
+static inline void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) { (void)irq; (void)priority; }
+static inline void NVIC_ClearPendingIRQ(IRQn_Type irq) { (void)irq; }
+
+/*
+ * ******************************************************************
+ * Clock, port and GPIO drivers:
+ * ******************************************************************
+ */
+
+typedef enum {
+	kCLOCK_PortA, kCLOCK_PortB, kCLOCK_PortC, kCLOCK_PortD, kCLOCK_PortE
+} clock_ip_name_t;
+
+typedef enum { kCLOCK_BusClk, kCLOCK_CoreSysClk } clock_name_t;
+
+void CLOCK_EnableClock(clock_ip_name_t name);
+uint32_t CLOCK_GetFreq(clock_name_t name);
+
+typedef enum { kPORT_PullDisable, kPORT_PullDown, kPORT_PullUp } port_pull_t;
+enum { kPORT_FastSlewRate, kPORT_SlowSlewRate };
+enum { kPORT_PassiveFilterDisable, kPORT_PassiveFilterEnable };
+enum { kPORT_OpenDrainDisable, kPORT_OpenDrainEnable };
+enum { kPORT_LowDriveStrength, kPORT_HighDriveStrength };
+enum { kPORT_UnlockRegister, kPORT_LockRegister };
+
+typedef enum {
+	kPORT_PinDisabledOrAnalog, kPORT_MuxAsGpio, kPORT_MuxAlt2, kPORT_MuxAlt3,
+	kPORT_MuxAlt4, kPORT_MuxAlt5
+} port_mux_t;
+
+typedef struct {
+	uint16_t pullSelect;
+	uint16_t slewRate;
+	uint16_t passiveFilterEnable;
+	uint16_t openDrainEnable;
+	uint16_t driveStrength;
+	uint16_t mux;
+	uint16_t lockRegister;
+} port_pin_config_t;
+
+typedef enum {
+	kPORT_InterruptOrDMADisabled, kPORT_DMARisingEdge, kPORT_DMAFallingEdge,
+	kPORT_InterruptLogicZero, kPORT_InterruptRisingEdge,
+	kPORT_InterruptFallingEdge, kPORT_InterruptEitherEdge
+} port_interrupt_t;
+
+typedef enum { kPORT_BusClock, kPORT_LpoClock } port_digital_filter_clock_source_t;
+
+typedef struct {
+	uint32_t digitalFilterWidth;
+	port_digital_filter_clock_source_t clockSource;
+} port_digital_filter_config_t;
+
+void PORT_SetPinConfig(PORT_Type * base, uint32_t pin, const port_pin_config_t * config);
+void PORT_SetPinMux(PORT_Type * base, uint32_t pin, port_mux_t mux);
+void PORT_SetPinInterruptConfig(PORT_Type * base, uint32_t pin, port_interrupt_t config);
+void PORT_EnablePinsDigitalFilter(PORT_Type * base, uint32_t mask, bool enable);
+void PORT_SetDigitalFilterConfig(PORT_Type * base, const port_digital_filter_config_t * config);
+
+typedef enum { kGPIO_DigitalInput, kGPIO_DigitalOutput } gpio_pin_direction_t;
+
+typedef struct {
+	gpio_pin_direction_t pinDirection;
+	uint8_t outputLogic;
+} gpio_pin_config_t;
+
+void GPIO_PinInit(GPIO_Type * base, uint32_t pin, const gpio_pin_config_t * config);
+uint32_t GPIO_PortGetInterruptFlags(GPIO_Type * base);
+void GPIO_PortClearInterruptFlags(GPIO_Type * base, uint32_t mask);
+uint32_t GPIO_PinRead(GPIO_Type * base, uint32_t pin);
+
+/*
+ * ******************************************************************
+ * PIT driver:
+ * ******************************************************************
+ */
+
+typedef enum { kPIT_Chnl_0, kPIT_Chnl_1, kPIT_Chnl_2, kPIT_Chnl_3 } pit_chnl_t;
+enum { kPIT_TimerInterruptEnable = 1 };
+enum { kPIT_TimerFlag = 1 };
+
+typedef struct {
+	bool enableRunInDebug;
+} pit_config_t;
+
+void PIT_GetDefaultConfig(pit_config_t * config);
+void PIT_Init(PIT_Type * base, const pit_config_t * config);
+void PIT_SetTimerPeriod(PIT_Type * base, pit_chnl_t channel, uint32_t count);
+void PIT_EnableInterrupts(PIT_Type * base, pit_chnl_t channel, uint32_t mask);
+void PIT_DisableInterrupts(PIT_Type * base, pit_chnl_t channel, uint32_t mask);
+void PIT_StartTimer(PIT_Type * base, pit_chnl_t channel);
+void PIT_StopTimer(PIT_Type * base, pit_chnl_t channel);
+uint32_t PIT_GetCurrentTimerCount(PIT_Type * base, pit_chnl_t channel);
+void PIT_ClearStatusFlags(PIT_Type * base, pit_chnl_t channel, uint32_t mask);
+uint32_t PIT_GetStatusFlags(PIT_Type * base, pit_chnl_t channel);
+
+/*
+ * ******************************************************************
+ * I2C driver:
+ * ******************************************************************
+ */
+
+typedef enum { kI2C_Write, kI2C_Read } i2c_direction_t;
+enum { kI2C_TransferDefaultFlag = 0 };
+
+typedef struct {
+	bool enableMaster;
+	uint32_t baudRate_Bps;
+	uint8_t glitchFilterWidth;
+} i2c_master_config_t;
+
+typedef struct {
+	uint32_t flags;
+	uint8_t slaveAddress;
+	i2c_direction_t direction;
+	uint32_t subaddress;
+	uint8_t subaddressSize;
+	uint8_t * volatile data;
+	volatile size_t dataSize;
+} i2c_master_transfer_t;
+
+typedef struct _i2c_master_handle i2c_master_handle_t;
+typedef void (*i2c_master_transfer_callback_t)(I2C_Type * base,
+		i2c_master_handle_t * handle, status_t status, void * userData);
+
+struct _i2c_master_handle {
+	int state;
+};
+
+void I2C_MasterGetDefaultConfig(i2c_master_config_t * config);
+void I2C_MasterInit(I2C_Type * base, const i2c_master_config_t * config, uint32_t clock);
+status_t I2C_MasterTransferBlocking(I2C_Type * base, i2c_master_transfer_t * xfer);
+void I2C_MasterTransferCreateHandle(I2C_Type * base, i2c_master_handle_t * handle,
+		i2c_master_transfer_callback_t callback, void * userData);
+status_t I2C_MasterTransferNonBlocking(I2C_Type * base, i2c_master_handle_t * handle,
+		i2c_master_transfer_t * xfer);
+
+// Transfers started with I2C_MasterTransferNonBlocking(), the last one:
+extern uint32_t g_stub_i2c_started;
+extern i2c_master_transfer_t g_stub_i2c_last;
+
+/*
+ * ******************************************************************
+ * eDMA and DMAMUX drivers:
+ * ******************************************************************
+ */
+
+typedef enum {
+	kEDMA_TransferSize1Bytes, kEDMA_TransferSize2Bytes, kEDMA_TransferSize4Bytes
+} edma_transfer_size_t;
+
+typedef struct {
+	uint32_t srcAddr;
+	uint32_t destAddr;
+	edma_transfer_size_t srcTransferSize;
+	edma_transfer_size_t destTransferSize;
+	int16_t srcOffset;
+	int16_t destOffset;
+	uint32_t minorLoopBytes;
+	uint32_t majorLoopCounts;
+} edma_transfer_config_t;
+
+typedef struct {
+	bool enableContinuousLinkMode;
+	bool enableHaltOnError;
+	bool enableRoundRobinArbitration;
+	bool enableDebugMode;
+} edma_config_t;
+
+typedef enum { kEDMA_LinkNone, kEDMA_MinorLink, kEDMA_MajorLink } edma_channel_link_type_t;
+enum { kEDMA_DoneFlag = 1, kEDMA_ErrorFlag = 2, kEDMA_InterruptFlag = 4 };
+enum { kEDMA_ErrorInterruptEnable = 1, kEDMA_MajorInterruptEnable = 2, kEDMA_HalfInterruptEnable = 4 };
+typedef enum { kDmaRequestMux0FTM0Channel7 = 27, kDmaRequestMux0AlwaysOn63 = 63 } dma_request_source_t;
+
+void EDMA_GetDefaultConfig(edma_config_t * config);
+void EDMA_Init(DMA_Type * base, const edma_config_t * config);
+void EDMA_ResetChannel(DMA_Type * base, uint32_t channel);
+void EDMA_SetTransferConfig(DMA_Type * base, uint32_t channel,
+		const edma_transfer_config_t * config, void * next);
+void EDMA_SetChannelLink(DMA_Type * base, uint32_t channel,
+		edma_channel_link_type_t type, uint32_t linked);
+void EDMA_EnableChannelInterrupts(DMA_Type * base, uint32_t channel, uint32_t mask);
+void EDMA_EnableAutoStopRequest(DMA_Type * base, uint32_t channel, bool enable);
+void EDMA_EnableChannelRequest(DMA_Type * base, uint32_t channel);
+void EDMA_DisableChannelRequest(DMA_Type * base, uint32_t channel);
+uint32_t EDMA_GetRemainingMajorLoopCount(DMA_Type * base, uint32_t channel);
+void EDMA_ClearChannelStatusFlags(DMA_Type * base, uint32_t channel, uint32_t mask);
+uint32_t EDMA_GetChannelStatusFlags(DMA_Type * base, uint32_t channel);
+
+void DMAMUX_Init(DMAMUX_Type * base);
+void DMAMUX_SetSource(DMAMUX_Type * base, uint32_t channel, uint32_t source);
+void DMAMUX_EnableChannel(DMAMUX_Type * base, uint32_t channel);
+void DMAMUX_DisableChannel(DMAMUX_Type * base, uint32_t channel);
+
+// Status flags and major loops left of every channel, set by the tests:
+extern uint32_t g_stub_edma_flags[16];
+extern uint32_t g_stub_edma_remaining[16];
+
+#endif /* SDK_STUBS_H_ */
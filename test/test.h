@@ -0,0 +1,80 @@
+/*
+ * @file     test.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Minimal check macros and a repeatable noise source for the host
+ *           tests. Each test is a single program that prints its figures,
+ *           checks them and returns non-zero if any check failed.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+static uint32_t g_test_checks = 0;
+static uint32_t g_test_failures = 0;
+static uint32_t g_test_seed = 1U;
+
+/*
+ * Checks a condition, printing the message and where it failed if false.
+ */
+#define TEST_CHECK(cond, ...)                                              \
+	do {                                                                   \
+		g_test_checks++;                                                   \
+		if (!(cond))                                                       \
+		{                                                                  \
+			g_test_failures++;                                             \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);                    \
+			printf(__VA_ARGS__);                                           \
+			printf("\n");                                                  \
+		}                                                                  \
+	} while (0)
+
+/*
+ * @brief: Restarts the noise source, so each scenario sees the same noise.
+ */
+static inline void test_seed(uint32_t seed)
+{
+	g_test_seed = seed ? seed : 1U;
+}
+
+/*
+ * @brief: Uniform noise in [-1, 1], the same sequence on every host
+ *         (xorshift32, not the C library rand()).
+ */
+static inline double test_noise(void)
+{
+	g_test_seed ^= g_test_seed << 13;
+	g_test_seed ^= g_test_seed >> 17;
+	g_test_seed ^= g_test_seed << 5;
+
+	return ((double)g_test_seed / 2147483647.5) - 1.0;
+}
+
+/*
+ * @brief: Uniform integer in [0, range).
+ */
+static inline uint32_t test_rand(uint32_t range)
+{
+	g_test_seed ^= g_test_seed << 13;
+	g_test_seed ^= g_test_seed >> 17;
+	g_test_seed ^= g_test_seed << 5;
+
+	return g_test_seed % range;
+}
+
+/*
+ * @brief: Prints the totals. Returns the exit status of the test.
+ */
+static inline int test_report(void)
+{
+	printf("%u checks, %u failed\n", g_test_checks, g_test_failures);
+
+	return (0U == g_test_failures) ? 0 : 1;
+}
+
+#endif /* TEST_H_ */
@@ -0,0 +1,137 @@
+/*
+ * @file     test_attitude.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host replay of the attitude filter on a synthetic trace: the
+ *           sensor pitched 30 deg about X, tilted to 40 deg at 10 deg/s,
+ *           with a gyro bias, accelerometer noise and periodic bumps.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_attitude.c fast_math.c -lm
+ *               -o test_attitude && ./test_attitude
+ */
+
+#include <math.h>
+#include "test.h"
+#include "attitude.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SIM_RATE_HZ   200U
+#define SIM_DT        (1.0f / SIM_RATE_HZ)
+#define SIM_SECONDS   60U
+// Gyro bias left after calibration, rad/s:
+#define SIM_BIAS      0.02f
+// Accelerometer noise, g peak:
+#define SIM_NOISE     0.05f
+// A 0.6 g bump every 250 ms:
+#define SIM_BUMP      0.6f
+#define SIM_BUMP_EVERY 50U
+#define DEG_RAD       (1.0f / ATTITUDE_RAD_2_DEG)
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: After 30 s, the filter angle must stay within a fraction of a
+ *         degree of the true one, well below the raw accelerometer angle,
+ *         and the integral term must have learned the gyro bias. The peak
+ *         error depends on the noise sequence (0.31 to 0.57 deg over a few
+ *         seeds), the RMS error much less.
+ */
+static void test_tilt(void)
+{
+	float acc[3] = {0};
+	float gyr[3] = {0};
+	float angle = 30.0f * DEG_RAD;
+	float rate = 0.0f;
+	float noise = 0.0f;
+	float err = 0.0f;
+	float raw_err = 0.0f;
+	float max_err = 0.0f;
+	float max_raw = 0.0f;
+	double sum_sq = 0.0;
+	uint32_t n = 0;
+	float t = 0.0f;
+	uint32_t i = 0;
+
+	test_seed(38U);
+	for (i = 0; i < (SIM_RATE_HZ * SIM_SECONDS); i++)
+	{
+		t = i * SIM_DT;
+		rate = ((t > 20.0f) && (t < 21.0f)) ? (10.0f * DEG_RAD) : 0.0f;
+		angle += rate * SIM_DT;
+
+		noise = SIM_NOISE * (float)test_noise();
+		acc[0] = 0.0f;
+		acc[1] = sinf(angle) + noise;
+		acc[2] = cosf(angle) - noise;
+		if (0U == (i % SIM_BUMP_EVERY))
+		{
+			acc[2] += SIM_BUMP;
+		}
+		gyr[0] = rate + SIM_BIAS;
+
+		if (0U == i)
+		{
+			attitude_reset(acc);
+		}
+		attitude_update(gyr, acc, SIM_DT);
+
+		if (t > 30.0f)
+		{
+			err = fabsf(attitude_get_angle() - (angle * ATTITUDE_RAD_2_DEG));
+			raw_err = fabsf((atan2f(acc[1], sqrtf((acc[0] * acc[0]) + (acc[2] * acc[2]))) -
+					angle) * ATTITUDE_RAD_2_DEG);
+			max_err = (err > max_err) ? err : max_err;
+			max_raw = (raw_err > max_raw) ? raw_err : max_raw;
+			sum_sq += err * err;
+			n++;
+		}
+	}
+
+	printf("Tilt 30 -> 40 deg: after 30 s error %.3f deg RMS, %.3f max (raw accel %.2f max),"
+			" learned bias %.4f rad/s of %.4f\n", sqrt(sum_sq / n), max_err, max_raw,
+			-g_integral[0], SIM_BIAS);
+	TEST_CHECK(sqrt(sum_sq / n) <= 0.2, "RMS error %.3f deg", sqrt(sum_sq / n));
+	TEST_CHECK(max_err <= 0.75f, "max error %.3f deg", max_err);
+	TEST_CHECK(fabsf(-g_integral[0] - SIM_BIAS) < (0.1f * SIM_BIAS),
+			"learned bias %.4f", -g_integral[0]);
+}
+
+/*
+ * @brief: A reset from any reading points gravity along it, normalized.
+ */
+static void test_reset(void)
+{
+	float acc[3] = {0.3f, -0.5f, -0.8f};
+	float gravity[3] = {0};
+	float norm = sqrtf((acc[0] * acc[0]) + (acc[1] * acc[1]) + (acc[2] * acc[2]));
+	uint32_t i = 0;
+
+	attitude_reset(acc);
+	attitude_get_gravity(gravity);
+	for (i = 0; i < 3U; i++)
+	{
+		TEST_CHECK(fabsf(gravity[i] - (acc[i] / norm)) < 1e-4f, "gravity[%u] %.4f, expected %.4f",
+				i, gravity[i], acc[i] / norm);
+	}
+	TEST_CHECK(attitude_ready(), "not ready after a reset");
+}
+
+int main(void)
+{
+	test_tilt();
+	test_reset();
+
+	return test_report();
+}
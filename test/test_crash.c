@@ -0,0 +1,307 @@
+/*
+ * @file     test_crash.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host replays of the crash recorder on synthetic rides: quiet
+ *           riding, a rough road, an impact and a slow fall, saved to a
+ *           simulated EEPROM that can refuse pages like a busy one.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_crash.c fast_math.c -lm
+ *               -o test_crash && ./test_crash
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "crash.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define EEPROM_SIZE   4096U
+// Samples of each ride, 15 s at 200 Hz, and where the event starts:
+#define SIM_SAMPLES   3000U
+#define SIM_EVENT     1000U
+
+typedef enum{
+	RIDE_QUIET,
+	RIDE_IMPACT,
+	RIDE_FALL,
+	RIDE_ROUGH
+}ride_t;
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static uint8_t g_eeprom[EEPROM_SIZE];
+static uint32_t g_eeprom_writes = 0;
+static uint32_t g_eeprom_fail_every = 0;    // Refuses every n-th write.
+static uint32_t g_eeprom_fail_after = 0;    // Refuses all after n writes.
+static uint32_t g_page_crossings = 0;
+static crash_frame_t g_event[CRASH_FRAMES];
+
+/*
+ * ******************************************************************
+ * EEPROM and IMU stand-ins:
+ * ******************************************************************
+ */
+
+uint32_t RTC_mod_write_mem(mem_data_t * data)
+{
+	g_eeprom_writes++;
+	if ((g_eeprom_fail_every && (0U == (g_eeprom_writes % g_eeprom_fail_every))) ||
+		(g_eeprom_fail_after && (g_eeprom_writes > g_eeprom_fail_after)))
+	{
+		return kStatus_Fail;
+	}
+
+	// A page write wraps around within its page on the real EEPROM:
+	if (((data->address % MEM_PAGE_SIZE) + data->size) > MEM_PAGE_SIZE)
+	{
+		g_page_crossings++;
+	}
+	memcpy(&g_eeprom[data->address], data->data_array, data->size);
+
+	return kStatus_Success;
+}
+
+uint32_t RTC_mod_read_mem(mem_data_t * data)
+{
+	memcpy(data->data_array, &g_eeprom[data->address], data->size);
+
+	return kStatus_Success;
+}
+
+void MPU6050_suspend(void) { }
+void MPU6050_resume(void) { }
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Rides SIM_SAMPLES samples with the event given from SIM_EVENT on,
+ *         calling crash_process() every 100 ms as the main loop would, and
+ *         finishing any write left. Returns the sample of the trigger, or
+ *         -1 if there was none.
+ */
+static int32_t sim_ride(ride_t ride)
+{
+	float acc[3] = {0};
+	float gyr[3] = {0};
+	float gravity[3] = {0};
+	float tilt = 0.0f;
+	int32_t trigger = -1;
+	uint32_t i = 0;
+
+	memset(g_eeprom, 0xFF, sizeof(g_eeprom));
+	memset(&g_stats, 0, sizeof(g_stats));
+	g_eeprom_writes = 0;
+	g_page_crossings = 0;
+	crash_init();
+	test_seed(44U);
+
+	for (i = 0; i < SIM_SAMPLES; i++)
+	{
+		acc[0] = 0.02f * (float)test_noise();
+		acc[1] = 0.05f * (float)test_noise();
+		acc[2] = 1.0f + (0.1f * (float)test_noise());
+		gyr[0] = 0.05f * (float)test_noise();
+		gyr[1] = 0.1f * sinf(i * 0.05f);
+		gyr[2] = 0.02f * (float)test_noise();
+		tilt = 0.0f;
+
+		if ((RIDE_IMPACT == ride) && (i >= SIM_EVENT) && (i < (SIM_EVENT + 10U)))
+		{
+			acc[0] = 3.0f;
+			acc[1] = -5.0f;
+			acc[2] = 2.0f;
+			gyr[0] = 6.0f;
+		}
+		else if ((RIDE_FALL == ride) && (i >= SIM_EVENT))
+		{
+			// Onto its side in 300 ms, and left lying there:
+			tilt = 1.4f * fminf((i - SIM_EVENT) / 60.0f, 1.0f);
+			gyr[0] = (i < (SIM_EVENT + 60U)) ? (1.4f / 0.3f) : 0.0f;
+		}
+		else if ((RIDE_ROUGH == ride) && (i >= SIM_EVENT) && (i < (SIM_EVENT + 100U)))
+		{
+			acc[2] = 1.0f + (0.8f * (float)test_noise());
+		}
+
+		gravity[0] = 0.0f;
+		gravity[1] = sinf(tilt);
+		gravity[2] = cosf(tilt);
+		crash_add_sample(i * 5U, acc, gyr, gravity);
+
+		if ((trigger < 0) && g_stats.triggers)
+		{
+			trigger = (int32_t)i;
+		}
+		if (0U == (i % 20U))
+		{
+			crash_process();
+		}
+	}
+	while (crash_process())
+	{
+	}
+
+	return trigger;
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Riding, even on a rough road, triggers nothing.
+ */
+static void test_no_trigger(void)
+{
+	crash_header_t header;
+
+	TEST_CHECK(sim_ride(RIDE_QUIET) < 0, "quiet ride triggered");
+	TEST_CHECK(sim_ride(RIDE_ROUGH) < 0, "rough road triggered");
+	TEST_CHECK(!crash_read_header(&header), "event stored without a trigger");
+	TEST_CHECK(CRASH_ARMED == crash_get_state(), "not armed after riding");
+	printf("Quiet and rough rides: no trigger\n");
+}
+
+/*
+ * @brief: An impact is stored whole, with the samples around the trigger,
+ *         and the recorder re-arms once the bicycle rides on.
+ */
+static void test_impact(void)
+{
+	crash_header_t header;
+	crash_frame_t * at = NULL;
+	int32_t trigger = sim_ride(RIDE_IMPACT);
+	uint32_t frames = crash_read_event(&header, g_event);
+
+	at = &g_event[header.pre_frames - 1U];
+	printf("Impact: trigger at sample %d, %u frames (%u before), %u bytes, peak %u mg,"
+			" frame at the trigger %d %d %d mg\n", trigger, frames, header.pre_frames,
+			header.payload_size, header.peak_acc, at->value[0], at->value[1], at->value[2]);
+	TEST_CHECK(SIM_EVENT == trigger, "impact triggered at %d", trigger);
+	TEST_CHECK(CRASH_FRAMES == frames, "%u frames stored", frames);
+	TEST_CHECK((CRASH_PRE_SAMPLES / CRASH_DECIMATION) == header.pre_frames, "%u frames before",
+			header.pre_frames);
+	TEST_CHECK(CRASH_CAUSE_IMPACT == header.cause, "cause %u", header.cause);
+	TEST_CHECK((header.peak_acc > 6100U) && (header.peak_acc < 6250U), "peak %u mg",
+			header.peak_acc);
+	TEST_CHECK((SIM_EVENT * 5U) == header.timestamp, "timestamp %u ms", header.timestamp);
+	TEST_CHECK((1U == header.count) && (1U == crash_get_stats().saved), "event not counted");
+	TEST_CHECK(0U == g_page_crossings, "%u writes across a page", g_page_crossings);
+	TEST_CHECK(CRASH_ARMED == crash_get_state(), "not re-armed after the impact");
+
+	// The frames around the trigger hold the impact, averaged in pairs:
+	TEST_CHECK(abs(g_event[header.pre_frames].value[1] + 5000) < 60, "AcY %d mg in the impact",
+			g_event[header.pre_frames].value[1]);
+}
+
+/*
+ * @brief: A fall triggers after 1 s past 60 deg, and the recorder stays
+ *         disarmed while the bicycle lies on its side.
+ */
+static void test_fall(void)
+{
+	crash_header_t header;
+	int32_t trigger = sim_ride(RIDE_FALL);
+	uint32_t frames = crash_read_event(&header, g_event);
+
+	printf("Fall: trigger at sample %d, %u frames, cause %u\n", trigger, frames, header.cause);
+	TEST_CHECK((trigger >= (int32_t)(SIM_EVENT + 43U + CRASH_TILT_SAMPLES)) &&
+			(trigger <= (int32_t)(SIM_EVENT + 46U + CRASH_TILT_SAMPLES)),
+			"fall triggered at %d", trigger);
+	TEST_CHECK((CRASH_FRAMES == frames) && (CRASH_CAUSE_FALL == header.cause), "fall not stored");
+	TEST_CHECK(CRASH_REARMING == crash_get_state(), "re-armed lying on its side");
+}
+
+/*
+ * @brief: An EEPROM refusing every third page still gets the same event,
+ *         only later. One that stops answering before the header leaves no
+ *         valid event behind.
+ */
+static void test_busy_eeprom(void)
+{
+	static crash_frame_t reference[CRASH_FRAMES];
+	crash_header_t header;
+	uint32_t writes = 0;
+	uint32_t frames = 0;
+
+	sim_ride(RIDE_IMPACT);
+	crash_read_event(&header, reference);
+	writes = g_eeprom_writes;
+
+	g_eeprom_fail_every = 3U;
+	sim_ride(RIDE_IMPACT);
+	g_eeprom_fail_every = 0U;
+	frames = crash_read_event(&header, g_event);
+	printf("Busy EEPROM: %u writes instead of %u, %u frames\n", g_eeprom_writes, writes, frames);
+	TEST_CHECK(CRASH_FRAMES == frames, "%u frames with a busy EEPROM", frames);
+	TEST_CHECK(0 == memcmp(reference, g_event, sizeof(reference)), "event differs");
+
+	g_eeprom_fail_after = 10U;
+	sim_ride(RIDE_IMPACT);
+	g_eeprom_fail_after = 0U;
+	TEST_CHECK(!crash_read_header(&header), "header valid after an interrupted save");
+	TEST_CHECK(0U == crash_read_event(&header, g_event), "event read after an interrupted save");
+	TEST_CHECK(1U == crash_get_stats().dropped, "dropped %u", crash_get_stats().dropped);
+}
+
+/*
+ * @brief: The delta code round trip is exact, escapes included.
+ */
+static void test_codec(void)
+{
+	static crash_frame_t in[CRASH_FRAMES];
+	static crash_frame_t out[CRASH_FRAMES];
+	static uint8_t code[CRASH_PAYLOAD_SIZE];
+	uint32_t used = 0;
+	uint32_t encoded = 0;
+	uint32_t decoded = 0;
+	uint32_t i = 0;
+	uint32_t c = 0;
+
+	test_seed(440U);
+	for (i = 0; i < CRASH_FRAMES; i++)
+	{
+		for (c = 0; c < CRASH_CHANNELS; c++)
+		{
+			in[i].value[c] = (0U == (i % 7U)) ? (int16_t)(test_rand(65536U) - 32768) :
+					(int16_t)(1000.0f * sinf((i * 0.1f) + c));
+		}
+	}
+
+	encoded = crash_encode(in, CRASH_FRAMES, code, sizeof(code), &used);
+	decoded = crash_decode(code, used, out, CRASH_FRAMES);
+	printf("Codec: %u frames in %u bytes, %u decoded\n", encoded, used, decoded);
+	TEST_CHECK(decoded == encoded, "%u decoded of %u", decoded, encoded);
+	TEST_CHECK(0 == memcmp(in, out, encoded * sizeof(crash_frame_t)), "round trip differs");
+}
+
+int main(void)
+{
+	test_no_trigger();
+	test_impact();
+	test_fall();
+	test_busy_eeprom();
+	test_codec();
+
+	return test_report();
+}
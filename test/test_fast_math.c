@@ -0,0 +1,118 @@
+/*
+ * @file     test_fast_math.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host accuracy checks of the math kernels against the C library,
+ *           in double precision. On the host the square root falls back to
+ *           sqrtf(), so only its edge cases are checked.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_fast_math.c -lm
+ *               -o test_fast_math && ./test_fast_math
+ */
+
+#include <math.h>
+#include "test.h"
+#include "fast_math.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define ANGLES        2000000U
+// Bound stated in fast_math.h:
+#define ATAN2_BOUND   1.2e-5
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Sweeps the whole circle at radii from the accelerometer noise
+ *         floor to well past full scale, and checks the worst error.
+ */
+static void test_atan2(void)
+{
+	static const double radii[] = {1e-3, 1.0, 3.0, 9.81, 1e4};
+	double max_err = 0.0;
+	double worst = 0.0;
+	double theta = 0.0;
+	double err = 0.0;
+	float x = 0.0f;
+	float y = 0.0f;
+	uint32_t i = 0;
+	uint32_t r = 0;
+
+	for (r = 0; r < (sizeof(radii) / sizeof(radii[0])); r++)
+	{
+		for (i = 0; i < ANGLES; i++)
+		{
+			theta = -M_PI + ((2.0 * M_PI * i) / ANGLES);
+			y = (float)(radii[r] * sin(theta));
+			x = (float)(radii[r] * cos(theta));
+
+			// Against the exact angle of the float inputs, wrapped at +-pi:
+			err = fabs((double)fast_math_atan2(y, x) - atan2((double)y, (double)x));
+			err = (err > M_PI) ? ((2.0 * M_PI) - err) : err;
+			if (err > max_err)
+			{
+				max_err = err;
+				worst = theta;
+			}
+		}
+	}
+
+	printf("atan2: max error %.2e rad (%.5f deg) over %u angles x %u radii, at %.4f rad\n",
+			max_err, max_err * (180.0 / M_PI), ANGLES,
+			(uint32_t)(sizeof(radii) / sizeof(radii[0])), worst);
+	TEST_CHECK(max_err <= ATAN2_BOUND, "atan2 error %.2e over the bound", max_err);
+
+	// Axes, diagonals and the origin:
+	TEST_CHECK(0.0f == fast_math_atan2(0.0f, 0.0f), "atan2(0, 0) not 0");
+	TEST_CHECK(fabsf(fast_math_atan2(0.0f, 1.0f)) <= ATAN2_BOUND, "atan2(0, 1)");
+	TEST_CHECK(fabsf(fast_math_atan2(1.0f, 0.0f) - FAST_MATH_PI_2) <= ATAN2_BOUND, "atan2(1, 0)");
+	TEST_CHECK(fabsf(fast_math_atan2(-1.0f, 0.0f) + FAST_MATH_PI_2) <= ATAN2_BOUND, "atan2(-1, 0)");
+	TEST_CHECK(fabsf(fabsf(fast_math_atan2(0.0f, -1.0f)) - FAST_MATH_PI) <= ATAN2_BOUND,
+			"atan2(0, -1)");
+	TEST_CHECK(fabsf(fast_math_atan2(-2.0f, -2.0f) + (0.75f * FAST_MATH_PI)) <= ATAN2_BOUND,
+			"atan2(-2, -2)");
+}
+
+/*
+ * @brief: Square root edge cases, and a sweep against the C library.
+ */
+static void test_sqrt(void)
+{
+	double max_rel = 0.0;
+	double rel = 0.0;
+	float x = 0.0f;
+	uint32_t i = 0;
+
+	test_seed(34U);
+	for (i = 0; i < ANGLES; i++)
+	{
+		x = (float)(1e4 * (test_noise() + 1.0));
+		rel = fabs(fast_math_sqrt(x) - sqrt((double)x)) / sqrt((double)x);
+		max_rel = (rel > max_rel) ? rel : max_rel;
+	}
+
+	printf("sqrt: max relative error %.2e\n", max_rel);
+	TEST_CHECK(max_rel <= 6e-8, "sqrt relative error %.2e", max_rel);
+	TEST_CHECK(0.0f == fast_math_sqrt(-4.0f), "sqrt(-4) not 0");
+	TEST_CHECK(0.0f == fast_math_sqrt(0.0f), "sqrt(0) not 0");
+	TEST_CHECK(3.0f == fast_math_sqrt(9.0f), "sqrt(9) not 3");
+}
+
+int main(void)
+{
+	test_atan2();
+	test_sqrt();
+
+	return test_report();
+}
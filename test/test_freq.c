@@ -0,0 +1,387 @@
+/*
+ * @file     test_freq.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host replays of the wheel pulse input. A simulated wheel turns
+ *           with a speed profile and fires capture_values() at each turn,
+ *           with the time base set to the exact edge time.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_freq.c soft_timer.c
+ *               spsc_ring.c test/stubs/host_timebase.c
+ *               test/stubs/sdk_stubs.c -lm -o test_freq && ./test_freq
+ */
+
+#include <math.h>
+#include "test.h"
+#include "host_timebase.h"
+#include "freq.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Replay step, and how often the display would read the speed:
+#define SIM_DT        0.001
+#define SIM_READ_DT   0.01
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+typedef double (*speed_profile_t)(double t);
+
+static double g_sim_time = 0.0;
+static double g_sim_pos = 0.0;
+static double g_sim_last_edge = 0.0;
+static double g_sim_last_period = 0.0;
+static double g_sim_next_check = 0.0;
+static double g_decel = 0.0;
+static double g_accel_sim = 0.0;
+static double g_v0 = 0.0;
+static double g_sim_jitter = 0.0;
+
+/*
+ * ******************************************************************
+ * Simulated wheel:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Clears the capture state, as after a power up.
+ */
+static void sim_reset(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < FREQ_CHANNELS; i++)
+	{
+		g_inputs[i].active    = false;
+		g_inputs[i].period    = 0;
+		g_inputs[i].last_edge = 0;
+		freq_clear_diagnostics((freq_channel_t)i);
+	}
+	freq_history_reset();
+	spsc_ring_flush(&g_edges);
+	g_log_head  = 0;
+	g_log_count = 0;
+
+	g_sim_time = 0.0;
+	g_sim_pos = 0.0;
+	g_sim_last_edge = 0.0;
+	g_sim_last_period = 0.0;
+	g_sim_next_check = FREQ_CHECK_MS / 1000.0;
+	host_timebase_set(0);
+}
+
+/*
+ * @brief: Fires a wheel edge at the given time.
+ */
+static void sim_edge(double t)
+{
+	freq_edge_t edge;
+
+	host_timebase_set_sec(t);
+	capture_values(1U << FREQ_WHEEL_PIN);
+
+	// The main loop takes the edges as they come:
+	while (freq_get_edge(&edge))
+	{
+	}
+}
+
+/*
+ * @brief: Moves the simulation to time t, firing the edges of every turn
+ *         completed on the way and the timeout checks of the soft timer.
+ */
+static void sim_run_to(speed_profile_t speed, double t)
+{
+	double v = 0.0;
+	double step = 0.0;
+
+	while (g_sim_time < t)
+	{
+		v = speed(g_sim_time);
+		step = v * SIM_DT;
+		if ((g_sim_pos + step) >= FREQ_WHEEL_CIRC)
+		{
+			// Edge time within the step, the speed is taken as constant:
+			double edge = g_sim_time + ((FREQ_WHEEL_CIRC - g_sim_pos) / v);
+
+			sim_edge(edge + (g_sim_jitter * test_noise()));
+			g_sim_last_period = edge - g_sim_last_edge;
+			g_sim_last_edge = edge;
+			g_sim_pos += step - FREQ_WHEEL_CIRC;
+		}
+		else
+		{
+			g_sim_pos += step;
+		}
+		g_sim_time += SIM_DT;
+
+		if (g_sim_time >= g_sim_next_check)
+		{
+			host_timebase_set_sec(g_sim_next_check);
+			no_gpio_pit_callback(NULL);
+			g_sim_next_check += FREQ_CHECK_MS / 1000.0;
+		}
+	}
+	host_timebase_set_sec(g_sim_time);
+}
+
+/*
+ * ******************************************************************
+ * Speed profiles:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Cruise at g_v0 for 10 s, then brake at g_decel to a standstill.
+ */
+static double profile_brake(double t)
+{
+	double v = g_v0;
+
+	if (t > 10.0)
+	{
+		v = g_v0 - (g_decel * (t - 10.0));
+	}
+
+	return (v > 0.0) ? v : 0.0;
+}
+
+/*
+ * @brief: Starts at g_v0 and changes speed at g_accel_sim, never below
+ *         walking pace.
+ */
+static double profile_accel(double t)
+{
+	double v = g_v0 + (g_accel_sim * t);
+
+	return (v > 1.0) ? v : 1.0;
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Brakes to a standstill from several speeds and measures how long
+ *         the speed keeps being shown after the wheel stopped. Before, the
+ *         last speed was held until the 5 s timeout after the last edge.
+ */
+static void test_zero_speed(void)
+{
+	static const double speeds[] = {40.0, 25.0, 12.0, 5.0};
+	static const double decels[] = {2.5, 6.0};
+	uint32_t i = 0;
+	uint32_t j = 0;
+
+	printf("Zero-speed detection, braking to a stop:\n");
+	for (j = 0; j < (sizeof(decels) / sizeof(decels[0])); j++)
+	{
+		for (i = 0; i < (sizeof(speeds) / sizeof(speeds[0])); i++)
+		{
+			double t_stop = 0.0;
+			double t_zero = -1.0;
+			double t_hold = 0.0;
+			double t = 0.0;
+			double f = 0.0;
+			bool bounded = true;
+
+			g_v0 = speeds[i] / 3.6;
+			g_decel = decels[j];
+			t_stop = 10.0 + (g_v0 / g_decel);
+			sim_reset();
+
+			for (t = SIM_READ_DT; t < (t_stop + 10.0); t += SIM_READ_DT)
+			{
+				sim_run_to(profile_brake, t);
+				f = freq_get_freq();
+
+				// Between edges the speed never exceeds a turn per elapsed time:
+				if ((f > 0.0f) && (t > g_sim_last_edge) &&
+					(f > (1.0001 / (t - g_sim_last_edge))))
+				{
+					bounded = false;
+				}
+				if ((t > t_stop) && (t_zero < 0.0) && (f <= 0.0f))
+				{
+					t_zero = t;
+				}
+			}
+
+			// The old code held the speed until the timeout after the last edge:
+			t_hold = (g_sim_last_edge + 5.0) - t_stop;
+			printf("  %4.1f km/h at %.1f m/s^2: last turn %.2f s, zero %.2f s after the"
+					" stop (was %.2f s)\n", speeds[i], decels[j], g_sim_last_period,
+					t_zero - t_stop, t_hold);
+
+			TEST_CHECK(t_zero > 0.0, "%.1f km/h: speed never went to zero", speeds[i]);
+			TEST_CHECK((t_zero - g_sim_last_edge) <=
+					((FREQ_STOP_PERIODS * g_sim_last_period) + (2.0 * SIM_READ_DT)),
+					"%.1f km/h: zero %.2f s after the last edge, over %u periods",
+					speeds[i], t_zero - g_sim_last_edge, FREQ_STOP_PERIODS);
+			TEST_CHECK(bounded, "%.1f km/h: speed above a turn per elapsed time", speeds[i]);
+		}
+	}
+}
+
+/*
+ * @brief: Constant acceleration pulse trains. Once the window is full, the
+ *         least-squares slope must match the acceleration of the wheel.
+ */
+static void test_accel(void)
+{
+	static const double accels[] = {0.25, 0.5, 1.0, 2.0, -0.5, -1.0};
+	uint32_t i = 0;
+
+	printf("Acceleration from wheel periods:\n");
+	for (i = 0; i < (sizeof(accels) / sizeof(accels[0])); i++)
+	{
+		double t = 0.0;
+		double err = 0.0;
+		double max_err = 0.0;
+		uint32_t turns = 0;
+		uint32_t last_turns = 0;
+
+		g_v0 = (accels[i] > 0.0) ? 2.0 : 12.0;
+		g_accel_sim = accels[i];
+		sim_reset();
+
+		// Until the speed gets to 2 or 12 m/s, the fit is read after every turn:
+		for (t = SIM_READ_DT; t < 10.0; t += SIM_READ_DT)
+		{
+			sim_run_to(profile_accel, t);
+			turns = g_inputs[FREQ_WHEEL].diag.accepted_edges;
+			if ((turns != last_turns) && (turns > FREQ_ACCEL_WINDOW))
+			{
+				err = fabs(freq_get_accel() - accels[i]);
+				max_err = (err > max_err) ? err : max_err;
+			}
+			last_turns = turns;
+		}
+
+		printf("  %+5.2f m/s^2: %u turns, max error %.1e m/s^2\n",
+				accels[i], turns, max_err);
+		TEST_CHECK(max_err < 0.02, "%+.2f m/s^2: error %.4f", accels[i], max_err);
+	}
+}
+
+/*
+ * @brief: The event log keeps every measured turn with its acceleration,
+ *         and every edge rejected by the glitch filter with its spacing.
+ */
+static void test_log(void)
+{
+	freq_log_t entry;
+	uint32_t spacing = 0;
+	double t = 0.0;
+
+	printf("Wheel event log:\n");
+	g_v0 = 3.0;
+	g_accel_sim = 1.0;
+	sim_reset();
+	freq_set_max_speed(FREQ_MAX_SPEED_KMH);
+	TEST_CHECK(!freq_get_log(0, &entry), "log not empty after reset");
+
+	for (t = SIM_READ_DT; t < 10.0; t += SIM_READ_DT)
+	{
+		sim_run_to(profile_accel, t);
+	}
+
+	// Last turn, as measured:
+	TEST_CHECK(freq_get_log(0, &entry), "no entry after 10 s of turns");
+	spacing = (uint32_t)(g_sim_last_period * TIMEBASE_TICKS_PER_SEC);
+	TEST_CHECK(FREQ_LOG_REVOLUTION == entry.type, "last entry type %u", entry.type);
+	TEST_CHECK((entry.spacing >= (spacing - 1U)) && (entry.spacing <= (spacing + 1U)),
+			"spacing %u, turn took %u", entry.spacing, spacing);
+	TEST_CHECK(fabs(entry.accel - g_accel_sim) < 0.02, "logged accel %.3f", entry.accel);
+	printf("  turn: spacing %u counts, accel %.3f m/s^2\n", entry.spacing, entry.accel);
+
+	// A bounce 5 ms after the last edge is rejected, and logged as such:
+	sim_edge(g_sim_last_edge + 0.005);
+	TEST_CHECK(freq_get_log(0, &entry), "no entry for the rejected edge");
+	TEST_CHECK(FREQ_LOG_REJECTED == entry.type, "bounce entry type %u", entry.type);
+	TEST_CHECK(fabs((entry.spacing / (double)TIMEBASE_TICKS_PER_SEC) - 0.005) < 1e-6,
+			"bounce spacing %u", entry.spacing);
+	TEST_CHECK(0.0f == entry.accel, "bounce accel %.3f", entry.accel);
+	printf("  bounce: spacing %u counts\n", entry.spacing);
+	TEST_CHECK(freq_get_log(1, &entry) && (FREQ_LOG_REVOLUTION == entry.type),
+			"turn before the bounce missing");
+
+	// The ring keeps the last FREQ_LOG_SIZE events only:
+	TEST_CHECK(freq_get_log(FREQ_LOG_SIZE - 1U, &entry), "oldest entry missing");
+	TEST_CHECK(!freq_get_log(FREQ_LOG_SIZE, &entry), "entry beyond the log size");
+
+	freq_set_max_speed(0.0f);
+}
+
+/*
+ * @brief: Slow speed changes, read every 500 ms as the display does, with
+ *         the edges 2 ms early or late at random. The prediction must
+ *         follow the wheel closer than the last period.
+ */
+static void test_predicted(void)
+{
+	static const double accels[] = {0.3, -0.3};
+	static const double starts[] = {1.0, 7.0};
+	uint32_t i = 0;
+
+	printf("Speed between edges, read every 500 ms:\n");
+	for (i = 0; i < (sizeof(accels) / sizeof(accels[0])); i++)
+	{
+		double err_step = 0.0;
+		double err_pred = 0.0;
+		double t = 0.0;
+		double v = 0.0;
+		uint32_t n = 0;
+
+		g_v0 = starts[i];
+		g_accel_sim = accels[i];
+		g_sim_jitter = 0.002;
+		test_seed(30U);
+		sim_reset();
+
+		for (t = 0.5; t < 20.0; t += 0.5)
+		{
+			sim_run_to(profile_accel, t);
+			if (t > 6.0)
+			{
+				v = profile_accel(t);
+				err_step += fabs((freq_get_freq() * FREQ_WHEEL_CIRC) - v);
+				err_pred += fabs((freq_get_predicted_freq() * FREQ_WHEEL_CIRC) - v);
+				n++;
+			}
+		}
+		err_step /= n;
+		err_pred /= n;
+		g_sim_jitter = 0.0;
+
+		printf("  %+.1f m/s^2 from %.0f m/s: mean error %.3f m/s step, %.3f m/s"
+				" predicted\n", accels[i], starts[i], err_step, err_pred);
+		TEST_CHECK(err_pred < (0.6 * err_step), "%+.1f m/s^2: predicted %.3f, step %.3f",
+				accels[i], err_pred, err_step);
+	}
+}
+
+int main(void)
+{
+	soft_timer_init();
+	init_freq();
+
+	test_zero_speed();
+	test_accel();
+	test_log();
+	test_predicted();
+
+	return test_report();
+}
@@ -0,0 +1,252 @@
+/*
+ * @file     test_ftm_speed.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host checks of the gauge driver: speed to channel value
+ *           mapping, needle profiles, and the end of profile handling of
+ *           the eDMA interrupt, driven through the stubbed eDMA flags.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_ftm_speed.c
+ *               test/stubs/sdk_stubs.c -lm -o test_ftm_speed && ./test_ftm_speed
+ *
+ *           The driver casts buffer addresses to the 32-bit eDMA address
+ *           registers, which gcc warns about on a 64-bit host.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "test.h"
+#include "ftm_speed.c"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+extern uint32_t g_stub_edma_flags[16];
+extern uint32_t g_stub_edma_remaining[16];
+
+static uint32_t g_test_profile[FTM_ANIM_STEPS];
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Returns true if the profile goes from `from` to `to` without
+ *         going back, and ends exactly on `to`.
+ */
+static bool profile_ok(const uint32_t * profile, uint32_t steps, uint16_t from, uint16_t to)
+{
+	uint32_t prev = from;
+	uint32_t i = 0;
+
+	for (i = 0; i < steps; i++)
+	{
+		if (((to >= from) && (profile[i] < prev)) || ((to < from) && (profile[i] > prev)))
+		{
+			return false;
+		}
+		prev = profile[i];
+	}
+
+	return (profile[steps - 1U] == to);
+}
+
+/*
+ * @brief: The eDMA finishes the profile running now: DONE and the interrupt
+ *         flag are raised, and the interrupt is taken.
+ */
+static void dma_complete(void)
+{
+	g_stub_edma_remaining[FTM_ANIM_DMA_CHNL] = 0;
+	g_stub_edma_flags[FTM_ANIM_DMA_CHNL] |= kEDMA_DoneFlag | kEDMA_InterruptFlag;
+	DMA0_IRQHandler();
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Speed to channel value: exact on the calibration points, linear
+ *         in between at any speed, never increasing, and clamped at both
+ *         ends of the table.
+ */
+static void test_duty(void)
+{
+	uint16_t duty = 0;
+	uint16_t prev = 0xFFFFU;
+	float expect = 0.0f;
+	float speed = 0.0f;
+	bool monotonic = true;
+	bool linear = true;
+	uint32_t i = 0;
+
+	// Points past a full period are clamped to it (the 0 km/h rest):
+	for (i = 0; i < CAL_POINTS(g_speed_cal); i++)
+	{
+		duty = ftm_speed_duty(g_speed_cal[i].value);
+		expect = (float)((g_speed_cal[i].duty * FTM_SPEED_FULL) / FTM_SPEED_CAL_FULL);
+		expect = (expect > FTM_SPEED_FULL) ? FTM_SPEED_FULL : expect;
+		TEST_CHECK(duty == (uint16_t)expect, "%.0f km/h: %u counts", g_speed_cal[i].value, duty);
+	}
+
+	for (i = 0; i <= 4400; i++)
+	{
+		speed = (float)i / 100.0f;
+		duty = ftm_speed_duty(speed);
+		monotonic &= (duty <= prev);
+		prev = duty;
+
+		// The table drops 10 duty units every 2 km/h:
+		expect = ((260.0f - (5.0f * speed)) * FTM_SPEED_FULL) / FTM_SPEED_CAL_FULL;
+		expect = (expect > FTM_SPEED_FULL) ? FTM_SPEED_FULL : expect;
+		linear &= (fabsf((float)duty - expect) <= 0.5f);
+	}
+	TEST_CHECK(monotonic, "needle goes back as the speed rises");
+	TEST_CHECK(linear, "duty off the calibration line between points");
+
+	printf("Speed to duty: 1 km/h %u, 21.5 km/h %u, 43 km/h %u counts\n",
+			ftm_speed_duty(1.0f), ftm_speed_duty(21.5f), ftm_speed_duty(43.0f));
+	TEST_CHECK(ftm_speed_duty(1.0f) == 4080U, "1 km/h: %u", ftm_speed_duty(1.0f));
+	TEST_CHECK(ftm_speed_duty(21.5f) == 2440U, "21.5 km/h: %u", ftm_speed_duty(21.5f));
+
+	// Past the ends of the table, the needle stays on them:
+	TEST_CHECK(ftm_speed_duty(-5.0f) == ftm_speed_duty(0.0f), "below 0 km/h not clamped");
+	TEST_CHECK(ftm_speed_duty(90.0f) == ftm_speed_duty(44.0f), "above 44 km/h not clamped");
+	TEST_CHECK(ftm_speed_duty(0.0f) == FTM_SPEED_FULL, "0 km/h: %u", ftm_speed_duty(0.0f));
+}
+
+/*
+ * @brief: Both needle profiles end exactly on the destination and never go
+ *         back, whatever the distance and the number of steps. The ease-out
+ *         profile starts faster, to carry on a needle already moving.
+ */
+static void test_profiles(void)
+{
+	static const uint16_t ends[][2] = {
+		{4160, 640}, {640, 4160}, {2000, 2001}, {2001, 2000}, {3000, 3000}, {0, 4096}
+	};
+	static const uint32_t steps[] = {1, 2, 7, FTM_UPDATE_STEPS, FTM_ANIM_STEPS};
+	uint32_t i = 0;
+	uint32_t j = 0;
+
+	for (i = 0; i < (sizeof(ends) / sizeof(ends[0])); i++)
+	{
+		for (j = 0; j < (sizeof(steps) / sizeof(steps[0])); j++)
+		{
+			ftm_speed_ease_profile(g_test_profile, steps[j], ends[i][0], ends[i][1]);
+			TEST_CHECK(profile_ok(g_test_profile, steps[j], ends[i][0], ends[i][1]),
+					"ease %u -> %u in %u steps", ends[i][0], ends[i][1], steps[j]);
+
+			ftm_speed_ease_out_profile(g_test_profile, steps[j], ends[i][0], ends[i][1]);
+			TEST_CHECK(profile_ok(g_test_profile, steps[j], ends[i][0], ends[i][1]),
+					"ease-out %u -> %u in %u steps", ends[i][0], ends[i][1], steps[j]);
+		}
+	}
+
+	// First step of a 640 to 4160 move, from rest and while moving:
+	ftm_speed_ease_profile(g_test_profile, FTM_UPDATE_STEPS, 640, 4160);
+	j = g_test_profile[0] - 640U;
+	ftm_speed_ease_out_profile(g_test_profile, FTM_UPDATE_STEPS, 640, 4160);
+	i = g_test_profile[0] - 640U;
+	printf("First step of %u periods: ease %u, ease-out %u counts\n", FTM_UPDATE_STEPS, j, i);
+	TEST_CHECK(i > (8U * j), "ease-out first step %u, ease %u", i, j);
+}
+
+/*
+ * @brief: An end of profile interrupt that belongs to a profile already
+ *         stopped must not end the one running now.
+ */
+static void test_stale_dma(void)
+{
+	ftm_speed_chnnlVal(ftm_speed_duty(0.0f));
+	ftm_speed_update(30.0f);
+	TEST_CHECK(ftm_speed_animating(), "no profile after a speed update");
+
+	// The first profile ends, but its interrupt is late:
+	g_stub_edma_flags[FTM_ANIM_DMA_CHNL] |= kEDMA_DoneFlag | kEDMA_InterruptFlag;
+
+	// A new speed restarts the needle from the end of the first profile:
+	ftm_speed_update(10.0f);
+	TEST_CHECK(ftm_speed_animating(), "no profile after the second update");
+	TEST_CHECK(g_needle[FTM_GAUGE_SPEED] == ftm_speed_duty(30.0f),
+			"needle %u, first profile ended on %u", g_needle[FTM_GAUGE_SPEED],
+			ftm_speed_duty(30.0f));
+
+	// The late interrupt is taken with nothing but the interrupt flag:
+	g_stub_edma_flags[FTM_ANIM_DMA_CHNL] |= kEDMA_InterruptFlag;
+	DMA0_IRQHandler();
+	TEST_CHECK(ftm_speed_animating(), "stale interrupt ended the running profile");
+	TEST_CHECK(g_needle[FTM_GAUGE_SPEED] == ftm_speed_duty(30.0f),
+			"stale interrupt moved the needle to %u", g_needle[FTM_GAUGE_SPEED]);
+
+	// The real end leaves the needle on the last value:
+	dma_complete();
+	TEST_CHECK(!ftm_speed_animating(), "profile still running after DONE");
+	TEST_CHECK(g_needle[FTM_GAUGE_SPEED] == ftm_speed_duty(10.0f),
+			"needle %u after the end, expected %u", g_needle[FTM_GAUGE_SPEED],
+			ftm_speed_duty(10.0f));
+
+	// Stopped halfway, the needle stays on the last value streamed:
+	ftm_speed_update(40.0f);
+	g_stub_edma_remaining[FTM_ANIM_DMA_CHNL] = FTM_UPDATE_STEPS - 10U;
+	TEST_CHECK(ftm_speed_anim_stop() == g_profile[9], "stopped needle not on value 10");
+}
+
+/*
+ * @brief: Speed updates closer than the deadband to the target leave the
+ *         needle alone, others start a new profile. A profile started while
+ *         the needle moves eases out only.
+ */
+static void test_deadband(void)
+{
+	uint16_t from = 0;
+
+	ftm_speed_chnnlVal(ftm_speed_duty(20.0f));
+
+	// 0.05 km/h is 4 counts, below the deadband:
+	ftm_speed_update(20.05f);
+	TEST_CHECK(!ftm_speed_animating(), "0.05 km/h change animated");
+	TEST_CHECK(g_dutyCycle[FTM_GAUGE_SPEED] == ftm_speed_duty(20.0f), "target moved");
+
+	// 0.5 km/h is 40 counts, above it:
+	ftm_speed_update(20.5f);
+	TEST_CHECK(ftm_speed_animating(), "0.5 km/h change not animated");
+	TEST_CHECK(g_dutyCycle[FTM_GAUGE_SPEED] == ftm_speed_duty(20.5f), "target not moved");
+
+	// Close to the new target, even while moving, nothing changes:
+	g_stub_edma_remaining[FTM_ANIM_DMA_CHNL] = FTM_UPDATE_STEPS - 4U;
+	ftm_speed_update(20.45f);
+	TEST_CHECK(ftm_speed_animating(), "update within the deadband stopped the needle");
+
+	// A change while moving starts from where the needle is, easing out:
+	from = g_profile[3];
+	ftm_speed_update(25.0f);
+	TEST_CHECK(ftm_speed_animating(), "no profile for 25 km/h");
+	ftm_speed_ease_out_profile(g_test_profile, FTM_UPDATE_STEPS, from, ftm_speed_duty(25.0f));
+	TEST_CHECK(0 == memcmp(g_test_profile, g_profile, FTM_UPDATE_STEPS * sizeof(uint32_t)),
+			"moving needle not eased out from %u", from);
+	dma_complete();
+}
+
+int main(void)
+{
+	ftm_speed_init();
+
+	test_duty();
+	test_profiles();
+	test_stale_dma();
+	test_deadband();
+
+	return test_report();
+}
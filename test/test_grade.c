@@ -0,0 +1,156 @@
+/*
+ * @file     test_grade.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host replay of the road grade on a synthetic trace: flat road
+ *           with hard braking and acceleration, then a 5 % hill. The wheel
+ *           acceleration is fed straight to the module in place of freq.c.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_grade.c fast_math.c -lm
+ *               -o test_grade && ./test_grade
+ */
+
+#include <math.h>
+#include "test.h"
+#include "attitude.c"
+#include "grade.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SIM_RATE_HZ   200U
+#define SIM_DT        (1.0f / SIM_RATE_HZ)
+#define SIM_SECONDS   60U
+#define SIM_HILL      0.05f
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static float g_wheel_accel = 0.0f;
+
+/*
+ * ******************************************************************
+ * Wheel sensor stand-in:
+ * ******************************************************************
+ */
+
+float freq_get_accel(void)
+{
+	return g_wheel_accel;
+}
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Feeds one sample of a steady pitch and longitudinal acceleration,
+ *         as the sensor pipeline does.
+ */
+static void sim_sample(float theta, float accel, bool compensate, bool first)
+{
+	float acc[3] = {0.0f, sinf(theta) + (accel / GRADE_GRAVITY), cosf(theta)};
+	float gyr[3] = {0.0f, 0.0f, 0.0f};
+
+	g_wheel_accel = accel;
+	if (compensate)
+	{
+		grade_compensate(acc);
+	}
+	if (first)
+	{
+		attitude_reset(acc);
+	}
+	attitude_update(gyr, acc, SIM_DT);
+	grade_update();
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Braking at 2.5 m/s^2 and accelerating at 1.5 m/s^2 on the flat
+ *         must not show up as a grade once compensated, and the hill must
+ *         read 5 %.
+ */
+static void test_brake_and_hill(void)
+{
+	float max_err[2] = {0.0f, 0.0f};
+	float theta = 0.0f;
+	float accel = 0.0f;
+	float err = 0.0f;
+	float t = 0.0f;
+	uint32_t comp = 0;
+	uint32_t i = 0;
+
+	for (comp = 0; comp < 2U; comp++)
+	{
+		for (i = 0; i < (SIM_RATE_HZ * SIM_SECONDS); i++)
+		{
+			t = i * SIM_DT;
+			accel = ((t > 10.0f) && (t < 14.0f)) ? -2.5f :
+					((t > 20.0f) && (t < 26.0f)) ? 1.5f : 0.0f;
+			theta = (t > 35.0f) ? atanf(SIM_HILL) : 0.0f;
+
+			sim_sample(theta, accel, (1U == comp), (0U == i));
+
+			err = fabsf(grade_get_degrees() - (theta * GRADE_RAD_2_DEG));
+			if ((t < 34.0f) && (err > max_err[comp]))
+			{
+				max_err[comp] = err;
+			}
+		}
+		printf("%s: flat error %.2f deg at most, hill %.2f deg / %.2f %%\n",
+				comp ? "Compensated" : "Uncompensated", max_err[comp],
+				grade_get_degrees(), grade_get_percent());
+	}
+
+	TEST_CHECK(max_err[0] > 10.0f, "uncompensated braking error only %.2f deg", max_err[0]);
+	TEST_CHECK(max_err[1] < 0.01f, "compensated flat error %.2f deg", max_err[1]);
+	TEST_CHECK(fabsf(grade_get_percent() - (100.0f * SIM_HILL)) < 0.1f,
+			"hill reads %.2f %%", grade_get_percent());
+}
+
+/*
+ * @brief: Percent is limited to what the display fits, both ways.
+ */
+static void test_limit(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < (SIM_RATE_HZ * 5U); i++)
+	{
+		sim_sample(60.0f / GRADE_RAD_2_DEG, 0.0f, true, (0U == i));
+	}
+	TEST_CHECK(GRADE_MAX_PERCENT == grade_get_percent(), "60 deg reads %.1f %%",
+			grade_get_percent());
+
+	for (i = 0; i < (SIM_RATE_HZ * 5U); i++)
+	{
+		sim_sample(-60.0f / GRADE_RAD_2_DEG, 0.0f, true, (0U == i));
+	}
+	TEST_CHECK(-GRADE_MAX_PERCENT == grade_get_percent(), "-60 deg reads %.1f %%",
+			grade_get_percent());
+}
+
+int main(void)
+{
+	test_brake_and_hill();
+	test_limit();
+
+	return test_report();
+}
@@ -0,0 +1,187 @@
+/*
+ * @file     test_gyro_temp.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host checks of the gyro temperature table on a synthetic gyro
+ *           whose bias drifts linearly with the die temperature, with
+ *           noise. The EEPROM is a RAM stand-in.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_gyro_temp.c -lm
+ *               -o test_gyro_temp && ./test_gyro_temp
+ */
+
+#include <math.h>
+#include <string.h>
+#include "test.h"
+#include "gyro_temp.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Gyro noise standing still and with the bike ridden, rad/s peak:
+#define SIM_GYR_NOISE  0.002
+#define SIM_GYR_RIDDEN 0.2
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Bias at 0 degC and its drift, rad/s and rad/s per degC:
+static const double g_bias_0[3] = {0.01, -0.02, 0.005};
+static const double g_drift[3] = {0.0004, 0.0002, -0.0003};
+static uint8_t g_eeprom[4096];
+
+/*
+ * ******************************************************************
+ * EEPROM stand-in:
+ * ******************************************************************
+ */
+
+uint32_t RTC_mod_read_mem(mem_data_t * data)
+{
+	memcpy(data->data_array, &g_eeprom[data->address], data->size);
+
+	return kStatus_Success;
+}
+
+uint32_t RTC_mod_write_block(mem_data_t * data)
+{
+	memcpy(&g_eeprom[data->address], data->data_array, data->size);
+
+	return kStatus_Success;
+}
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Feeds the given number of samples at a temperature, the wheel
+ *         stopped or not, with the given gyro noise.
+ */
+static void sim_samples(double temp, uint32_t samples, bool stopped, double noise)
+{
+	float gyro[3];
+	uint32_t n = 0;
+	uint32_t i = 0;
+
+	gyro_temp_set_stopped(stopped);
+	for (n = 0; n < samples; n++)
+	{
+		for (i = 0; i < 3U; i++)
+		{
+			gyro[i] = (float)(g_bias_0[i] + (g_drift[i] * temp) + (noise * test_noise()));
+		}
+		gyro_temp_add_sample((float)temp, gyro);
+	}
+}
+
+/*
+ * @brief: Largest error of the bias read at a temperature, rad/s, or -1 if
+ *         none is given.
+ */
+static double sim_bias_error(double temp)
+{
+	float bias[3];
+	double err = 0.0;
+	uint32_t i = 0;
+
+	if (!gyro_temp_get_bias((float)temp, bias))
+	{
+		return -1.0;
+	}
+	for (i = 0; i < 3U; i++)
+	{
+		err = fmax(err, fabs(bias[i] - (g_bias_0[i] + (g_drift[i] * temp))));
+	}
+
+	return err;
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Learned at 20 and 40 degC, the bias at 30 degC is their
+ *         midpoint, held flat up to 10 degC past them and not given
+ *         further. The table survives a save and a load.
+ */
+static void test_learn(void)
+{
+	gyro_temp_table_t saved;
+	double mid = 0.0;
+	double near = 0.0;
+	float bias[3];
+
+	test_seed(40U);
+	TEST_CHECK(!gyro_temp_load(), "table loaded from a blank EEPROM");
+	TEST_CHECK(!gyro_temp_get_bias(25.0f, bias), "bias given by an empty table");
+	TEST_CHECK(fabs(gyro_temp_celsius(-521) - 35.0f) < 0.01f, "raw -521 is %.2f degC",
+			gyro_temp_celsius(-521));
+
+	sim_samples(20.0, 5U * GYRO_TEMP_WINDOW, true, SIM_GYR_NOISE);
+	sim_samples(40.0, 5U * GYRO_TEMP_WINDOW, true, SIM_GYR_NOISE);
+	mid = sim_bias_error(30.0);
+	near = sim_bias_error(40.0);
+	printf("Learned at 20 and 40 degC: off by %.5f rad/s at 30 degC, %.5f at 40 degC\n", mid,
+			near);
+	TEST_CHECK((mid >= 0.0) && (mid < 0.0005), "off by %.5f rad/s at 30 degC", mid);
+	TEST_CHECK((near >= 0.0) && (near < 0.0005), "off by %.5f rad/s at 40 degC", near);
+	TEST_CHECK(sim_bias_error(50.0) >= 0.0, "no bias 10 degC past the last bin");
+	TEST_CHECK(sim_bias_error(51.0) < 0.0, "bias given 11 degC past the last bin");
+	TEST_CHECK(sim_bias_error(9.0) < 0.0, "bias given 11 degC below the first bin");
+	TEST_CHECK(gyro_temp_dirty(), "learned table not dirty");
+
+	TEST_CHECK(kStatus_Success == gyro_temp_save(), "save failed");
+	TEST_CHECK(!gyro_temp_dirty(), "saved table still dirty");
+	saved = g_table;
+	memset(&g_table, 0, sizeof(g_table));
+	TEST_CHECK(gyro_temp_load(), "saved table not loaded");
+	TEST_CHECK(0 == memcmp(&saved, &g_table, sizeof(g_table)), "loaded table differs");
+}
+
+/*
+ * @brief: Windows with the wheel turning, even briefly, or with the gyro
+ *         moving are not learned.
+ */
+static void test_reject(void)
+{
+	gyro_temp_table_t before = g_table;
+
+	sim_samples(0.0, 3U * GYRO_TEMP_WINDOW, false, SIM_GYR_NOISE);
+	sim_samples(0.0, 3U * GYRO_TEMP_WINDOW, true, SIM_GYR_RIDDEN);
+
+	// Stopped but for one sample of the window:
+	sim_samples(0.0, GYRO_TEMP_WINDOW / 2U, true, SIM_GYR_NOISE);
+	sim_samples(0.0, 1U, false, SIM_GYR_NOISE);
+	sim_samples(0.0, (GYRO_TEMP_WINDOW / 2U) - 1U, true, SIM_GYR_NOISE);
+	TEST_CHECK(0 == memcmp(&before, &g_table, sizeof(g_table)), "table changed");
+	TEST_CHECK(!gyro_temp_dirty(), "table dirty after rejected windows");
+
+	// The next whole window stopped is learned again:
+	sim_samples(0.0, GYRO_TEMP_WINDOW, true, SIM_GYR_NOISE);
+	printf("Wheel turning or gyro at %.1f rad/s: not learned, %u still window learned after\n",
+			SIM_GYR_RIDDEN, g_table.weight[2]);
+	TEST_CHECK(1U == g_table.weight[2], "%u windows learned at 0 degC", g_table.weight[2]);
+}
+
+int main(void)
+{
+	test_learn();
+	test_reject();
+
+	return test_report();
+}
@@ -0,0 +1,175 @@
+/*
+ * @file     test_imu_cadence.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host replays of the IMU cadence estimate on synthetic frame
+ *           sway: a pedaling fundamental, its second harmonic and noise,
+ *           noise alone, and an hour-long ride checked against a direct
+ *           DFT of the window.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_imu_cadence.c fast_math.c
+ *               -lm -o test_imu_cadence && ./test_imu_cadence
+ */
+
+#include <math.h>
+#include "test.h"
+#include "imu_cadence.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SIM_RATE_HZ   200U
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Roll rate of the frame at time t, pedaling at rpm: 0.08 rad/s of
+ *         fundamental, 0.03 rad/s of second harmonic and 0.05 rad/s of
+ *         noise, peak.
+ */
+static float sim_sway(double t, float rpm)
+{
+	double f = rpm / 60.0;
+
+	return (float)((0.08 * sin(2.0 * M_PI * f * t)) +
+			(0.03 * sin((4.0 * M_PI * f * t) + 1.0)) + (0.05 * test_noise()));
+}
+
+/*
+ * @brief: Largest difference between the sliding bins and a direct DFT of
+ *         the window with the same damping, relative to the largest bin.
+ */
+static double sdft_error(void)
+{
+	double max_diff = 0.0;
+	double max_mag = 0.0;
+	double angle = 0.0;
+	double re = 0.0;
+	double im = 0.0;
+	double gain = 0.0;
+	double x = 0.0;
+	uint32_t k = 0;
+	uint32_t m = 0;
+
+	// X_k = sum of (r e^(i w_k))^(m + 1) times the sample m steps old:
+	for (k = 0; k < IMU_CAD_BINS; k++)
+	{
+		re = 0.0;
+		im = 0.0;
+		for (m = 0; m < IMU_CAD_WINDOW; m++)
+		{
+			x = g_window[(g_head - 1U - m) & IMU_CAD_WINDOW_MASK];
+			angle = (2.0 * M_PI * (IMU_CAD_FIRST_BIN + k) * (m + 1U)) / IMU_CAD_WINDOW;
+			gain = pow(IMU_CAD_DAMPING, m + 1U);
+			re += x * gain * cos(angle);
+			im += x * gain * sin(angle);
+		}
+		max_diff = fmax(max_diff, hypot(g_bin_re[k] - re, g_bin_im[k] - im));
+		max_mag = fmax(max_mag, hypot(re, im));
+	}
+
+	return max_diff / max_mag;
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Pedaling from 45 to 120 RPM, read after 20 s.
+ */
+static void test_cadence(void)
+{
+	static const float rpms[] = {45.0f, 62.5f, 78.0f, 85.0f, 97.0f, 110.0f, 120.0f};
+	float max_err = 0.0f;
+	float conf = 0.0f;
+	float rpm = 0.0f;
+	uint32_t i = 0;
+	uint32_t j = 0;
+
+	test_seed(43U);
+	printf("Cadence from sway, after 20 s:\n");
+	for (j = 0; j < (sizeof(rpms) / sizeof(rpms[0])); j++)
+	{
+		imu_cadence_init();
+		for (i = 0; i < (SIM_RATE_HZ * 20U); i++)
+		{
+			imu_cadence_add_sample(sim_sway((double)i / SIM_RATE_HZ, rpms[j]));
+		}
+		rpm = imu_cadence_get(&conf);
+		max_err = fmaxf(max_err, fabsf(rpm - rpms[j]));
+		printf("  %5.1f RPM: reads %5.1f, confidence %.2f\n", rpms[j], rpm, conf);
+		TEST_CHECK(conf >= IMU_CAD_MIN_CONF, "%.1f RPM: confidence %.2f", rpms[j], conf);
+	}
+	printf("  max error %.2f RPM\n", max_err);
+	TEST_CHECK(max_err <= 1.5f, "max error %.2f RPM", max_err);
+}
+
+/*
+ * @brief: Sway without pedaling gives no cadence, weak or strong.
+ */
+static void test_noise_only(void)
+{
+	static const float levels[] = {0.05f, 0.5f};
+	float conf = 0.0f;
+	float rpm = 0.0f;
+	uint32_t i = 0;
+	uint32_t j = 0;
+
+	for (j = 0; j < (sizeof(levels) / sizeof(levels[0])); j++)
+	{
+		imu_cadence_init();
+		for (i = 0; i < (SIM_RATE_HZ * 20U); i++)
+		{
+			imu_cadence_add_sample(levels[j] * (float)test_noise());
+		}
+		rpm = imu_cadence_get(&conf);
+		printf("Noise only, %.2f rad/s: %.1f RPM, confidence %.2f\n", levels[j], rpm, conf);
+		TEST_CHECK(0.0f == rpm, "%.2f rad/s noise read as %.1f RPM", levels[j], rpm);
+	}
+}
+
+/*
+ * @brief: An hour at 90 RPM. The sliding bins must still match a direct
+ *         DFT of the window, and the cadence be right.
+ */
+static void test_long_run(void)
+{
+	float conf = 0.0f;
+	float rpm = 0.0f;
+	double err = 0.0;
+	uint32_t i = 0;
+
+	imu_cadence_init();
+	for (i = 0; i < (SIM_RATE_HZ * 3600U); i++)
+	{
+		imu_cadence_add_sample(sim_sway((double)i / SIM_RATE_HZ, 90.0f));
+	}
+	rpm = imu_cadence_get(&conf);
+	err = sdft_error();
+	printf("After 1 h at 90 RPM: %.1f RPM, confidence %.2f, bins vs direct DFT %.1e\n",
+			rpm, conf, err);
+	TEST_CHECK(fabsf(rpm - 90.0f) <= 1.5f, "%.1f RPM after 1 h", rpm);
+	TEST_CHECK(err < 1e-3, "sliding DFT drifted, %.1e", err);
+}
+
+int main(void)
+{
+	test_cadence();
+	test_noise_only();
+	test_long_run();
+
+	return test_report();
+}
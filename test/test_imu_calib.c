@@ -0,0 +1,240 @@
+/*
+ * @file     test_imu_calib.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host checks of the standstill IMU calibration on a synthetic
+ *           sensor mounted 62 deg about X, with accelerometer and gyro
+ *           noise and a gyro bias, and of the automatic runs only being
+ *           kept upright. The EEPROM is a RAM stand-in.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_imu_calib.c fast_math.c -lm
+ *               -o test_imu_calib && ./test_imu_calib
+ */
+
+#include <math.h>
+#include <string.h>
+#include "test.h"
+#include "imu_calib.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+// Sensor mounting about X, deg:
+#define SIM_MOUNT     62.0
+// Accelerometer noise, g peak, and gyro noise, rad/s peak:
+#define SIM_ACC_NOISE 0.01
+#define SIM_GYR_NOISE 0.002
+// Gyro noise of a bike being moved, rad/s peak:
+#define SIM_GYR_MOVING 0.2
+#define DEG_RAD       (M_PI / 180.0)
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static const float g_gyro_bias[3] = {0.01f, -0.02f, 0.005f};
+static uint8_t g_eeprom[4096];
+
+/*
+ * ******************************************************************
+ * EEPROM stand-in:
+ * ******************************************************************
+ */
+
+uint32_t RTC_mod_read_mem(mem_data_t * data)
+{
+	memcpy(data->data_array, &g_eeprom[data->address], data->size);
+
+	return kStatus_Success;
+}
+
+uint32_t RTC_mod_write_block(mem_data_t * data)
+{
+	memcpy(&g_eeprom[data->address], data->data_array, data->size);
+
+	return kStatus_Success;
+}
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Reading of the mounted sensor with the bicycle pitched the given
+ *         angle about X: gravity turned into the sensor frame, plus the
+ *         prototype accelerometer offsets and the gyro bias.
+ */
+static void sim_reading(double pitch, double acc_noise, double gyr_noise, float acc[3],
+		float gyro[3])
+{
+	double a = (SIM_MOUNT + pitch) * DEG_RAD;
+	uint32_t i = 0;
+
+	acc[0] = (float)(IMU_CALIB_DEF_ACC_X + (acc_noise * test_noise()));
+	acc[1] = (float)(sin(a) + IMU_CALIB_DEF_ACC_Y + (acc_noise * test_noise()));
+	acc[2] = (float)(cos(a) + IMU_CALIB_DEF_ACC_Z + (acc_noise * test_noise()));
+	for (i = 0; i < 3U; i++)
+	{
+		gyro[i] = (float)(g_gyro_bias[i] + (gyr_noise * test_noise()));
+	}
+}
+
+/*
+ * @brief: Tilt from the vertical of a corrected reading, deg.
+ */
+static double sim_tilt(double pitch)
+{
+	float acc[3];
+	float gyro[3];
+
+	sim_reading(pitch, 0.0, 0.0, acc, gyro);
+	imu_calib_apply(acc, gyro);
+
+	return acos(acc[2] / sqrt((acc[0] * acc[0]) + (acc[1] * acc[1]) + (acc[2] * acc[2]))) /
+			DEG_RAD;
+}
+
+/*
+ * @brief: Runs a whole calibration with the bicycle pitched the given
+ *         angle and the given gyro noise, started by the rider or not.
+ */
+static imu_calib_state_t sim_calibrate(double pitch, double gyr_noise, bool automatic)
+{
+	float acc[3];
+	float gyro[3];
+	uint32_t i = 0;
+
+	if (automatic)
+	{
+		imu_calib_start_auto();
+	}
+	else
+	{
+		imu_calib_start();
+	}
+	for (i = 0; i < IMU_CALIB_SAMPLES; i++)
+	{
+		sim_reading(pitch, SIM_ACC_NOISE, gyr_noise, acc, gyro);
+		imu_calib_add_sample(acc, gyro);
+	}
+
+	return imu_calib_get_state();
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Calibrated at standstill on level ground, a level bicycle reads
+ *         0 deg and a 5 deg pitch reads 5 deg, and the gyro bias is
+ *         learned. The values survive a save and a load.
+ */
+static void test_standstill(void)
+{
+	imu_calib_t saved;
+	imu_calib_state_t state;
+	double level = 0.0;
+	double pitched = 0.0;
+	double bias_err = 0.0;
+	uint32_t i = 0;
+
+	test_seed(39U);
+	TEST_CHECK(!imu_calib_load(), "calibration loaded from a blank EEPROM");
+	printf("Defaults on a %.0f deg mount: level reads %.2f deg\n", SIM_MOUNT, sim_tilt(0.0));
+
+	state = sim_calibrate(0.0, SIM_GYR_NOISE, false);
+	level = sim_tilt(0.0);
+	pitched = sim_tilt(5.0);
+	for (i = 0; i < 3U; i++)
+	{
+		bias_err = fmax(bias_err, fabs(g_calib.gyro_bias[i] - g_gyro_bias[i]));
+	}
+	printf("Calibrated: level reads %.2f deg, 5 deg pitch reads %.2f deg, gyro bias off by"
+			" %.5f rad/s at most\n", level, pitched, bias_err);
+	TEST_CHECK(IMU_CALIB_DONE == state, "calibration state %d", state);
+	TEST_CHECK(imu_calib_is_valid() && imu_calib_changed(), "calibration not in use");
+	TEST_CHECK(level < 0.05, "level reads %.2f deg", level);
+	TEST_CHECK(fabs(pitched - 5.0) < 0.05, "5 deg pitch reads %.2f deg", pitched);
+	TEST_CHECK(bias_err < 0.0005, "gyro bias off by %.5f rad/s", bias_err);
+
+	TEST_CHECK(kStatus_Success == imu_calib_save(), "save failed");
+	saved = g_calib;
+	memset(&g_calib, 0, sizeof(g_calib));
+	TEST_CHECK(imu_calib_load(), "saved calibration not loaded");
+	TEST_CHECK(0 == memcmp(&saved, &g_calib, sizeof(g_calib)), "loaded values differ");
+
+	// A flipped bit fails the checksum, the defaults are back:
+	g_eeprom[IMU_CALIB_EEPROM_ADDR + 8U] ^= 0x01U;
+	TEST_CHECK(!imu_calib_load(), "corrupted calibration loaded");
+	TEST_CHECK(fabs(sim_tilt(0.0) - (SIM_MOUNT - 55.0)) < 0.5, "defaults not restored");
+	g_eeprom[IMU_CALIB_EEPROM_ADDR + 8U] ^= 0x01U;
+}
+
+/*
+ * @brief: A bike moved during the calibration is rejected, and the values
+ *         in use are kept.
+ */
+static void test_moving(void)
+{
+	imu_calib_state_t state;
+	imu_calib_t before;
+
+	imu_calib_load();
+	before = g_calib;
+	imu_calib_changed();
+	state = sim_calibrate(0.0, SIM_GYR_MOVING, false);
+	printf("Moving, %.1f rad/s gyro noise: state %s\n", SIM_GYR_MOVING,
+			(IMU_CALIB_FAILED == state) ? "failed" : "not failed");
+	TEST_CHECK(IMU_CALIB_FAILED == state, "moving calibration state %d", state);
+	TEST_CHECK(0 == memcmp(&before, &g_calib, sizeof(g_calib)), "values changed");
+	TEST_CHECK(!imu_calib_changed(), "change flagged after a rejected calibration");
+}
+
+/*
+ * @brief: An automatic calibration is only kept with gravity near the
+ *         vertical of the default 55 deg mounting: the 62 deg mount standing
+ *         level is rejected, and pitched 7 deg back onto the default it is
+ *         kept.
+ */
+static void test_auto(void)
+{
+	imu_calib_state_t tilted;
+	imu_calib_state_t upright;
+	imu_calib_t before;
+
+	imu_calib_load();
+	before = g_calib;
+	tilted = sim_calibrate(0.0, SIM_GYR_NOISE, true);
+	TEST_CHECK(IMU_CALIB_FAILED == tilted, "automatic run %.0f deg off the default state %d",
+			SIM_MOUNT - 55.0, tilted);
+	TEST_CHECK(0 == memcmp(&before, &g_calib, sizeof(g_calib)), "values changed");
+
+	upright = sim_calibrate(55.0 - SIM_MOUNT, SIM_GYR_NOISE, true);
+	printf("Automatic: %.0f deg off the default mount %s, on it %s\n", SIM_MOUNT - 55.0,
+			(IMU_CALIB_FAILED == tilted) ? "failed" : "not failed",
+			(IMU_CALIB_DONE == upright) ? "done" : "not done");
+	TEST_CHECK(IMU_CALIB_DONE == upright, "automatic run on the default mount state %d",
+			upright);
+}
+
+int main(void)
+{
+	test_standstill();
+	test_moving();
+	test_auto();
+
+	return test_report();
+}
@@ -0,0 +1,257 @@
+/*
+ * @file     test_mpu6050_fifo.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host checks of the MPU6050 FIFO acquisition: frame decoding and
+ *           the non-blocking read, step by step. Each I2C transfer started
+ *           is captured by the SDK stand-in, the test fills the transfer
+ *           buffer as the sensor would and calls the completion callback.
+ *           The sensor pipeline the samples feed is not exercised here.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_mpu6050_fifo.c fast_math.c
+ *               spsc_ring.c test/stubs/host_timebase.c test/stubs/sdk_stubs.c
+ *               -lm -o test_mpu6050_fifo && ./test_mpu6050_fifo
+ */
+
+#include "test.h"
+#include "host_timebase.h"
+#include "MPU6050.c"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+extern uint32_t g_stub_i2c_started;
+extern i2c_master_transfer_t g_stub_i2c_last;
+
+/*
+ * ******************************************************************
+ * Sensor pipeline stand-ins:
+ * ******************************************************************
+ */
+
+void attitude_get_gravity(float gravity[3]) { (void)gravity; }
+bool attitude_ready(void) { return true; }
+void attitude_reset(const float acc[3]) { (void)acc; }
+void attitude_update(const float gyro[3], const float acc[3], float dt)
+{ (void)gyro; (void)acc; (void)dt; }
+void crash_init(void) { }
+void crash_add_sample(uint32_t timestamp, const float acc[3],
+		const float gyro[3], const float gravity[3])
+{ (void)timestamp; (void)acc; (void)gyro; (void)gravity; }
+void grade_compensate(float acc[3]) { (void)acc; }
+float grade_get_degrees(void) { return 0.0f; }
+void grade_update(void) { }
+void gyro_temp_add_sample(float temp, const float gyro[3]) { (void)temp; (void)gyro; }
+float gyro_temp_celsius(int16_t raw) { return (float)raw; }
+bool gyro_temp_get_bias(float temp, float bias[3]) { (void)temp; (void)bias; return false; }
+bool gyro_temp_load(void) { return false; }
+void imu_cadence_add_sample(float roll_rate) { (void)roll_rate; }
+void imu_calib_add_sample(const float acc[3], const float gyro[3]) { (void)acc; (void)gyro; }
+void imu_calib_apply(float acc[3], float gyro[3]) { (void)acc; (void)gyro; }
+bool imu_calib_changed(void) { return false; }
+void imu_calib_get_gyro_bias(float bias[3]) { (void)bias; }
+bool imu_calib_load(void) { return false; }
+void roughness_add_sample(float acc_z) { (void)acc_z; }
+void skid_add_sample(uint32_t timestamp, float accel, float dt)
+{ (void)timestamp; (void)accel; (void)dt; }
+void speed_fusion_predict(float accel, float dt) { (void)accel; (void)dt; }
+
+/*
+ * ******************************************************************
+ * Simulated sensor:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Writes the big-endian frame of sample number n: every value
+ *         holds n, negated for the gyro, so frames can be told apart.
+ */
+static void sensor_frame(uint8_t * frame, uint32_t n)
+{
+	int16_t values[7];
+	uint32_t i = 0;
+
+	for (i = 0; i < 7U; i++)
+	{
+		values[i] = (i < 4U) ? (int16_t)(n + i) : (int16_t)(-(int32_t)(n + i));
+		frame[2U * i]        = (uint8_t)((uint16_t)values[i] >> 8);
+		frame[(2U * i) + 1U] = (uint8_t)values[i];
+	}
+}
+
+/*
+ * @brief: Data-ready pulses, as many as it takes to start a FIFO read.
+ */
+static void sensor_drdy(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < MPU_DRDY_DECIMATION; i++)
+	{
+		MPU6050_int_callback(1U << MPU_INT_PIN);
+	}
+}
+
+/*
+ * @brief: Answers the FIFO count read with a byte count.
+ */
+static void sensor_count(uint32_t bytes)
+{
+	g_xfer_buff[0] = (uint8_t)(bytes >> 8);
+	g_xfer_buff[1] = (uint8_t)bytes;
+	MPU6050_xfer_callback(I2C0, &g_i2c_handle, kStatus_Success, NULL);
+}
+
+/*
+ * @brief: Answers a burst read with consecutive frames, from number n.
+ */
+static void sensor_frames(uint32_t n)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < (g_stub_i2c_last.dataSize / MPU_SAMPLE_BYTES); i++)
+	{
+		sensor_frame(&g_xfer_buff[i * MPU_SAMPLE_BYTES], n + i);
+	}
+	MPU6050_xfer_callback(I2C0, &g_i2c_handle, kStatus_Success, NULL);
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Frame decoding: big-endian signed values in register order,
+ *         whole frames only, no more than asked for.
+ */
+static void test_parse(void)
+{
+	uint8_t data[(3U * MPU_SAMPLE_BYTES) + 7U] = {0};
+	MPU6050_sample_t samples[4];
+	uint32_t i = 0;
+
+	for (i = 0; i < 3U; i++)
+	{
+		sensor_frame(&data[i * MPU_SAMPLE_BYTES], 1000U * i);
+	}
+
+	// Three frames and half of a fourth one:
+	TEST_CHECK(3U == MPU6050_parse_frames(data, sizeof(data), samples, 4), "partial frame parsed");
+	TEST_CHECK((2000 == samples[2].acc.AcX) && (2001 == samples[2].acc.AcY) &&
+			(2002 == samples[2].acc.AcZ) && (2003 == samples[2].temp),
+			"frame 3 accel/temp %d %d %d %d", samples[2].acc.AcX, samples[2].acc.AcY,
+			samples[2].acc.AcZ, samples[2].temp);
+	TEST_CHECK((-2004 == samples[2].gyro.GyX) && (-2005 == samples[2].gyro.GyY) &&
+			(-2006 == samples[2].gyro.GyZ), "frame 3 gyro %d %d %d",
+			samples[2].gyro.GyX, samples[2].gyro.GyY, samples[2].gyro.GyZ);
+
+	TEST_CHECK(2U == MPU6050_parse_frames(data, sizeof(data), samples, 2), "max not honoured");
+	TEST_CHECK(0U == MPU6050_parse_frames(data, MPU_SAMPLE_BYTES - 1U, samples, 4),
+			"frame of 13 bytes parsed");
+}
+
+/*
+ * @brief: A FIFO holding 20 frames and part of another is read in bursts of
+ *         MPU_FIFO_BURST. The partial frame is left for the next read, and
+ *         all frames are stamped one sample period apart, back from the
+ *         time the count was read, however long the bursts take.
+ */
+static void test_bursts(void)
+{
+	MPU6050_sample_t sample;
+	uint64_t count_time = 0;
+	uint64_t expect = 0;
+	uint32_t started = g_stub_i2c_started;
+	uint32_t frames = 20U;
+	uint32_t burst = 0;
+	uint32_t n = 0;
+	bool stamps_ok = true;
+	bool order_ok = true;
+
+	host_timebase_set_sec(10.0);
+	sensor_drdy();
+	TEST_CHECK((started + 1U) == g_stub_i2c_started, "no read after %u pulses", MPU_DRDY_DECIMATION);
+	TEST_CHECK((MPU_XFER_COUNT == g_xfer_state) && (MPU_FIFO_COUNT_H == g_stub_i2c_last.subaddress) &&
+			(2U == g_stub_i2c_last.dataSize), "FIFO count not read first");
+
+	count_time = timebase_us();
+	sensor_count((frames * MPU_SAMPLE_BYTES) + 6U);
+
+	// Each burst takes 3 ms on the bus:
+	while (MPU_XFER_FRAMES == g_xfer_state)
+	{
+		TEST_CHECK(MPU_FIFO_R_W == g_stub_i2c_last.subaddress, "burst not from the FIFO");
+		TEST_CHECK(0U == (g_stub_i2c_last.dataSize % MPU_SAMPLE_BYTES), "burst of %u bytes",
+				(uint32_t)g_stub_i2c_last.dataSize);
+		burst = g_stub_i2c_last.dataSize / MPU_SAMPLE_BYTES;
+		host_timebase_set(timebase_ticks() + (3U * TIMEBASE_TICKS_PER_SEC / 1000U));
+		sensor_frames(n);
+		n += burst;
+	}
+
+	TEST_CHECK(MPU_XFER_IDLE == g_xfer_state, "read not over");
+	TEST_CHECK(frames == n, "%u frames read, %u whole in the FIFO", n, frames);
+	TEST_CHECK((started + 1U + 3U) == g_stub_i2c_started, "%u transfers for 20 frames",
+			g_stub_i2c_started - started);
+
+	for (n = 0; MPU6050_get_sample(&sample); n++)
+	{
+		expect = count_time - ((uint64_t)(frames - 1U - n) * MPU_SAMPLE_US);
+		stamps_ok &= (sample.timestamp == expect);
+		order_ok &= (sample.acc.AcX == (int16_t)n);
+	}
+	printf("Bursts: %u frames, stamps %s, %u us apart\n", n, stamps_ok ? "exact" : "off",
+			MPU_SAMPLE_US);
+	TEST_CHECK(frames == n, "%u samples in the ring", n);
+	TEST_CHECK(stamps_ok, "timestamps not one sample period apart");
+	TEST_CHECK(order_ok, "frames out of order");
+}
+
+/*
+ * @brief: A full FIFO has lost frame alignment: it is reset, not read. A
+ *         count below a frame, or a failed transfer, ends the read.
+ */
+static void test_overflow(void)
+{
+	MPU6050_fifo_stats_t before = MPU6050_get_fifo_stats();
+	MPU6050_fifo_stats_t after;
+
+	sensor_drdy();
+	sensor_count(MPU_FIFO_SIZE);
+	TEST_CHECK((MPU_XFER_RESET == g_xfer_state) && (kI2C_Write == g_stub_i2c_last.direction) &&
+			(MPU_USER_CTRL == g_stub_i2c_last.subaddress) &&
+			((MPU_USER_FIFO_EN | MPU_USER_FIFO_RESET) == g_stub_i2c_last.data[0]),
+			"overflow did not reset the FIFO");
+	MPU6050_xfer_callback(I2C0, &g_i2c_handle, kStatus_Success, NULL);
+	TEST_CHECK(MPU_XFER_IDLE == g_xfer_state, "not idle after the reset");
+	TEST_CHECK(!MPU6050_get_sample(&(MPU6050_sample_t){0}), "samples after an overflow");
+
+	sensor_drdy();
+	sensor_count(MPU_SAMPLE_BYTES - 1U);
+	TEST_CHECK(MPU_XFER_IDLE == g_xfer_state, "partial frame alone was read");
+
+	sensor_drdy();
+	MPU6050_xfer_callback(I2C0, &g_i2c_handle, kStatus_Fail, NULL);
+	TEST_CHECK(MPU_XFER_IDLE == g_xfer_state, "not idle after a bus error");
+
+	after = MPU6050_get_fifo_stats();
+	TEST_CHECK((before.overflows + 1U) == after.overflows, "overflow not counted");
+	TEST_CHECK((before.bus_errors + 1U) == after.bus_errors, "bus error not counted");
+}
+
+int main(void)
+{
+	test_parse();
+	test_bursts();
+	test_overflow();
+
+	return test_report();
+}
@@ -0,0 +1,216 @@
+/*
+ * @file     test_roughness.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host checks of the road roughness module: the built-in real
+ *           FFT against a direct DFT, its host run time, and the band
+ *           energies of pure vibrations ridden at a steady speed. The wheel
+ *           frequency is fed straight to the module in place of freq.c.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_roughness.c fast_math.c -lm
+ *               -o test_roughness && ./test_roughness
+ */
+
+#include <math.h>
+#include <time.h>
+#include "test.h"
+#include "roughness.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define BENCH_RUNS    200000U
+// Riding speed of the vibration replays, m/s:
+#define SIM_SPEED     5.0f
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static float g_wheel_freq = 0.0f;
+
+/*
+ * ******************************************************************
+ * Wheel sensor stand-in:
+ * ******************************************************************
+ */
+
+float freq_get_freq(void)
+{
+	return g_wheel_freq;
+}
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Rides 30 s at SIM_SPEED over a sine vibration of the given RMS
+ *         (in g) and frequency, processing blocks as the main loop would.
+ *         Returns the last completed interval.
+ */
+static roughness_segment_t sim_ride(float rms_g, float hz)
+{
+	roughness_segment_t segment = {0};
+	uint32_t i = 0;
+
+	roughness_init();
+	g_wheel_freq = SIM_SPEED / FREQ_WHEEL_CIRC;
+	for (i = 0; i < (200U * 30U); i++)
+	{
+		roughness_add_sample(1.0f + (rms_g * sqrtf(2.0f) *
+				sinf((2.0f * FAST_MATH_PI * hz * i) / ROUGH_SAMPLE_RATE)));
+		if (0U == (i % 20U))
+		{
+			roughness_process();
+		}
+	}
+	roughness_get_segment(0, &segment);
+
+	return segment;
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: The packed real FFT output must match a direct DFT.
+ */
+static void test_fft(void)
+{
+	static float x[ROUGH_FFT_SIZE];
+	static float d[ROUGH_FFT_SIZE];
+	double max_err = 0.0;
+	double re = 0.0;
+	double im = 0.0;
+	double got_re = 0.0;
+	double got_im = 0.0;
+	double err = 0.0;
+	double us = 0.0;
+	clock_t start = 0;
+	uint32_t k = 0;
+	uint32_t n = 0;
+
+	roughness_init();
+	test_seed(42U);
+	for (n = 0; n < ROUGH_FFT_SIZE; n++)
+	{
+		x[n] = (float)test_noise();
+		d[n] = x[n];
+	}
+	roughness_fft(d);
+
+	for (k = 0; k <= (ROUGH_FFT_SIZE / 2U); k++)
+	{
+		re = 0.0;
+		im = 0.0;
+		for (n = 0; n < ROUGH_FFT_SIZE; n++)
+		{
+			re += x[n] * cos((2.0 * M_PI * k * n) / ROUGH_FFT_SIZE);
+			im -= x[n] * sin((2.0 * M_PI * k * n) / ROUGH_FFT_SIZE);
+		}
+
+		// DC and Nyquist are packed in the first two slots:
+		got_re = (0U == k) ? d[0] : ((ROUGH_FFT_SIZE / 2U) == k) ? d[1] : d[2U * k];
+		got_im = ((0U == k) || ((ROUGH_FFT_SIZE / 2U) == k)) ? 0.0 : d[(2U * k) + 1U];
+		err = fabs(got_re - re) + fabs(got_im - im);
+		max_err = (err > max_err) ? err : max_err;
+	}
+
+	// Host run time, for reference only:
+	start = clock();
+	for (n = 0; n < BENCH_RUNS; n++)
+	{
+		roughness_fft(d);
+		d[0] = x[0];
+	}
+	us = ((double)(clock() - start) / CLOCKS_PER_SEC) * 1e6 / BENCH_RUNS;
+
+	printf("FFT: max error vs DFT %.1e, host %.2f us per %u-point block\n", max_err, us,
+			ROUGH_FFT_SIZE);
+	TEST_CHECK(max_err < 2e-5, "FFT error %.1e", max_err);
+}
+
+/*
+ * @brief: A pure vibration reads its RMS value, all in the band holding
+ *         its frequency, and a 150 m ride gives one 100 m interval.
+ */
+static void test_bands(void)
+{
+	static const float tones[] = {3.0f, 10.0f, 20.0f, 60.0f};
+	static const uint32_t bands[] = {0, 1, 2, 3};
+	roughness_segment_t segment;
+	roughness_stats_t before;
+	roughness_stats_t stats;
+	float expect = 0.3f * ROUGH_GRAVITY;
+	float total = 0.0f;
+	uint32_t i = 0;
+	uint32_t b = 0;
+
+	for (i = 0; i < (sizeof(tones) / sizeof(tones[0])); i++)
+	{
+		before = roughness_get_stats();
+		segment = sim_ride(0.3f, tones[i]);
+		stats = roughness_get_stats();
+		total = 0.0f;
+		for (b = 0; b < ROUGH_BANDS; b++)
+		{
+			total += segment.band[b];
+		}
+
+		printf("%4.0f Hz, 0.3 g RMS: %.3f m/s^2 (expect %.3f), %.1f %% in band %u,"
+				" %.1f m, %u blocks\n", tones[i], segment.rms, expect,
+				100.0f * segment.band[bands[i]] / total, bands[i], segment.distance,
+				segment.blocks);
+		TEST_CHECK(fabsf(segment.rms - expect) < (0.02f * expect), "%.0f Hz: %.3f m/s^2",
+				tones[i], segment.rms);
+		TEST_CHECK(segment.band[bands[i]] > (0.99f * total), "%.0f Hz: energy outside band %u",
+				tones[i], bands[i]);
+		TEST_CHECK(1U == (stats.segments - before.segments), "%u intervals in 150 m",
+				stats.segments - before.segments);
+		TEST_CHECK(stats.overruns == before.overruns, "%u overruns",
+				stats.overruns - before.overruns);
+	}
+}
+
+/*
+ * @brief: Without the main loop taking blocks, the first one waits and
+ *         every later one is lost and counted.
+ */
+static void test_overrun(void)
+{
+	uint32_t before = 0;
+	uint32_t i = 0;
+
+	roughness_init();
+	before = roughness_get_stats().overruns;
+	for (i = 0; i < (5U * ROUGH_FFT_SIZE); i++)
+	{
+		roughness_add_sample(1.0f);
+	}
+	TEST_CHECK(4U == (roughness_get_stats().overruns - before), "%u overruns for 5 blocks",
+			roughness_get_stats().overruns - before);
+	TEST_CHECK(roughness_process(), "no block waiting");
+}
+
+int main(void)
+{
+	test_fft();
+	test_bands();
+	test_overrun();
+
+	return test_report();
+}
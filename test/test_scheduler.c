@@ -0,0 +1,218 @@
+/*
+ * @file     test_scheduler.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host replay of the cooperative scheduler against a simulated
+ *           event source: five tasks posted at the rates of the bicycle
+ *           computer, each running a set time. WFI jumps the time base to
+ *           the next event, so a minute of running takes a moment.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_scheduler.c
+ *               test/stubs/host_timebase.c test/stubs/sdk_stubs.c
+ *               -o test_scheduler && ./test_scheduler
+ */
+
+#include "test.h"
+#include "host_timebase.h"
+
+// Sleeping moves the simulation to the next event:
+void sim_wfi(void);
+#define __WFI sim_wfi
+#include "scheduler.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SIM_TASKS     5U
+#define SIM_SECONDS   60U
+#define TICKS_PER_SEC ((uint64_t)TIMEBASE_TICKS_PER_SEC)
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Each task is posted at its own period and runs for its cost, plus up
+// to a quarter more. IMU batch, wheel, 100 ms refresh, screen and touch:
+static const uint64_t g_period[SIM_TASKS] = {
+		TICKS_PER_SEC / 50U, TICKS_PER_SEC / 50U, TICKS_PER_SEC / 10U,
+		TICKS_PER_SEC / 2U, TICKS_PER_SEC / 10U};
+static const uint64_t g_cost[SIM_TASKS] = {
+		TICKS_PER_SEC / 10000U, TICKS_PER_SEC / 5000U, TICKS_PER_SEC / 2000U,
+		TICKS_PER_SEC / 100U, TICKS_PER_SEC / 1000U};
+
+static uint64_t g_next_event[SIM_TASKS];
+static uint32_t g_posted[SIM_TASKS];
+static uint32_t g_order_errors = 0;
+static uint32_t g_torn_stats = 0;
+
+/*
+ * ******************************************************************
+ * Simulated event source:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Posts every task whose event came by now, as its interrupt would,
+ *         and reads a task's counters from there as an interrupt may.
+ */
+static void sim_fire_due(void)
+{
+	scheduler_task_stats_t stats;
+	uint64_t now = timebase_ticks();
+	uint32_t k = 0;
+
+	for (k = 0; k < SIM_TASKS; k++)
+	{
+		while (g_next_event[k] <= now)
+		{
+			scheduler_post(k);
+			g_posted[k]++;
+			g_next_event[k] += g_period[k];
+
+			stats = scheduler_get_task_stats(k);
+			if ((stats.total_us < stats.max_us) ||
+				(stats.total_us > ((uint64_t)stats.runs * stats.max_us)))
+			{
+				g_torn_stats++;
+			}
+		}
+	}
+}
+
+void sim_wfi(void)
+{
+	uint64_t next = UINT64_MAX;
+	uint32_t k = 0;
+
+	for (k = 0; k < SIM_TASKS; k++)
+	{
+		if (g_next_event[k] < next)
+		{
+			next = g_next_event[k];
+		}
+	}
+	if (next > timebase_ticks())
+	{
+		host_timebase_set(next);
+	}
+}
+
+/*
+ * @brief: Body of every task: no higher priority task may be waiting when
+ *         it runs. Then its time passes, and the events due meanwhile are
+ *         posted.
+ */
+static void sim_task(uint32_t task)
+{
+	uint32_t k = 0;
+
+	for (k = 0; k < task; k++)
+	{
+		if (g_ready & (1U << k))
+		{
+			g_order_errors++;
+		}
+	}
+
+	host_timebase_set(timebase_ticks() + g_cost[task] + test_rand((g_cost[task] / 4U) + 1U));
+	sim_fire_due();
+}
+
+static void task_0(void) { sim_task(0U); }
+static void task_1(void) { sim_task(1U); }
+static void task_2(void) { sim_task(2U); }
+static void task_3(void) { sim_task(3U); }
+static void task_4(void) { sim_task(4U); }
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: A minute of running: tasks in priority order, each post run
+ *         once at most, and the idle share matching the time the tasks
+ *         did not take.
+ */
+static void test_run(void)
+{
+	static void (* const handlers[SIM_TASKS])(void) = {task_0, task_1, task_2, task_3, task_4};
+	scheduler_task_stats_t stats;
+	uint64_t busy_us = 0;
+	double total_us = 0.0;
+	double expected = 0.0;
+	float idle = 0.0f;
+	uint32_t k = 0;
+
+	test_seed(49U);
+	host_timebase_set(0);
+	scheduler_init();
+	for (k = 0; k < SIM_TASKS; k++)
+	{
+		scheduler_add_task(k, handlers[k]);
+		g_next_event[k] = g_period[k];
+	}
+
+	while (timebase_ticks() < (SIM_SECONDS * TICKS_PER_SEC))
+	{
+		if (!scheduler_run_once())
+		{
+			scheduler_idle();
+			sim_fire_due();
+		}
+	}
+
+	for (k = 0; k < SIM_TASKS; k++)
+	{
+		stats = scheduler_get_task_stats(k);
+		busy_us += stats.total_us;
+		printf("Task %u: posted %u, ran %u, %u us at most, %llu us mean\n", k, g_posted[k],
+				stats.runs, stats.max_us, (unsigned long long)(stats.total_us / stats.runs));
+		TEST_CHECK((stats.runs <= g_posted[k]) && (stats.runs + 1U >= g_posted[k]),
+				"task %u ran %u times for %u posts", k, stats.runs, g_posted[k]);
+	}
+
+	idle = scheduler_get_idle_percent();
+	total_us = (double)timebase_ticks_to_us(timebase_ticks());
+	expected = 100.0 * (1.0 - ((double)busy_us / total_us));
+	printf("Idle %.3f %%, %.3f %% from the task times, %u out of order, %u torn counters\n",
+			idle, expected, g_order_errors, g_torn_stats);
+	TEST_CHECK(0U == g_order_errors, "%u tasks run out of order", g_order_errors);
+	TEST_CHECK(0U == g_torn_stats, "%u torn counters", g_torn_stats);
+	TEST_CHECK((idle - expected) < 0.01 && (expected - idle) < 0.01,
+			"idle %.3f %%, expected %.3f %%", idle, expected);
+}
+
+/*
+ * @brief: Several posts before a run make one run.
+ */
+static void test_posts(void)
+{
+	scheduler_init();
+	scheduler_add_task(2U, task_2);
+	scheduler_post(2U);
+	scheduler_post(2U);
+	scheduler_post(2U);
+	TEST_CHECK(scheduler_run_once(), "posted task did not run");
+	TEST_CHECK(!scheduler_run_once(), "three posts ran more than once");
+	TEST_CHECK(1U == scheduler_get_task_stats(2U).runs, "%u runs",
+			scheduler_get_task_stats(2U).runs);
+	TEST_CHECK(!scheduler_run_once() && (0U == g_ready), "task left ready");
+}
+
+int main(void)
+{
+	test_run();
+	test_posts();
+
+	return test_report();
+}
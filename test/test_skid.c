@@ -0,0 +1,284 @@
+/*
+ * @file     test_skid.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host replays of the skid detection on synthetic rides: hard
+ *           braking, locked and spinning wheels, a bumpy road and an IMU
+ *           bias. The wheel edges are simulated from its speed and fed to
+ *           the module through a freq.c timing stand-in.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_skid.c -lm -o test_skid
+ *               && ./test_skid
+ */
+
+#include <math.h>
+#include "test.h"
+#include "skid.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SIM_RATE_HZ   200U
+#define SIM_DT        (1.0 / SIM_RATE_HZ)
+#define SIM_SECONDS   20U
+// Start of the event in every ride, s:
+#define SIM_EVENT     10.0
+// Fixed IMU offset left after calibration, m/s^2:
+#define SIM_OFFSET    0.2
+
+typedef enum{
+	RIDE_BRAKE,
+	RIDE_LOCK,
+	RIDE_LOCK_FAST,
+	RIDE_SPIN,
+	RIDE_BUMPY
+}ride_t;
+
+typedef struct{
+	skid_stats_t stats;
+	skid_event_t event;
+	bool logged;
+	int32_t flagged;          // ms from SIM_EVENT to the alert, -1 if none.
+}ride_result_t;
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Simulated time and the last two wheel edges, s (negative if none yet):
+static double g_time = 0.0;
+static double g_last_edge = -1.0;
+static double g_prev_edge = -1.0;
+
+/*
+ * ******************************************************************
+ * Wheel sensor stand-in:
+ * ******************************************************************
+ */
+
+void freq_get_timing(freq_channel_t channel, float * period, float * age)
+{
+	double last = g_last_edge - g_prev_edge;
+
+	(void)channel;
+
+	// Stopped after three turns' time without an edge, as freq.c does:
+	if ((g_prev_edge < 0.0) || ((g_time - g_last_edge) > (3.0 * last)))
+	{
+		*period = 0.0f;
+		*age = 0.0f;
+		return;
+	}
+
+	*period = (float)last;
+	*age = (float)(g_time - g_last_edge);
+}
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Speed of the bicycle and of the wheel at time t, in m/s: a
+ *         1 m/s^2 start to a cruise speed, then the event of the ride.
+ */
+static void sim_speeds(ride_t ride, double t, double * bike, double * wheel)
+{
+	double cruise = (RIDE_LOCK_FAST == ride) ? 11.0 : (RIDE_SPIN == ride) ? 4.0 :
+			(RIDE_BUMPY == ride) ? 6.0 : 7.0;
+	double v = fmin(cruise, t);
+
+	switch (ride)
+	{
+		case RIDE_BRAKE:
+		case RIDE_LOCK:
+		case RIDE_LOCK_FAST:
+			// 5 m/s^2 braking, the wheel locked for the first part of it:
+			if (t > SIM_EVENT)
+			{
+				v = fmax(0.0, cruise - (5.0 * (t - SIM_EVENT)));
+			}
+			*bike = v;
+			*wheel = v;
+			if (((RIDE_LOCK == ride) && (t > SIM_EVENT) && (t < (SIM_EVENT + 1.0))) ||
+				((RIDE_LOCK_FAST == ride) && (t > SIM_EVENT) && (t < (SIM_EVENT + 0.8))))
+			{
+				*wheel = 0.0;
+			}
+		break;
+
+		case RIDE_SPIN:
+			*bike = v;
+			*wheel = ((t > SIM_EVENT) && (t < (SIM_EVENT + 0.6))) ? 7.5 : v;
+		break;
+
+		default:
+			// Rolling hills, the speed changing slowly:
+			*bike = v + ((t > 6.0) ? sin(t * 0.3) : 0.0);
+			*wheel = *bike;
+		break;
+	}
+}
+
+/*
+ * @brief: Rides SIM_SECONDS with the event from SIM_EVENT on, adding the
+ *         IMU samples at 200 Hz with the given noise (g peak) and bias
+ *         (m/s^2), and checking every 4 samples as the pipeline does.
+ */
+static ride_result_t sim_ride(ride_t ride, float noise, float bias)
+{
+	ride_result_t result = {0};
+	double travel = 0.0;
+	double bike = 0.0;
+	double wheel = 0.0;
+	double prev = 0.0;
+	double accel = 0.0;
+	uint32_t i = 0;
+
+	skid_init();
+	test_seed(45U);
+	g_last_edge = -1.0;
+	g_prev_edge = -1.0;
+	result.flagged = -1;
+	sim_speeds(ride, 0.0, &prev, &wheel);
+
+	for (i = 0; i < (SIM_RATE_HZ * SIM_SECONDS); i++)
+	{
+		g_time = i * SIM_DT;
+		sim_speeds(ride, g_time, &bike, &wheel);
+		travel += wheel * SIM_DT;
+		if (travel >= FREQ_WHEEL_CIRC)
+		{
+			travel -= FREQ_WHEEL_CIRC;
+			g_prev_edge = g_last_edge;
+			g_last_edge = g_time;
+		}
+
+		accel = ((bike - prev) / SIM_DT) + SIM_OFFSET + bias +
+				(noise * SKID_GRAVITY * test_noise());
+		prev = bike;
+		skid_add_sample((uint32_t)(g_time * 1000.0 + 0.5), (float)accel, (float)SIM_DT);
+		if (3U == (i % 4U))
+		{
+			skid_check();
+		}
+
+		if ((result.flagged < 0) && (SKID_NONE != skid_get_alert()))
+		{
+			result.flagged = (int32_t)((g_time - SIM_EVENT) * 1000.0 + 0.5);
+		}
+	}
+
+	result.stats = skid_get_stats();
+	result.logged = skid_get_event(0, &result.event);
+
+	return result;
+}
+
+/*
+ * @brief: Checks one skid was flagged, of the given type, with a reported
+ *         latency no shorter than the true one.
+ */
+static void check_skid(const char * name, ride_result_t * result, skid_type_t type)
+{
+	uint32_t count = (SKID_LOCK == type) ? result->stats.locks : result->stats.spins;
+
+	printf("%-18s: flagged %4d ms after the onset, reported latency %3u ms, %4u ms long,"
+			" %.1f m/s, slip %.2f\n", name, result->flagged, result->event.latency,
+			result->event.duration, result->event.speed, result->event.slip);
+	TEST_CHECK((1U == count) && ((result->stats.locks + result->stats.spins) == 1U),
+			"%s: %u locks, %u spins", name, result->stats.locks, result->stats.spins);
+	TEST_CHECK(result->logged && ((uint32_t)type == result->event.type), "%s: event not logged",
+			name);
+	TEST_CHECK((result->flagged > 0) && (result->flagged <= 500), "%s: flagged after %d ms",
+			name, result->flagged);
+	TEST_CHECK(result->event.latency >= (uint32_t)result->flagged,
+			"%s: reported latency %u ms under the true %d ms", name, result->event.latency,
+			result->flagged);
+}
+
+/*
+ * @brief: Checks nothing was flagged.
+ */
+static void check_none(const char * name, ride_result_t * result)
+{
+	printf("%-18s: %u locks, %u spins\n", name, result->stats.locks, result->stats.spins);
+	TEST_CHECK(0U == (result->stats.locks + result->stats.spins) && !result->logged,
+			"%s: %u locks, %u spins", name, result->stats.locks, result->stats.spins);
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Hard braking with the wheel rolling, and rolling hills, even on a
+ *         bumpy road, are no skid.
+ */
+static void test_no_skid(void)
+{
+	ride_result_t result;
+
+	result = sim_ride(RIDE_BRAKE, 0.05f, 0.0f);
+	check_none("Braking", &result);
+	result = sim_ride(RIDE_BUMPY, 0.5f, 0.0f);
+	check_none("Bumpy, 0.5 g", &result);
+	result = sim_ride(RIDE_BRAKE, 0.5f, 0.0f);
+	check_none("Braking, 0.5 g", &result);
+}
+
+/*
+ * @brief: A wheel locked under braking at 25 and 40 km/h, and one spinning
+ *         at almost twice the bicycle speed, are flagged within a turn and
+ *         a half.
+ */
+static void test_skids(void)
+{
+	ride_result_t result;
+
+	result = sim_ride(RIDE_LOCK, 0.05f, 0.0f);
+	check_skid("Lock, 25 km/h", &result, SKID_LOCK);
+	result = sim_ride(RIDE_LOCK_FAST, 0.05f, 0.0f);
+	check_skid("Lock, 40 km/h", &result, SKID_LOCK);
+	result = sim_ride(RIDE_SPIN, 0.05f, 0.0f);
+	check_skid("Spin, 14 km/h", &result, SKID_SPIN);
+	result = sim_ride(RIDE_LOCK, 0.5f, 0.0f);
+	check_skid("Lock, 0.5 g", &result, SKID_LOCK);
+}
+
+/*
+ * @brief: A 0.06 g IMU bias, corrected at every turn, flags nothing on its
+ *         own and still lets a lock-up through.
+ */
+static void test_bias(void)
+{
+	ride_result_t result;
+
+	result = sim_ride(RIDE_BRAKE, 0.05f, 0.06f * SKID_GRAVITY);
+	check_none("Braking, 0.06 g", &result);
+	result = sim_ride(RIDE_BUMPY, 0.05f, -0.06f * SKID_GRAVITY);
+	check_none("Hills, -0.06 g", &result);
+	result = sim_ride(RIDE_LOCK, 0.05f, 0.06f * SKID_GRAVITY);
+	check_skid("Lock, 0.06 g", &result, SKID_LOCK);
+}
+
+int main(void)
+{
+	test_no_skid();
+	test_skids();
+	test_bias();
+
+	return test_report();
+}
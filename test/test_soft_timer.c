@@ -0,0 +1,337 @@
+/*
+ * @file     test_soft_timer.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host checks of the software timers: the wheel is run to each
+ *           deadline it returns, sometimes late as a busy interrupt would,
+ *           with thousands of one-shot timers cascading down its levels,
+ *           a periodic timer, and callbacks that start and stop timers.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_soft_timer.c
+ *               test/stubs/host_timebase.c test/stubs/sdk_stubs.c
+ *               -o test_soft_timer && ./test_soft_timer
+ */
+
+#include "test.h"
+#include "host_timebase.h"
+#include "soft_timer.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SIM_TIMERS    3000U
+// Every n-th timer is stopped before it expires:
+#define SIM_STOP_EVERY 7U
+#define SIM_PERIOD    100U
+#define SIM_RUN_MS    3200000U
+// Worst lateness of a simulated wake up, ms:
+#define SIM_LATE_MS   50U
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static uint64_t g_ms = 0;
+
+static soft_timer_t g_timers[SIM_TIMERS];
+static uint64_t g_expires[SIM_TIMERS];
+static uint64_t g_fired[SIM_TIMERS];
+static uint64_t g_last_expires = 0;
+static uint32_t g_order_errors = 0;
+static uint32_t g_early = 0;
+static uint32_t g_count = 0;
+
+static soft_timer_t g_periodic;
+static uint64_t g_periodic_start = 0;
+static uint32_t g_periodic_count = 0;
+static uint32_t g_periodic_early = 0;
+static uint64_t g_periodic_lag = 0;
+
+// Callback order checks:
+static soft_timer_t g_a;
+static soft_timer_t g_b;
+static soft_timer_t g_c;
+static uint32_t g_a_count = 0;
+static uint32_t g_b_count = 0;
+static uint32_t g_c_count = 0;
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Sets the time base to a time in ms.
+ */
+static void sim_set_ms(uint64_t ms)
+{
+	g_ms = ms;
+	host_timebase_set(ms * SOFT_TIMER_TICKS_PER_MS);
+}
+
+/*
+ * @brief: Runs the wheel to each deadline it returns, one in ten up to
+ *         SIM_LATE_MS late, until it is empty or the given time is passed.
+ *         Returns the number of wake ups.
+ */
+static uint32_t sim_run(uint64_t until, bool late)
+{
+	uint64_t next = 0;
+	uint32_t wakes = 0;
+
+	while (soft_timer_advance(g_ms, &next) && (g_ms < until))
+	{
+		sim_set_ms(next + ((late && (0U == test_rand(10U))) ? test_rand(SIM_LATE_MS) : 0U));
+		wakes++;
+	}
+
+	return wakes;
+}
+
+static void one_shot_callback(void * context)
+{
+	uint32_t i = (uint32_t)(uintptr_t)context;
+
+	g_fired[i] = g_ms;
+	if (g_expires[i] < g_last_expires)
+	{
+		g_order_errors++;
+	}
+	g_last_expires = g_expires[i];
+	if (g_ms < g_expires[i])
+	{
+		g_early++;
+	}
+	g_count++;
+}
+
+static void periodic_callback(void * context)
+{
+	uint64_t due = 0;
+
+	(void)context;
+
+	g_periodic_count++;
+	due = g_periodic_start + ((uint64_t)g_periodic_count * SIM_PERIOD);
+	if (g_ms < due)
+	{
+		g_periodic_early++;
+	}
+	else if ((g_ms - due) > g_periodic_lag)
+	{
+		g_periodic_lag = g_ms - due;
+	}
+}
+
+// Stops a timer due in the same slot and starts another one:
+static void a_callback(void * context)
+{
+	(void)context;
+
+	g_a_count++;
+	soft_timer_stop(&g_b);
+	soft_timer_start(&g_c, 7U, 0U);
+}
+
+static void b_callback(void * context)
+{
+	(void)context;
+
+	g_b_count++;
+}
+
+// Starts itself again, 100 times in all:
+static void c_callback(void * context)
+{
+	(void)context;
+
+	g_c_count++;
+	if (g_c_count < 100U)
+	{
+		soft_timer_start(&g_c, 7U, 0U);
+	}
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: 3000 one-shot timers up to 50 minutes ahead, past the reach of
+ *         the wheel, every 7th one stopped, and a 100 ms periodic timer,
+ *         run for 3200 s. Every timer fires once, in expiry order, never
+ *         early and no later than the wake up was. The periodic one keeps
+ *         to whole periods from its start.
+ */
+static void test_many(void)
+{
+	uint32_t timeout = 0;
+	uint32_t wakes = 0;
+	uint32_t stopped_fired = 0;
+	uint32_t lost = 0;
+	uint32_t late = 0;
+	uint32_t stopped = 0;
+	uint32_t i = 0;
+
+	test_seed(48U);
+	sim_set_ms(12345U);
+	soft_timer_init();
+
+	for (i = 0; i < SIM_TIMERS; i++)
+	{
+		timeout = 1U + ((0U == test_rand(5U)) ? test_rand(3000000U) : test_rand(5000U));
+		soft_timer_setup(&g_timers[i], one_shot_callback, (void *)(uintptr_t)i);
+		soft_timer_start(&g_timers[i], timeout, 0U);
+		g_expires[i] = g_ms + timeout;
+	}
+	for (i = 0; i < SIM_TIMERS; i += SIM_STOP_EVERY)
+	{
+		soft_timer_stop(&g_timers[i]);
+		stopped++;
+	}
+	soft_timer_setup(&g_periodic, periodic_callback, NULL);
+	soft_timer_start(&g_periodic, SIM_PERIOD, SIM_PERIOD);
+	g_periodic_start = g_ms;
+
+	wakes = sim_run(g_ms + SIM_RUN_MS, true);
+
+	for (i = 0; i < SIM_TIMERS; i++)
+	{
+		if (0U == (i % SIM_STOP_EVERY))
+		{
+			stopped_fired += (0U != g_fired[i]);
+		}
+		else if (0U == g_fired[i])
+		{
+			lost++;
+		}
+		else if ((g_fired[i] - g_expires[i]) > SIM_LATE_MS)
+		{
+			late++;
+		}
+	}
+
+	printf("%u one-shot timers: %u fired, %u lost, %u late, %u early, %u out of order,"
+			" %u stopped fired, %u wake ups\n", SIM_TIMERS, g_count, lost, late, g_early,
+			g_order_errors, stopped_fired, wakes);
+	printf("Periodic %u ms: %u expiries in %llu ms, %u early, lag %llu ms at most\n",
+			SIM_PERIOD, g_periodic_count, (unsigned long long)(g_ms - g_periodic_start),
+			g_periodic_early, (unsigned long long)g_periodic_lag);
+	TEST_CHECK((SIM_TIMERS - stopped) == g_count, "%u of %u fired", g_count, SIM_TIMERS - stopped);
+	TEST_CHECK((0U == lost) && (0U == late) && (0U == g_early), "%u lost, %u late, %u early",
+			lost, late, g_early);
+	TEST_CHECK(0U == g_order_errors, "%u out of order", g_order_errors);
+	TEST_CHECK(0U == stopped_fired, "%u stopped timers fired", stopped_fired);
+	TEST_CHECK(((g_ms - g_periodic_start) / SIM_PERIOD) == g_periodic_count,
+			"periodic fired %u times in %llu ms", g_periodic_count,
+			(unsigned long long)(g_ms - g_periodic_start));
+	TEST_CHECK((0U == g_periodic_early) && (g_periodic_lag < SIM_LATE_MS),
+			"periodic %u early, lag %llu ms", g_periodic_early, (unsigned long long)g_periodic_lag);
+	soft_timer_stop(&g_periodic);
+}
+
+/*
+ * @brief: A callback stops a timer due in the same slot, which then does
+ *         not fire, and a timer restarting itself from its callback runs
+ *         back to back.
+ */
+static void test_callbacks(void)
+{
+	sim_set_ms(0U);
+	soft_timer_init();
+	soft_timer_setup(&g_a, a_callback, NULL);
+	soft_timer_setup(&g_b, b_callback, NULL);
+	soft_timer_setup(&g_c, c_callback, NULL);
+
+	// The last one started in a slot runs first:
+	soft_timer_start(&g_b, 10U, 0U);
+	soft_timer_start(&g_a, 10U, 0U);
+	sim_set_ms(1U);
+	sim_run(UINT64_MAX, false);
+
+	printf("Callbacks: A %u, B %u, C %u, done at %llu ms\n", g_a_count, g_b_count, g_c_count,
+			(unsigned long long)g_ms);
+	TEST_CHECK((1U == g_a_count) && (0U == g_b_count), "A %u, B %u", g_a_count, g_b_count);
+	TEST_CHECK(100U == g_c_count, "C %u", g_c_count);
+	TEST_CHECK((10U + (100U * 7U)) == g_ms, "done at %llu ms", (unsigned long long)g_ms);
+}
+
+/*
+ * @brief: Once empty, the wheel jumps to the time base when a timer is
+ *         started, however long it sat idle.
+ */
+static void test_stale_wheel(void)
+{
+	uint64_t next = 0;
+
+	sim_set_ms(g_ms + 5000000U);
+	soft_timer_start(&g_a, 3U, 0U);
+	soft_timer_advance(g_ms, &next);
+	TEST_CHECK(3U == (next - g_ms), "next deadline %llu ms ahead after idling",
+			(unsigned long long)(next - g_ms));
+	soft_timer_stop(&g_a);
+}
+
+/*
+ * @brief: A start read the time base before the interrupt ran the wheel
+ *         past it. The timer is placed from the wheel time: a 1 ms timer
+ *         is due 1 ms after it, with other timers running or none, and the
+ *         wheel never goes back.
+ */
+static void test_start_behind_wheel(void)
+{
+	uint64_t next = 0;
+	uint32_t fired = 0;
+	uint32_t pass = 0;
+
+	for (pass = 0; pass < 2U; pass++)
+	{
+		sim_set_ms(100000U);
+		soft_timer_init();
+		soft_timer_setup(&g_a, b_callback, NULL);
+		soft_timer_setup(&g_b, b_callback, NULL);
+		if (0U == pass)
+		{
+			soft_timer_start(&g_b, 500U, 0U);
+		}
+
+		// The interrupt ran the wheel 10 ms past the time base read:
+		soft_timer_advance(g_ms + 10U, &next);
+		g_b_count = 0;
+		soft_timer_start(&g_a, 1U, 0U);
+		soft_timer_advance(g_ms + 10U, &next);
+		TEST_CHECK((g_ms + 11U) == next, "%s: 1 ms timer due %lld ms after the read",
+				pass ? "empty wheel" : "running wheel", (long long)(next - g_ms));
+		TEST_CHECK(g_wheel_time == (g_ms + 10U), "%s: wheel moved back %lld ms",
+				pass ? "empty wheel" : "running wheel", (long long)(g_ms + 10U - g_wheel_time));
+
+		fired = g_b_count;
+		soft_timer_advance(g_ms + 11U, &next);
+		fired = g_b_count - fired;
+		TEST_CHECK(1U == fired, "%s: 1 ms timer fired %u times at 11 ms",
+				pass ? "empty wheel" : "running wheel", fired);
+		soft_timer_stop(&g_b);
+	}
+	printf("Start behind the wheel: a 1 ms timer fires 1 ms after the wheel time\n");
+}
+
+int main(void)
+{
+	test_many();
+	test_callbacks();
+	test_stale_wheel();
+	test_start_behind_wheel();
+
+	return test_report();
+}
@@ -0,0 +1,293 @@
+/*
+ * @file     test_speed_fusion.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host replay of the fused speed on a synthetic ride: a start,
+ *           surging, hard braking, riding at 1 m/s and a stop, with 0.3 g of
+ *           vibration on the IMU. The wheel edges go through freq.c, and the
+ *           fused speed is compared with its predicted speed, read at every
+ *           sample and every 500 ms as the screen used to.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_speed_fusion.c
+ *               speed_fusion.c fast_math.c soft_timer.c spsc_ring.c
+ *               test/stubs/host_timebase.c test/stubs/sdk_stubs.c -lm
+ *               -o test_speed_fusion && ./test_speed_fusion
+ */
+
+#include <math.h>
+#include "test.h"
+#include "host_timebase.h"
+#include "speed_fusion.h"
+#include "freq.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SIM_RATE_HZ   200U
+#define SIM_DT        (1.0 / SIM_RATE_HZ)
+#define SIM_SAMPLES   (SIM_RATE_HZ * 62U)
+// Left standing after the ride, past the wheel timeout:
+#define SIM_STANDING  (SIM_RATE_HZ * 6U)
+// IMU vibration, g peak:
+#define SIM_NOISE     0.3
+#define SIM_GRAVITY   9.80665
+// Lags searched for the best match, in samples:
+#define SIM_LAG_MIN   (-100)
+#define SIM_LAG_MAX   200
+
+typedef enum{
+	EST_FUSED,
+	EST_PREDICTED,
+	EST_SHOWN,
+	EST_COUNT
+}estimate_t;
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+static const char * const g_names[EST_COUNT] = {"fused", "freq predicted", "shown (500 ms)"};
+
+static float g_true[SIM_SAMPLES];
+static float g_estimate[EST_COUNT][SIM_SAMPLES];
+
+/*
+ * ******************************************************************
+ * Skid detection stand-in:
+ * ******************************************************************
+ */
+
+skid_type_t skid_get_alert(void)
+{
+	return SKID_NONE;
+}
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Speed of the ride at time t, in m/s.
+ */
+static double sim_profile(double t)
+{
+	if (t < 8.0)
+	{
+		return t;                                   // 1 m/s^2 start.
+	}
+	if (t < 30.0)
+	{
+		return 8.0 + (1.5 * sin((t - 8.0) * 0.8));  // Surging.
+	}
+	if (t < 32.0)
+	{
+		return 8.0 - (3.5 * (t - 30.0));            // Hard braking to 1 m/s.
+	}
+	if (t < 45.0)
+	{
+		return 1.0 + (0.3 * sin(t));                // Slow riding.
+	}
+	if (t < 55.0)
+	{
+		return fmin(1.3 + ((t - 45.0) * 0.8), 9.0);
+	}
+
+	return fmax(0.0, 9.0 - (2.0 * (t - 55.0)));     // Stop.
+}
+
+/*
+ * @brief: Rides the profile with the given IMU bias (m/s^2): wheel edges
+ *         into freq.c at their exact time, the IMU samples into the filter
+ *         at 200 Hz, corrected every 4 samples as the pipeline does. The
+ *         bicycle is left standing for SIM_STANDING samples after it.
+ */
+static void sim_ride(double bias)
+{
+	freq_edge_t edge;
+	double next_check = FREQ_CHECK_MS / 1000.0;
+	double shown = 0.0;
+	double travel = 0.0;
+	double prev = 0.0;
+	double v = 0.0;
+	double t = 0.0;
+	uint32_t i = 0;
+
+	g_inputs[FREQ_WHEEL].active = false;
+	g_inputs[FREQ_WHEEL].period = 0;
+	freq_history_reset();
+	spsc_ring_flush(&g_edges);
+	host_timebase_set(0);
+	speed_fusion_init();
+	test_seed(46U);
+
+	for (i = 0; i < (SIM_SAMPLES + SIM_STANDING); i++)
+	{
+		t = i * SIM_DT;
+		v = sim_profile(t);
+		if ((travel + (v * SIM_DT)) >= FREQ_WHEEL_CIRC)
+		{
+			// Edge time within the sample, the speed taken as constant:
+			host_timebase_set_sec(t + ((FREQ_WHEEL_CIRC - travel) / v));
+			capture_values(1U << FREQ_WHEEL_PIN);
+			while (freq_get_edge(&edge))
+			{
+			}
+			travel -= FREQ_WHEEL_CIRC;
+		}
+		travel += v * SIM_DT;
+		t += SIM_DT;
+		if (t >= next_check)
+		{
+			host_timebase_set_sec(next_check);
+			no_gpio_pit_callback(NULL);
+			next_check += FREQ_CHECK_MS / 1000.0;
+		}
+		host_timebase_set_sec(t);
+
+		speed_fusion_predict((float)(((v - prev) / SIM_DT) + bias +
+				(SIM_NOISE * SIM_GRAVITY * test_noise())), (float)SIM_DT);
+		prev = v;
+		if (3U == (i % 4U))
+		{
+			speed_fusion_correct();
+		}
+		if (0U == (i % 100U))
+		{
+			shown = freq_get_predicted_freq() * FREQ_WHEEL_CIRC;
+		}
+
+		if (i >= SIM_SAMPLES)
+		{
+			continue;
+		}
+		g_true[i] = (float)v;
+		g_estimate[EST_FUSED][i] = speed_fusion_get();
+		g_estimate[EST_PREDICTED][i] = freq_get_predicted_freq() * FREQ_WHEEL_CIRC;
+		g_estimate[EST_SHOWN][i] = (float)shown;
+	}
+}
+
+/*
+ * @brief: RMS error of an estimate against the true speed it lags by the
+ *         given samples, over samples first to last.
+ */
+static double sim_rms(const float * estimate, int32_t lag, uint32_t first, uint32_t last)
+{
+	double sum = 0.0;
+	double d = 0.0;
+	uint32_t n = 0;
+	uint32_t i = 0;
+
+	for (i = first; i < last; i++)
+	{
+		d = estimate[i] - g_true[i - lag];
+		sum += d * d;
+		n++;
+	}
+
+	return sqrt(sum / n);
+}
+
+/*
+ * @brief: Lag, in samples, at which the estimate matches the true speed
+ *         best.
+ */
+static int32_t sim_best_lag(const float * estimate)
+{
+	double best = 1e9;
+	double rms = 0.0;
+	int32_t best_lag = 0;
+	int32_t lag = 0;
+
+	for (lag = SIM_LAG_MIN; lag <= SIM_LAG_MAX; lag++)
+	{
+		rms = sim_rms(estimate, lag, SIM_RATE_HZ + SIM_LAG_MAX,
+				SIM_SAMPLES - SIM_RATE_HZ + SIM_LAG_MIN);
+		if (rms < best)
+		{
+			best = rms;
+			best_lag = lag;
+		}
+	}
+
+	return best_lag;
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: The fused speed must be closer to the true one and lag less than
+ *         the wheel speed alone, on the whole ride and at 1 m/s, and be 0
+ *         once freq.c has timed the stopped wheel out.
+ */
+static void test_ride(void)
+{
+	double rms[EST_COUNT];
+	int32_t lag[EST_COUNT];
+	double slow[2];
+	speed_fusion_stats_t stats;
+	uint32_t k = 0;
+
+	sim_ride(0.0);
+	stats = speed_fusion_get_stats();
+	printf("62 s ride, 0.3 g vibration:\n");
+	for (k = 0; k < EST_COUNT; k++)
+	{
+		rms[k] = sim_rms(g_estimate[k], 0, SIM_RATE_HZ, SIM_SAMPLES - SIM_RATE_HZ);
+		lag[k] = sim_best_lag(g_estimate[k]);
+		printf("  %-15s %.3f m/s RMS, best match %4d ms behind\n", g_names[k], rms[k],
+				lag[k] * (int32_t)(1000U / SIM_RATE_HZ));
+	}
+	slow[0] = sim_rms(g_estimate[EST_FUSED], 0, SIM_RATE_HZ * 33U, SIM_RATE_HZ * 45U);
+	slow[1] = sim_rms(g_estimate[EST_PREDICTED], 0, SIM_RATE_HZ * 33U, SIM_RATE_HZ * 45U);
+	printf("  at 1 m/s: fused %.3f m/s RMS, freq predicted %.3f\n", slow[0], slow[1]);
+	printf("  %u updates, %u rejects, %u restarts\n", stats.updates, stats.rejects,
+			stats.restarts);
+
+	TEST_CHECK(rms[EST_FUSED] < rms[EST_PREDICTED], "fused %.3f m/s RMS, predicted %.3f",
+			rms[EST_FUSED], rms[EST_PREDICTED]);
+	TEST_CHECK(rms[EST_PREDICTED] < rms[EST_SHOWN], "predicted %.3f m/s RMS, shown %.3f",
+			rms[EST_PREDICTED], rms[EST_SHOWN]);
+	TEST_CHECK(lag[EST_FUSED] < lag[EST_PREDICTED], "fused lags %d samples, predicted %d",
+			lag[EST_FUSED], lag[EST_PREDICTED]);
+	TEST_CHECK(slow[0] < (0.5 * slow[1]), "at 1 m/s fused %.3f m/s RMS, predicted %.3f",
+			slow[0], slow[1]);
+	TEST_CHECK(0.0f == speed_fusion_get(), "%.2f m/s standing after the ride",
+			speed_fusion_get());
+}
+
+/*
+ * @brief: A 0.05 g IMU bias is held back by the wheel turns.
+ */
+static void test_bias(void)
+{
+	double rms = 0.0;
+
+	sim_ride(0.05 * SIM_GRAVITY);
+	rms = sim_rms(g_estimate[EST_FUSED], 0, SIM_RATE_HZ, SIM_SAMPLES - SIM_RATE_HZ);
+	printf("0.05 g IMU bias: fused %.3f m/s RMS\n", rms);
+	TEST_CHECK(rms < sim_rms(g_estimate[EST_PREDICTED], 0, SIM_RATE_HZ,
+			SIM_SAMPLES - SIM_RATE_HZ), "fused %.3f m/s RMS with the bias", rms);
+}
+
+int main(void)
+{
+	test_ride();
+	test_bias();
+
+	return test_report();
+}
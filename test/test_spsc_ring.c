@@ -0,0 +1,222 @@
+/*
+ * @file     test_spsc_ring.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Host checks of the single producer, single consumer rings: a
+ *           producer thread and a consumer thread pass millions of
+ *           checksummed items through a small and a tiny ring, standing in
+ *           for an interrupt and the main loop. Also full, empty and the
+ *           indices wrapping around.
+ *
+ *           From the repository root:
+ *           gcc -O2 -I test/stubs -I . test/test_spsc_ring.c -lpthread
+ *               -o test_spsc_ring && ./test_spsc_ring
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include "test.h"
+#include "spsc_ring.c"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define SIM_ITEMS     2000000U
+#define SIM_HASH      2654435761U
+
+/* 28 bytes, so a torn copy shows up in the words or the checksum: */
+typedef struct{
+	uint32_t seq;
+	uint32_t word[5];
+	uint32_t check;
+}item_t;
+
+/* One side of a stress run: */
+typedef struct{
+	spsc_ring_t * ring;
+	uint32_t yield_every;     // Yields after pushes, 0 only when full.
+	unsigned long waits;      // Full for the producer, empty for the consumer.
+	unsigned long bad;        // Items lost, reordered or torn.
+}side_t;
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+SPSC_RING_DEFINE(g_ring_64, item_t, 64);
+SPSC_RING_DEFINE(g_ring_2, item_t, 2);
+SPSC_RING_DEFINE(g_ring_4, uint32_t, 4);
+
+/*
+ * ******************************************************************
+ * Helpers:
+ * ******************************************************************
+ */
+
+static void * producer(void * context)
+{
+	side_t * side = (side_t *)context;
+	item_t item;
+	uint32_t i = 0;
+	uint32_t k = 0;
+
+	while (i < SIM_ITEMS)
+	{
+		item.seq = i;
+		item.check = i;
+		for (k = 0; k < 5U; k++)
+		{
+			item.word[k] = (i * SIM_HASH) + k;
+			item.check ^= item.word[k];
+		}
+
+		if (spsc_ring_push(side->ring, &item))
+		{
+			i++;
+			if (side->yield_every && (0U == ((i * 7919U) % side->yield_every)))
+			{
+				sched_yield();
+			}
+		}
+		else
+		{
+			side->waits++;
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+static void * consumer(void * context)
+{
+	side_t * side = (side_t *)context;
+	item_t item;
+	uint32_t check = 0;
+	uint32_t i = 0;
+	uint32_t k = 0;
+
+	while (i < SIM_ITEMS)
+	{
+		if (!spsc_ring_pop(side->ring, &item))
+		{
+			side->waits++;
+			sched_yield();
+			continue;
+		}
+
+		check = item.seq;
+		for (k = 0; k < 5U; k++)
+		{
+			if (item.word[k] != ((item.seq * SIM_HASH) + k))
+			{
+				side->bad++;
+			}
+			check ^= item.word[k];
+		}
+		if ((check != item.check) || (item.seq != i))
+		{
+			side->bad++;
+		}
+		i++;
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief: Passes SIM_ITEMS items from a producer thread to a consumer
+ *         thread through a ring.
+ */
+static void stress(const char * name, spsc_ring_t * ring, uint32_t yield_every)
+{
+	side_t produce = {ring, yield_every, 0, 0};
+	side_t consume = {ring, 0, 0, 0};
+	pthread_t producer_thread;
+	pthread_t consumer_thread;
+
+	pthread_create(&consumer_thread, NULL, consumer, &consume);
+	pthread_create(&producer_thread, NULL, producer, &produce);
+	pthread_join(producer_thread, NULL);
+	pthread_join(consumer_thread, NULL);
+
+	printf("%s: %u items, %lu bad, %lu times full, %lu times empty, %u left\n", name,
+			SIM_ITEMS, consume.bad, produce.waits, consume.waits, spsc_ring_count(ring));
+	TEST_CHECK(0U == consume.bad, "%s: %lu items lost, reordered or torn", name, consume.bad);
+	TEST_CHECK(spsc_ring_is_empty(ring), "%s: %u items left", name, spsc_ring_count(ring));
+}
+
+/*
+ * ******************************************************************
+ * Tests:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Two threads on a 64-item ring, and on a 2-item one with the
+ *         producer yielding at varying points, so both sides keep catching
+ *         each other mid copy.
+ */
+static void test_threads(void)
+{
+	stress("64 items", &g_ring_64, 0U);
+	stress("2 items", &g_ring_2, 13U);
+}
+
+/*
+ * @brief: A full ring refuses an item and keeps the ones it has, an empty
+ *         one gives none, and the order holds as the free running indices
+ *         wrap around 2^32.
+ */
+static void test_wrap(void)
+{
+	uint32_t value = 0;
+	uint32_t expect = 0;
+	uint32_t bad = 0;
+	uint32_t i = 0;
+
+	g_ring_4.head = UINT32_MAX - 5U;
+	g_ring_4.tail = UINT32_MAX - 5U;
+	for (i = 0; i < 4U; i++)
+	{
+		spsc_ring_push(&g_ring_4, &i);
+	}
+	TEST_CHECK(!spsc_ring_push(&g_ring_4, &i), "full ring took a fifth item");
+	TEST_CHECK(4U == spsc_ring_count(&g_ring_4), "%u items in a full ring",
+			spsc_ring_count(&g_ring_4));
+
+	// Across the wrap, one out and one in at a time:
+	for (i = 4U; i < 20U; i++)
+	{
+		spsc_ring_pop(&g_ring_4, &value);
+		bad += (value != expect++);
+		spsc_ring_push(&g_ring_4, &i);
+	}
+	while (spsc_ring_pop(&g_ring_4, &value))
+	{
+		bad += (value != expect++);
+	}
+	TEST_CHECK((0U == bad) && (20U == expect), "%u out of order across the wrap, %u taken",
+			bad, expect);
+	TEST_CHECK(spsc_ring_is_empty(&g_ring_4) && !spsc_ring_pop(&g_ring_4, &value),
+			"empty ring gave an item");
+
+	spsc_ring_push(&g_ring_4, &i);
+	spsc_ring_flush(&g_ring_4);
+	TEST_CHECK(spsc_ring_is_empty(&g_ring_4), "items left after a flush");
+}
+
+int main(void)
+{
+	test_threads();
+	test_wrap();
+
+	return test_report();
+}
@@ -0,0 +1,122 @@
+/*
+ * @file     timebase.c
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Source file for the system time base: a free-running PIT channel
+ *           extended to 64 bits in software, so it only interrupts once per
+ *           reload. Gives monotonic timestamps in bus clock ticks, us and ms
+ *           to the pulse inputs, the IMU samples and the event logs.
+ */
+
+#include "timebase.h"
+
+/*
+ * ******************************************************************
+ * Global variables:
+ * ******************************************************************
+ */
+
+// Ticks at the last reload:
+static volatile uint64_t g_epoch = 0;
+
+/*
+ * ******************************************************************
+ * Private function prototypes:
+ * ******************************************************************
+ */
+
+static void timebase_reload(void);
+
+/*
+ * ******************************************************************
+ * Function code:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Sets the clock dividers, initializes the PIT module and starts
+ *         the time base channel from 0. Must be called before any other
+ *         PIT or bus clock user.
+ */
+void timebase_init(void)
+{
+	pit_config_t pit_config;
+
+	g_epoch = 0;
+
+	SIM->CLKDIV1 = TIMEBASE_CLKDIV1;
+
+	PIT_GetDefaultConfig(&pit_config);
+	PIT_Init(PIT, &pit_config);
+	PIT_SetTimerPeriod(PIT, TIMEBASE_PIT_CHNL, TIMEBASE_RELOAD);
+	PIT_EnableInterrupts(PIT, TIMEBASE_PIT_CHNL, kPIT_TimerInterruptEnable);
+	PIT_callback_init(TIMEBASE_PIT_CHNL, timebase_reload);
+	NVIC_enable_interrupt_and_priotity(TIMEBASE_PIT_IRQ, TIMEBASE_PRIORITY);
+
+	PIT_StartTimer(PIT, TIMEBASE_PIT_CHNL);
+}
+
+/*
+ * @brief: Ticks since timebase_init(), at TIMEBASE_TICKS_PER_SEC. Safe to
+ *         call from any context.
+ */
+uint64_t timebase_ticks(void)
+{
+	uint64_t base    = 0;
+	uint32_t count   = 0;
+	uint32_t primask = __get_PRIMASK();
+
+	NVIC_disable_interrupts;
+	base  = g_epoch;
+	count = PIT_GetCurrentTimerCount(PIT, TIMEBASE_PIT_CHNL);
+	if (PIT_GetStatusFlags(PIT, TIMEBASE_PIT_CHNL) & kPIT_TimerFlag)
+	{
+		// Reloaded, but the interrupt hasn't been serviced yet:
+		base += TIMEBASE_RELOAD;
+		count = PIT_GetCurrentTimerCount(PIT, TIMEBASE_PIT_CHNL);
+	}
+	__set_PRIMASK(primask);
+
+	// The PIT counts down from (TIMEBASE_RELOAD - 1):
+	return base + ((uint32_t)TIMEBASE_RELOAD - 1U - count);
+}
+
+/*
+ * @brief: Microseconds since timebase_init().
+ */
+uint64_t timebase_us(void)
+{
+	return timebase_ticks_to_us(timebase_ticks());
+}
+
+/*
+ * @brief: Milliseconds since timebase_init(), wraps around after 49 days.
+ */
+uint32_t timebase_ms(void)
+{
+	return (uint32_t)(timebase_us() / 1000U);
+}
+
+/*
+ * @brief: Converts a number of ticks into microseconds.
+ */
+uint64_t timebase_ticks_to_us(uint64_t ticks)
+{
+	// Whole seconds apart, so the product can't overflow:
+	return ((ticks / TIMEBASE_TICKS_PER_SEC) * 1000000U) +
+			(((ticks % TIMEBASE_TICKS_PER_SEC) * 1000000U) / TIMEBASE_TICKS_PER_SEC);
+}
+
+/*
+ * The following function code corresponds to private (static) functions:
+ */
+
+/*
+ * @brief: PIT callback, called each time the channel reloads.
+ */
+static void timebase_reload(void)
+{
+	g_epoch += TIMEBASE_RELOAD;
+}
@@ -0,0 +1,75 @@
+/*
+ * @file     timebase.h
+ *
+ * @Authors  Juan Pablo Villanueva
+ *           Jose Angel Gonzalez
+ *
+ * @brief    Header file for the system time base: a free-running PIT channel
+ *           extended to 64 bits in software, so it only interrupts once per
+ *           reload. Gives monotonic timestamps in bus clock ticks, us and ms
+ *           to the pulse inputs, the IMU samples and the event logs.
+ */
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#include <stdint.h>
+#include "fsl_pit.h"
+#include "NVIC.h"
+#include "PIT.h"
+
+/*
+ * ******************************************************************
+ * Definitions:
+ * ******************************************************************
+ */
+
+#define TIMEBASE_PIT_CHNL       kPIT_Chnl_3
+#define TIMEBASE_PIT_IRQ        PIT_CH3_IRQ
+// No reader may have a higher priority, it could see the reload flag
+// cleared before the epoch is moved:
+#define TIMEBASE_PRIORITY       PRIORITY_2
+
+// Clock dividers: core /1, bus /2, FlexBus /3 and flash /5. Set before
+// the time base starts, so it never counts at another rate:
+#define TIMEBASE_CLKDIV1        0x01240000U
+// PIT counts per second, the bus clock with the dividers above:
+#define TIMEBASE_TICKS_PER_SEC  10500000U
+// Counts between reloads, 5 s and the only interrupt of the time base:
+#define TIMEBASE_RELOAD         (5U * TIMEBASE_TICKS_PER_SEC)
+
+/*
+ * ******************************************************************
+ * Function prototypes:
+ * ******************************************************************
+ */
+
+/*
+ * @brief: Sets the clock dividers, initializes the PIT module and starts
+ *         the time base channel from 0. Must be called before any other
+ *         PIT or bus clock user.
+ */
+void timebase_init(void);
+
+/*
+ * @brief: Ticks since timebase_init(), at TIMEBASE_TICKS_PER_SEC. Safe to
+ *         call from any context.
+ */
+uint64_t timebase_ticks(void);
+
+/*
+ * @brief: Microseconds since timebase_init().
+ */
+uint64_t timebase_us(void);
+
+/*
+ * @brief: Milliseconds since timebase_init(), wraps around after 49 days.
+ */
+uint32_t timebase_ms(void);
+
+/*
+ * @brief: Converts a number of ticks into microseconds.
+ */
+uint64_t timebase_ticks_to_us(uint64_t ticks);
+
+#endif /* TIMEBASE_H_ */